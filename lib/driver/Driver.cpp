@@ -169,11 +169,31 @@ bool Driver::run() {
       return false;
     }
 
+    // The trace backend is chosen when the program is built, overriding the
+    // configuration
+    if (ParsedDriverArgs_.hasArg(options::OPT_trace_backend)) {
+      auto backend =
+          ParsedDriverArgs_.getLastArgValue(options::OPT_trace_backend);
+      if (backend == "ring") {
+        cfg.get().set_tracebackend(aicnwdesc::RING);
+      } else if (backend == "stm") {
+        cfg.get().set_tracebackend(aicnwdesc::STM);
+      } else {
+        DRIVER_REPORT_ERROR("unknown trace backend " << backend << "\n");
+        return false;
+      }
+    }
+
     context.setProgram(std::make_unique<ComputeProgram>(std::move(cfg)));
   }
 
   std::vector<std::unique_ptr<DriverAction>> actionsToRun;
 
+  // Sources given when linking are compiled first
+  bool hasSources = false;
+  for (auto &input : ParsedDriverArgs_.getAllArgValues(options::OPT_INPUT))
+    hasSources |= Compiler::isSourceFile(input);
+
   // Build list of action to perform
   switch (Mode_) {
   case PreProcess:
@@ -185,16 +205,22 @@ bool Driver::run() {
 
   case Link:
     // Just execute the linker to build a .a, .elf/exe
+    if (hasSources)
+      context.addAction(std::make_unique<CompileAction>(*this));
     context.addAction(std::make_unique<LinkAction>(*this));
     break;
 
   case LinkWithMetadata:
+    if (hasSources)
+      context.addAction(std::make_unique<CompileAction>(*this));
     context.addAction(std::make_unique<LinkAction>(*this));
     context.addAction(std::make_unique<ExtractEntryPointAddressAction>(*this));
     context.addAction(std::make_unique<EmbedMetadataAction>(*this));
     break;
 
   case QPC:
+    if (hasSources)
+      context.addAction(std::make_unique<CompileAction>(*this));
     context.addAction(std::make_unique<LinkAction>(*this));
     context.addAction(std::make_unique<ExtractEntryPointAddressAction>(*this));
     context.addAction(std::make_unique<EmbedMetadataAction>(*this));
@@ -1,14 +1,24 @@
 // Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
 // SPDX-License-Identifier: BSD-3-Clause-Clear
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
+#include <ostream>
+#include <streambuf>
+#include <thread>
 
+#include "elfio/elfio.hpp"
+
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/Object/Binary.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 
 #include "Driver.h"
 #include "DriverAction.h"
@@ -29,6 +39,51 @@ using namespace llvm::object;
 
 #define DEBUG_TYPE "Driver"
 
+namespace {
+// A streambuf that writes to a vector, with the seeks ELFIO saves with, so
+// the ELF is written straight into the buffer handed to BuildQPCAction.
+class VectorStreamBuf : public std::streambuf {
+public:
+  explicit VectorStreamBuf(std::vector<uint8_t> &data) : data_(data) {}
+
+protected:
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    if (pos_ + n > data_.size())
+      data_.resize(pos_ + n);
+    std::copy(s, s + n, data_.begin() + pos_);
+    pos_ += n;
+    return n;
+  }
+
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    char ch = traits_type::to_char_type(c);
+    xsputn(&ch, 1);
+    return c;
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override {
+    off_type base = dir == std::ios_base::beg   ? 0
+                    : dir == std::ios_base::cur ? (off_type)pos_
+                                                : (off_type)data_.size();
+    return seekpos(base + off, which);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::out) || off_type(pos) < 0)
+      return pos_type(off_type(-1));
+    pos_ = off_type(pos);
+    return pos;
+  }
+
+private:
+  std::vector<uint8_t> &data_;
+  size_t pos_{0};
+};
+} // namespace
+
 DriverAction::DriverAction(Driver &D, llvm::StringRef name)
     : D_(D), actionName_(name.str()) {}
 
@@ -60,7 +115,9 @@ CompileAction::CompileAction(Driver &D)
 
 bool CompileAction::preRunCheckImpl(DriverContext &context) const {
 
-  bool compileFlag = false;
+  // When linking, any sources among the inputs are compiled first
+  bool compileFlag = getDriver().isLinkOnlyMode() ||
+                     getDriver().getDriverMode() == Driver::QPC;
   compileFlag |= getDriverArgs().hasArg(options::OPT_c);
   compileFlag |= getDriverArgs().hasArg(options::OPT_E);
   compileFlag |= getDriverArgs().hasArg(options::OPT_S);
@@ -76,20 +133,19 @@ bool CompileAction::preRunCheckImpl(DriverContext &context) const {
 bool CompileAction::runImpl(DriverContext &context) {
   compiler_.getTools().loadStandardEnvPaths();
 
-  compiler_.setOutputFile(getDriverArgs().getLastArgValue(options::OPT_o));
-
-  if (getDriverArgs().hasArg(options::OPT_c)) {
-    compiler_.setSourceFile(
-        getDriverArgs().getLastArgValue(options::OPT_INPUT));
+  bool linking = !getDriverArgs().hasArg(options::OPT_c) &&
+                 !getDriverArgs().hasArg(options::OPT_E) &&
+                 !getDriverArgs().hasArg(options::OPT_S);
+  StringRef outputExt;
+  if (linking || getDriverArgs().hasArg(options::OPT_c)) {
     compiler_.setMode(Compiler::Compile);
+    outputExt = ".o";
   } else if (getDriverArgs().hasArg(options::OPT_E)) {
-    compiler_.setSourceFile(
-        getDriverArgs().getLastArgValue(options::OPT_INPUT));
     compiler_.setMode(Compiler::PreProcess);
+    outputExt = ".i";
   } else if (getDriverArgs().hasArg(options::OPT_S)) {
-    compiler_.setSourceFile(
-        getDriverArgs().getLastArgValue(options::OPT_INPUT));
     compiler_.setMode(Compiler::CompileNoAssemble);
+    outputExt = ".s";
   } else {
     llvm_unreachable("");
     return false;
@@ -169,7 +225,123 @@ bool CompileAction::runImpl(DriverContext &context) {
   compiler_.setLinkStandardLibsFlag(
       getDriverArgs().hasArg(options::OPT_WithStdLibraries));
 
-  return (compiler_.execute() == 0);
+  // Set up the compile cache
+  std::string cacheDir;
+  if (getDriverArgs().hasArg(options::OPT_compile_cache_dir)) {
+    cacheDir =
+        getDriverArgs().getLastArgValue(options::OPT_compile_cache_dir).str();
+  } else if (const char *envDir = std::getenv("QAIC_CC_CACHE_DIR")) {
+    cacheDir = envDir;
+  }
+  if (!cacheDir.empty()) {
+    uint64_t cacheSize = CompileCache::DEFAULT_MAX_SIZE;
+    if (getDriverArgs().hasArg(options::OPT_compile_cache_size)) {
+      auto value = getDriverArgs().getLastArgValue(
+          options::OPT_compile_cache_size);
+      if (value.getAsInteger(10, cacheSize)) {
+        DRIVER_ACTION_REPORT_ERROR("invalid compile cache size '" << value
+                                                                  << "'\n");
+        return false;
+      }
+      cacheSize *= 1024 * 1024;
+    }
+    cache_ = std::make_unique<CompileCache>(cacheDir, cacheSize);
+    compiler_.setCompileCache(cache_.get());
+  }
+
+  // Pick the output of each source. A lone source compiled without linking
+  // goes to -o, otherwise outputs are named after the source like the
+  // compiler does. Objects that only feed the link step are temporary.
+  bool saveTemps = getDriverArgs().hasArg(options::OPT_save_temps);
+  std::vector<std::string> sources, outputs;
+  for (auto &src : getDriverArgs().getAllArgValues(options::OPT_INPUT)) {
+    if (linking && !Compiler::isSourceFile(src))
+      continue;
+    sources.push_back(src);
+  }
+
+  if (!linking && sources.size() > 1 &&
+      getDriverArgs().hasArg(options::OPT_o)) {
+    DRIVER_ACTION_REPORT_ERROR(
+        "cannot specify -o when compiling multiple sources.\n");
+    return false;
+  }
+
+  // Sources of the same name in different directories would write the same
+  // output and, when linking, hand it to the linker twice
+  StringMap<StringRef> outputSources;
+  for (auto &src : sources) {
+    std::string output;
+    if (!linking && getDriverArgs().hasArg(options::OPT_o)) {
+      output = getDriverArgs().getLastArgValue(options::OPT_o).str();
+    } else if (linking && !saveTemps) {
+      SmallString<128> tempPath;
+      auto ec = sys::fs::createTemporaryFile(sys::path::stem(src),
+                                             outputExt.drop_front(), tempPath);
+      if (ec) {
+        DRIVER_ACTION_REPORT_ERROR("failed to create temporary file for "
+                                   << src << ": " << ec.message() << "\n");
+        return false;
+      }
+      output = tempPath.str().str();
+      context.registerIntermediateFileForCleanup(output);
+    } else {
+      output = (sys::path::stem(src) + outputExt).str();
+    }
+
+    auto inserted = outputSources.try_emplace(output, src);
+    if (!inserted.second) {
+      DRIVER_ACTION_REPORT_ERROR(inserted.first->second
+                                 << " and " << src << " both compile to "
+                                 << output << "\n");
+      return false;
+    }
+
+    if (linking)
+      context.setCompiledObject(src, output);
+    outputs.push_back(std::move(output));
+  }
+
+  // Compile the sources, running up to -j compiler processes at a time. Each
+  // job gets its own copy of the configured compiler.
+  unsigned jobs = 1;
+  if (getDriverArgs().hasArg(options::OPT_j)) {
+    auto value = getDriverArgs().getLastArgValue(options::OPT_j);
+    if (value.getAsInteger(10, jobs)) {
+      DRIVER_ACTION_REPORT_ERROR("invalid job count '" << value << "'\n");
+      return false;
+    }
+  }
+
+  unsigned numWorkers = jobs ? jobs : std::thread::hardware_concurrency();
+  numWorkers = std::max(1u, std::min<unsigned>(numWorkers, sources.size()));
+  std::vector<int> results(sources.size(), 0);
+  std::atomic<size_t> nextSource{0};
+  std::vector<std::thread> workers;
+  for (unsigned w = 0; w < numWorkers; w++) {
+    workers.emplace_back([this, &sources, &outputs, &results, &nextSource]() {
+      for (size_t i; (i = nextSource++) < sources.size();) {
+        Compiler compiler = compiler_;
+        compiler.setSourceFile(sources[i]);
+        compiler.setOutputFile(outputs[i]);
+        results[i] = compiler.execute();
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+
+  if (cache_)
+    cache_->prune();
+
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (results[i] != 0) {
+      DRIVER_ACTION_REPORT_ERROR("failed to compile " << sources[i] << "\n");
+      return false;
+    }
+  }
+
+  return true;
 }
 
 LinkAction::LinkAction(Driver &D)
@@ -237,7 +409,7 @@ bool LinkAction::runImpl(DriverContext &context) {
       // Handle input objects
     } else if (A->getOption().matches(options::OPT_INPUT)) {
       for (auto &s : A->getValues()) {
-        linker_.addInput(s);
+        linker_.addInput(context.getCompiledObject(s));
       }
       // Handle libraries
     } else if (A->getOption().matches(options::OPT_l)) {
@@ -270,7 +442,7 @@ bool LinkAction::runImpl(DriverContext &context) {
 }
 
 EmbedMetadataAction::EmbedMetadataAction(Driver &D)
-    : DriverAction(D, "EmbedMetadataAction"), objcopy_() {}
+    : DriverAction(D, "EmbedMetadataAction") {}
 
 bool EmbedMetadataAction::preRunCheckImpl(DriverContext &context) const {
   assert(context.getProgram() != nullptr &&
@@ -301,30 +473,58 @@ bool EmbedMetadataAction::runImpl(DriverContext &context) {
     inputFileName = outputNames.getLinkStepOutputName();
   }
 
-  // Generate and write the metadata to a file
-  auto metadataPtr = context.getProgram()->generateMetadata();
-  auto metadataFileName = outputNames.getMetadataOutputName();
-  metadataPtr->writeMetadata(metadataFileName.c_str());
-
-  // Run objcopy to embed the metadata
-  objcopy_.getTools().loadStandardEnvPaths();
-  objcopy_.setInputFile(inputFileName);
-  objcopy_.addSection("metadata", metadataFileName);
-  objcopy_.setSectionFlag("metadata", ObjCopy::noload);
-
-  int rc = (objcopy_.execute() == 0);
-
-  // Delete the temporary metadata file
-  if (!getDriverArgs().hasArg(options::OPT_save_temps)) {
-    auto ec = sys::fs::remove(metadataFileName);
-    if (ec) {
-      DRIVER_ACTION_REPORT_ERROR("Failed to remove temp build file "
-                                 << metadataFileName << "\n");
-      return ec.value();
+  bool saveTemps = getDriverArgs().hasArg(options::OPT_save_temps);
+
+  // Generate the metadata and the constants segments
+  ProgramConstants constants;
+  auto metadataPtr = context.getProgram()->generateMetadata(&constants);
+  const std::vector<uint8_t> &metadata = metadataPtr->getMetadata();
+  if (saveTemps)
+    metadataPtr->writeMetadata(outputNames.getMetadataOutputName().c_str());
+
+  // Embed the metadata in-process. This matches what
+  //   objcopy --add-section metadata=<file> --set-section-flags metadata=noload
+  // produces: a PROGBITS section that is not allocated.
+  ELFIO::elfio elf;
+  if (!elf.load(inputFileName)) {
+    DRIVER_ACTION_REPORT_ERROR("failed to load ELF " << inputFileName << "\n");
+    return false;
+  }
+  ELFIO::section *metadataSec = elf.sections["metadata"];
+  if (metadataSec == nullptr)
+    metadataSec = elf.sections.add("metadata");
+  metadataSec->set_type(ELFIO::SHT_PROGBITS);
+  metadataSec->set_flags(0);
+  metadataSec->set_addr_align(1);
+  metadataSec->set_data(reinterpret_cast<const char *>(metadata.data()),
+                        metadata.size());
+
+  // In link only mode the ELF is the output. Otherwise hand it and the
+  // constants to BuildQPCAction through the context, only keeping the files
+  // with --save-temps.
+  if (getDriver().isLinkOnlyMode() || saveTemps) {
+    if (!elf.save(inputFileName)) {
+      DRIVER_ACTION_REPORT_ERROR("failed to write ELF " << inputFileName
+                                                        << "\n");
+      return false;
     }
   }
+  if (getDriver().isLinkOnlyMode())
+    return true;
+
+  std::vector<uint8_t> elfData;
+  VectorStreamBuf elfBuf(elfData);
+  std::ostream elfStream(&elfBuf);
+  if (!elf.save(elfStream)) {
+    DRIVER_ACTION_REPORT_ERROR("failed to write ELF " << inputFileName
+                                                      << "\n");
+    return false;
+  }
+  context.setBuffer("network.elf", std::move(elfData));
+  context.setBuffer("constants.bin", std::move(constants.constants));
+  context.setBuffer("constantsdesc.bin", std::move(constants.constantsDesc));
 
-  return rc;
+  return true;
 }
 
 ExtractEntryPointAddressAction::ExtractEntryPointAddressAction(Driver &D)
@@ -412,64 +612,63 @@ bool BuildQPCAction::preRunCheckImpl(DriverContext &context) const {
 
 bool BuildQPCAction::runImpl(DriverContext &context) {
 
-  // The input name must be a .elf from the previous step
-  // The output name can be whatever the user provided
+  // The ELF with the embedded metadata and the constants come from
+  // EmbedMetadataAction through the context. The output name can be whatever
+  // the user provided.
   Driver::OutputNames outputNames{
       getDriverArgs().getLastArgValue(options::OPT_o)};
-  auto inputName = outputNames.getLinkStepOutputName();
   auto outputName = outputNames.getProvidedName();
 
   QPCBuilder builder;
 
-  // Add the elf + metadata
-  if (!builder.addSegmentFromFile("network.elf", inputName)) {
-    DRIVER_ACTION_REPORT_ERROR("failed to add " << inputName << " to QPC.\n");
-    return false;
-  }
-
-  // Add the constants
-  std::vector<std::string> constfiles = {"constants.bin", "constantsdesc.bin"};
-  for (auto const &file : constfiles) {
-    if (!builder.addSegmentFromFile(file, file)) {
-      DRIVER_ACTION_REPORT_ERROR("failed to add " << file << " to QPC.\n");
+  bool saveTemps = getDriverArgs().hasArg(options::OPT_save_temps);
+  for (auto name : {"network.elf", "constants.bin", "constantsdesc.bin"}) {
+    std::vector<uint8_t> *data = context.getBuffer(name);
+    if (data == nullptr) {
+      DRIVER_ACTION_REPORT_ERROR("missing " << name << " for QPC.\n");
       return false;
     }
-    // Delete the temporary file
-    if (!getDriverArgs().hasArg(options::OPT_save_temps)) {
-      auto ec = sys::fs::remove(file);
-      if (ec) {
-        DRIVER_ACTION_REPORT_ERROR("Failed to remove temp build file " << file
-                                                                       << "\n");
-        return ec.value();
-      }
+
+    // Keep the constants in the working directory with --save-temps, they
+    // are what the device emulator runs with.
+    if (saveTemps && StringRef(name) != "network.elf") {
+      std::ofstream file(name, std::ios::binary);
+      file.write((const char *)data->data(), data->size());
     }
+
+    size_t offset = StringRef(name) == "constants.bin" ? data->size() : 0;
+    builder.addSegment(name, std::move(*data), offset);
   }
 
   // Serialize and add network descriptor
-  std::string networkDescBuffer;
   {
     auto networkDesc = context.getProgram()->generateNetworkDescriptor();
-    if (!networkDesc->SerializeToString(&networkDescBuffer)) {
+    std::vector<uint8_t> networkDescBuffer(networkDesc->ByteSizeLong());
+    if (!networkDesc->SerializeToArray(networkDescBuffer.data(),
+                                       networkDescBuffer.size())) {
       DRIVER_ACTION_REPORT_ERROR("failed to serialize network descriptor.\n");
       return false;
     }
 
-    builder.addSegment("networkdesc.bin",
-                       (const uint8_t *)networkDescBuffer.c_str(),
-                       networkDescBuffer.size(), 0);
+    if (saveTemps) {
+      std::ofstream file(outputNames.getNetworkDescriptorOutputName(),
+                         std::ios::binary);
+      file.write((const char *)networkDescBuffer.data(),
+                 networkDescBuffer.size());
+    }
+
+    builder.addSegment("networkdesc.bin", std::move(networkDescBuffer), 0);
   }
 
-  auto serializedQPC = builder.finalizeToByteArray();
-  {
-    std::ofstream file(outputName.str(), std::ios::binary);
-    file.write((const char *)serializedQPC.data(), serializedQPC.size());
+  if (getDriverArgs().hasArg(options::OPT_compress_qpc)) {
+    for (auto name : {"network.elf", "constants.bin", "constantsdesc.bin",
+                      "networkdesc.bin"})
+      builder.setSegmentCompression(name, QPC_CODEC_ZLIB);
   }
 
-  if (getDriverArgs().hasArg(options::OPT_save_temps)) {
-    std::ofstream file(outputNames.getNetworkDescriptorOutputName(),
-                       std::ios::binary);
-    file.write((const char *)networkDescBuffer.data(),
-               networkDescBuffer.size());
+  if (!builder.finalizeToFile(outputName)) {
+    DRIVER_ACTION_REPORT_ERROR("failed to write QPC " << outputName << ".\n");
+    return false;
   }
 
   return true;
@@ -4,11 +4,12 @@
 #ifndef _QAIC_TOOLS_DRIVER_ACTION_H_
 #define _QAIC_TOOLS_DRIVER_ACTION_H_
 
+#include <memory>
+
 #include "llvm/Option/ArgList.h"
 
 #include "toolchain/Compiler.h"
 #include "toolchain/Linker.h"
-#include "toolchain/ObjCopy.h"
 
 namespace qaic {
 
@@ -73,7 +74,9 @@ private:
 
 /**
  * @brief Executes the compiler to pre-process, compile and assemble source
- * code.
+ * code. Multiple sources are compiled in parallel, up to the -j job count.
+ * When linking, the objects are recorded in the context for LinkAction.
+ * Objects are looked up in the compile cache when one is configured.
  */
 class CompileAction : public DriverAction {
 public:
@@ -86,6 +89,7 @@ protected:
 
 private:
   Compiler compiler_;
+  std::unique_ptr<CompileCache> cache_;
 };
 
 /**
@@ -127,9 +131,6 @@ public:
 protected:
   bool preRunCheckImpl(DriverContext &context) const override;
   bool runImpl(DriverContext &context) override;
-
-private:
-  ObjCopy objcopy_;
 };
 
 /**
@@ -4,8 +4,10 @@
 #ifndef _QAIC_TOOLS_DRIVER_CONTEXT_H_
 #define _QAIC_TOOLS_DRIVER_CONTEXT_H_
 
+#include <map>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include "llvm/ADT/StringRef.h"
@@ -60,6 +62,43 @@ public:
    */
   const Program *getProgram() const { return program_.get(); }
 
+  /**
+   * @brief Stores a buffer produced by an action so later actions can use it
+   * without a round trip through a file. Buffers are keyed by the name of the
+   * QPC segment they become, e.g. "network.elf" or "constants.bin".
+   */
+  void setBuffer(llvm::StringRef name, std::vector<uint8_t> data) {
+    buffers_[name.str()] = std::move(data);
+  }
+
+  /**
+   * @brief Gets a buffer stored with \refitem setBuffer.
+   *
+   * If no buffer with the given name is set then return nullptr.
+   */
+  std::vector<uint8_t> *getBuffer(llvm::StringRef name) {
+    auto it = buffers_.find(name.str());
+    return it == buffers_.end() ? nullptr : &it->second;
+  }
+
+  /**
+   * @brief Records the object file a source input was compiled to so the link
+   * step uses it in place of the source.
+   */
+  void setCompiledObject(llvm::StringRef source, llvm::StringRef object) {
+    compiledObjects_[source.str()] = object.str();
+  }
+
+  /**
+   * @brief Gets the object file a source input was compiled to.
+   *
+   * Inputs that were not compiled are returned unchanged.
+   */
+  llvm::StringRef getCompiledObject(llvm::StringRef input) const {
+    auto it = compiledObjects_.find(input.str());
+    return it == compiledObjects_.end() ? input : llvm::StringRef(it->second);
+  }
+
   /**
    * @brief Gets a reference to the Driver that owns this context.
    */
@@ -89,6 +128,8 @@ private:
   Driver &Driver_;
   std::set<std::string> intermediateFiles_;
   std::unique_ptr<Program> program_;
+  std::map<std::string, std::vector<uint8_t>> buffers_;
+  std::map<std::string, std::string> compiledObjects_;
   std::vector<std::unique_ptr<DriverAction>> actionsToRun_;
 };
 } // namespace qaic
@@ -21,12 +21,16 @@
 #define AIC_NETWORK_DESCRIPTION_MINOR_VERSION 0
 
 #define AICQPC_MAJOR_VERSION 0
-#define AICQPC_MINOR_VERSION 1
+#define AICQPC_MINOR_VERSION 2
 #define AICQPC_MAGIC_NUMBER 0x00A1CD7C
 
+// Uncompressed bytes per chunk of a compressed segment
+#define AICQPC_DEFAULT_CHUNK_SIZE (1024 * 1024)
+
 typedef struct QAicQpcHandle QAicQpcHandle;
 typedef struct QpcHeader QpcHeader;
 typedef struct QpcSegment QpcSegment;
+typedef struct QpcSegmentCodec QpcSegmentCodec;
 typedef struct QAicQpc QAicQpc;
 
 // This is a added once per AICQPC
@@ -70,8 +74,29 @@ struct QpcSegment {
 };
 
 enum CompressionType {
-  FASTPATH = 0, // Fast path, no compression
-  SLOWPATH = 1  // Slow path for offline use compressed
+  FASTPATH = 0,  // Fast path, no compression
+  SLOWPATH = 1,  // Slow path for offline use
+  COMPRESSED = 2 // Slow path with a per segment codec
+};
+
+// Codec of a segment in a COMPRESSED QPC
+enum QpcCodec : uint32_t {
+  QPC_CODEC_NONE = 0, // Stored as is
+  QPC_CODEC_ZLIB = 1  // Independently deflated chunks
+};
+
+// COMPRESSED QPCs have one codec entry per segment in a table directly
+// following the segment table. QpcSegment::size and offset describe the
+// uncompressed data while start points to the storedSize bytes held in the
+// QPC.
+// QPC_CODEC_ZLIB data starts with a uint64_t array holding the compressed
+// size of every chunk, followed by the zlib streams of the chunks. Each chunk
+// inflates to chunkSize bytes, except the last one, so chunks can be
+// decompressed independently and in parallel.
+struct QpcSegmentCodec {
+  uint32_t codec;
+  uint32_t chunkSize;
+  uint64_t storedSize;
 };
 
 struct QAicQpc {
@@ -82,28 +107,48 @@ struct QAicQpc {
 
 enum QpcSegmentKind { QPC_SEGMENT_BUFFER, QPC_SEGMENT_FILE };
 
-// Segment descriptor used when generating a QPC.
+// Segment descriptor used when generating a QPC. The QPC is written
+// COMPRESSED if any segment uses a codec.
 struct QpcSegmentDesc {
   QpcSegment segment;
   QpcSegmentKind kind;
   std::string filePath;
-  QpcSegmentDesc(uint64_t sz, uint64_t o, char *n, uint8_t *s)
-      : segment(sz, o, n, s), kind(QPC_SEGMENT_BUFFER), filePath("") {}
-  QpcSegmentDesc(uint64_t o, char *n, const char *f)
-      : segment(0, o, n, nullptr), kind(QPC_SEGMENT_FILE), filePath(f) {}
+  QpcCodec codec;
+  QpcSegmentDesc(uint64_t sz, uint64_t o, char *n, uint8_t *s,
+                 QpcCodec c = QPC_CODEC_NONE)
+      : segment(sz, o, n, s), kind(QPC_SEGMENT_BUFFER), filePath(""),
+        codec(c) {}
+  QpcSegmentDesc(uint64_t o, char *n, const char *f,
+                 QpcCodec c = QPC_CODEC_NONE)
+      : segment(0, o, n, nullptr), kind(QPC_SEGMENT_FILE), filePath(f),
+        codec(c) {}
 };
 
 // Create an empty QPC handle object
 int createQpcHandle(QAicQpcHandle **handle, CompressionType c);
 
-// Build up a QPC object from a qpc segment array.
+// Build up a QPC object from a qpc segment array. Segments of a COMPRESSED
+// handle are all compressed with QPC_CODEC_ZLIB.
 int buildFromSegments(QAicQpcHandle *handle, const QpcSegment *segments,
                       size_t numSegments);
 
+// Same as above with a codec per segment. Codecs other than QPC_CODEC_NONE
+// require a COMPRESSED handle.
+int buildFromSegments(QAicQpcHandle *handle, const QpcSegment *segments,
+                      const QpcCodec *codecs, size_t numSegments);
+
 // Write QPC object to qpcPath from QPC segment descriptor array.
 int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
                       const std::string &qpcPath);
 
+// Write QPC object to the seekable file descriptor qpcFd from QPC segment
+// descriptor array, starting at the current position of qpcFd. The QPC is
+// streamed: file segments are read and written one chunk at a time and the
+// offsets are fixed up once the data is written, so memory use does not
+// depend on the segment sizes. qpcFd is left positioned after the QPC.
+int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
+                      int qpcFd);
+
 // Get serialized QPC object. This buffer is valid only till the handle is
 // not destroyed
 int getSerializedQpc(QAicQpcHandle *handle, uint8_t **serializedQpc,
@@ -113,7 +158,18 @@ int getSerializedQpc(QAicQpcHandle *handle, uint8_t **serializedQpc,
 // the handle is not destroyed
 int getQpc(QAicQpcHandle *handle, QAicQpc **qpc);
 
-// Build up a QPC object from serialized qpc object
+// Map the QPC file at qpcPath read-only and create a handle for it. The header
+// and segment table are validated in place and nothing is copied: getQpc()
+// returns segments pointing into the mapping and getSerializedQpc() returns
+// the mapped file. The segment data must not be modified and the handle
+// cannot be rebuilt (buildFrom* return -EPERM). The mapping is released by
+// destroyQpcHandle().
+// Compressed segments are decompressed into buffers owned by the handle,
+// getSerializedQpc() still returns the compressed file.
+int mapQpcFile(QAicQpcHandle **handle, const std::string &qpcPath);
+
+// Build up a QPC object from serialized qpc object. Segments of a COMPRESSED
+// qpc are decompressed.
 int buildFromByteArray(QAicQpcHandle *handle, const uint8_t *serializedQpc);
 
 // Build up a QPC object from another QAicQpc object
@@ -140,9 +196,16 @@ uint8_t *copyQpcBuffer(uint8_t *destination, uint8_t *source, size_t destSize);
 // [IN] source - QPC buffer
 // [IN] segName - Segment name
 // [OUT] segBuf, segSize
+// The source may also be an unmodified QPC file image, e.g. a file read or
+// mapped into memory, in which case the segment addresses are resolved
+// relative to source. Returns false for compressed segments.
 bool getQPCSegment(const uint8_t *source, const char *segName, uint8_t **segBuf,
                    size_t *segSize, size_t offset);
 
+// Same as above for the QPC held by handle, including mapped handles.
+bool getQPCSegment(QAicQpcHandle *handle, const char *segName,
+                   uint8_t **segBuf, size_t *segSize, size_t offset);
+
 //  This function iterates over the vector of segments and returns an iterator
 //  to the requested segment if present or end() iterator if absent
 //  This function does not modify anything
@@ -3,15 +3,24 @@
 
 #include "QAicQpc.h"
 #include "elfio/elfio.hpp"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <fcntl.h>
 #include <iostream>
 #include <malloc.h>
 #include <memory>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <unordered_map>
 #include <unordered_set>
+#include <zlib.h>
 
 typedef struct QAicQpcOffsets QAicQpcOffsets;
+typedef struct QAicQpcMapping QAicQpcMapping;
 
 static const std::string networkElfFileName("network.elf");
 static const std::string networkElfCRCFileName("network.elf.crc");
@@ -31,10 +40,29 @@ struct QAicQpcOffsets {
   std::vector<uint64_t> *imageStartOffsets;
 };
 
+// Read-only mapping of a QPC file. qpc is a copy of the file header whose
+// images point to segments, which in turn point into the mapping or, for
+// compressed segments, into buffers.
+struct QAicQpcMapping {
+  void *addr;
+  size_t size;
+  QAicQpc qpc;
+  std::vector<QpcSegment> *segments;
+  std::vector<std::vector<uint8_t>> *buffers;
+};
+
+// Compressed payloads of the segments of a COMPRESSED QPC
+struct QpcCompressedSegments {
+  std::vector<QpcSegmentCodec> codecs;
+  std::vector<const uint8_t *> payloads;
+  std::vector<std::vector<uint8_t>> buffers;
+};
+
 struct QAicQpcHandle {
   uint64_t compressionType;
   std::vector<uint8_t> *qpcBuffer;
   QAicQpcOffsets *qpcOffsets;
+  QAicQpcMapping *qpcMapping; // Only set for handles created by mapQpcFile
 };
 
 static uint64_t alignTo(uint64_t x, uint64_t m) {
@@ -52,6 +80,193 @@ static uint8_t *computeAddrByBase(uint8_t *old_base, uint8_t *new_base,
   return new_base + offset;
 }
 
+// Offset of a pointer stored in a serialized QPC relative to the start of the
+// QPC. Serialized buffers store absolute addresses based at hdr.base, QPC
+// files store file offsets (hdr.base == 0).
+static uint64_t computeOffset(const QAicQpc *qpc, const void *address) {
+  return reinterpret_cast<uint64_t>(address) - qpc->hdr.base;
+}
+
+// Address of a pointer stored in the serialized QPC at base.
+static uint8_t *resolveAddr(const QAicQpc *qpc, uint8_t *base,
+                            const void *address) {
+  if (qpc->hdr.base == reinterpret_cast<uint64_t>(base)) {
+    // Already fixed up, fast path segments also point outside of the QPC
+    return reinterpret_cast<uint8_t *>(const_cast<void *>(address));
+  }
+  return computeAddr(base, computeOffset(qpc, address));
+}
+
+// The codec table of a COMPRESSED QPC follows the segment table.
+static const QpcSegmentCodec *getSegmentCodecs(const QAicQpc *qpc,
+                                               const QpcSegment *images) {
+  if (qpc->hdr.compressionType != COMPRESSED) {
+    return nullptr;
+  }
+  return reinterpret_cast<const QpcSegmentCodec *>(images + qpc->numImages);
+}
+
+static uint64_t getNumChunks(uint64_t size, uint32_t chunkSize) {
+  return (size + chunkSize - 1) / chunkSize;
+}
+
+static int compressChunk(const uint8_t *src, uint64_t size,
+                         std::vector<uint8_t> &dst) {
+  uLongf storedSize = compressBound(size);
+  dst.resize(storedSize);
+  if (compress2(dst.data(), &storedSize, src, size, Z_DEFAULT_COMPRESSION) !=
+      Z_OK) {
+    return -ENOMEM;
+  }
+  dst.resize(storedSize);
+  return 0;
+}
+
+// Compresses size bytes at src into dst with the QPC_CODEC_ZLIB layout.
+static int compressSegment(const uint8_t *src, uint64_t size,
+                           uint32_t chunkSize, std::vector<uint8_t> &dst) {
+  uint64_t numChunks = getNumChunks(size, chunkSize);
+  std::vector<uint8_t> chunk;
+
+  dst.assign(numChunks * sizeof(uint64_t), 0);
+  for (uint64_t i = 0; i < numChunks; ++i) {
+    uint64_t chunkOffset = i * chunkSize;
+    uint64_t chunkBytes = std::min<uint64_t>(chunkSize, size - chunkOffset);
+    if (int rc = compressChunk(src + chunkOffset, chunkBytes, chunk); rc != 0) {
+      return rc;
+    }
+    uint64_t storedSize = chunk.size();
+    memcpy(&dst[i * sizeof(uint64_t)], &storedSize, sizeof(storedSize));
+    dst.insert(dst.end(), chunk.begin(), chunk.end());
+  }
+  return 0;
+}
+
+// Inflates a QPC_CODEC_ZLIB segment into dst, which holds segment.size bytes.
+// Large segments are split between threads by chunk.
+static int decompressSegment(const QpcSegment &segment,
+                             const QpcSegmentCodec &codec, uint8_t *dst) {
+  if (codec.chunkSize == 0) {
+    return -EINVAL;
+  }
+
+  // Validate the chunk table and turn it into offsets
+  uint64_t numChunks = getNumChunks(segment.size, codec.chunkSize);
+  if (numChunks > codec.storedSize / sizeof(uint64_t)) {
+    return -EINVAL;
+  }
+  std::vector<uint64_t> chunkOffsets(numChunks + 1);
+  chunkOffsets[0] = numChunks * sizeof(uint64_t);
+  for (uint64_t i = 0; i < numChunks; ++i) {
+    uint64_t storedSize;
+    memcpy(&storedSize, segment.start + i * sizeof(uint64_t),
+           sizeof(storedSize));
+    if (storedSize > codec.storedSize - chunkOffsets[i]) {
+      return -EINVAL;
+    }
+    chunkOffsets[i + 1] = chunkOffsets[i] + storedSize;
+  }
+
+  std::atomic<int> rc{0};
+  auto inflateChunks = [&](uint64_t first, uint64_t step) {
+    for (uint64_t i = first; i < numChunks && rc == 0; i += step) {
+      uint64_t chunkOffset = i * codec.chunkSize;
+      uLongf chunkBytes =
+          std::min<uint64_t>(codec.chunkSize, segment.size - chunkOffset);
+      uLongf inflatedBytes = chunkBytes;
+      if (uncompress(dst + chunkOffset, &inflatedBytes,
+                     segment.start + chunkOffsets[i],
+                     chunkOffsets[i + 1] - chunkOffsets[i]) != Z_OK ||
+          inflatedBytes != chunkBytes) {
+        rc = -EINVAL;
+      }
+    }
+  };
+
+  uint64_t numThreads =
+      std::min<uint64_t>(numChunks, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (uint64_t t = 1; t < numThreads; ++t) {
+    threads.emplace_back(inflateChunks, t, numThreads);
+  }
+  inflateChunks(0, std::max<uint64_t>(numThreads, 1));
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return rc;
+}
+
+// Returns the uncompressed views of numImages segments with resolved
+// addresses. Compressed segments are inflated into buffers.
+static int decompressSegments(const QpcSegment *images,
+                              const QpcSegmentCodec *codecs,
+                              uint64_t numImages,
+                              std::vector<QpcSegment> &segments,
+                              std::vector<std::vector<uint8_t>> &buffers) {
+  segments.assign(images, images + numImages);
+  if (codecs == nullptr) {
+    return 0;
+  }
+
+  for (uint64_t i = 0; i < numImages; ++i) {
+    if (codecs[i].codec == QPC_CODEC_NONE) {
+      continue;
+    }
+    if (codecs[i].codec != QPC_CODEC_ZLIB) {
+      std::cout << "Error: Unknown codec " << codecs[i].codec
+                << " for QPC segment " << images[i].name << std::endl;
+      return -EINVAL;
+    }
+    buffers.emplace_back(images[i].size);
+    if (int rc = decompressSegment(images[i], codecs[i], buffers.back().data());
+        rc != 0) {
+      std::cout << "Error: Unable to decompress QPC segment " << images[i].name
+                << std::endl;
+      return rc;
+    }
+    segments[i].start = buffers.back().data();
+  }
+
+  return 0;
+}
+
+static int compressSegments(const std::vector<QpcSegment> &segments,
+                            const QpcCodec *codecs,
+                            QpcCompressedSegments &compressed) {
+  compressed.codecs.resize(segments.size());
+  compressed.payloads.resize(segments.size());
+  compressed.buffers.resize(segments.size());
+
+  for (size_t i = 0; i < segments.size(); ++i) {
+    QpcSegmentCodec &codec = compressed.codecs[i];
+    codec.codec = codecs ? codecs[i] : QPC_CODEC_ZLIB;
+    codec.chunkSize = AICQPC_DEFAULT_CHUNK_SIZE;
+    codec.storedSize = segments[i].size;
+    compressed.payloads[i] = segments[i].start;
+
+    if (codec.codec == QPC_CODEC_NONE) {
+      continue;
+    }
+    std::vector<uint8_t> &buffer = compressed.buffers[i];
+    if (int rc = compressSegment(segments[i].start, segments[i].size,
+                                 codec.chunkSize, buffer);
+        rc != 0) {
+      return rc;
+    }
+    // Keep segments that do not shrink as is
+    if (buffer.size() >= segments[i].size) {
+      codec.codec = QPC_CODEC_NONE;
+      std::vector<uint8_t>().swap(buffer);
+      continue;
+    }
+    codec.storedSize = buffer.size();
+    compressed.payloads[i] = buffer.data();
+  }
+
+  return 0;
+}
+
 namespace aicqpc {
 template <typename T>
 size_t writeElement(const T *src, size_t elts, std::vector<uint8_t> &buffer,
@@ -65,9 +280,10 @@ size_t writeElement(const T *src, size_t elts, std::vector<uint8_t> &buffer,
 }
 } // namespace aicqpc
 
-static uint64_t writeQAicQpcObject(QAicQpcHandle *handle,
-                                   const QpcSegment *segments,
-                                   size_t numSegments, bool commit) {
+static uint64_t
+writeQAicQpcObject(QAicQpcHandle *handle, const QpcSegment *segments,
+                   size_t numSegments, const QpcCompressedSegments *compressed,
+                   bool commit) {
   uint64_t writeOffset = 0;
   uint64_t segmentCount;
   QAicQpc aicQpcTemp;
@@ -88,7 +304,12 @@ static uint64_t writeQAicQpcObject(QAicQpcHandle *handle,
                                        *handle->qpcBuffer, writeOffset, commit);
   }
 
-  if (handle->compressionType == SLOWPATH) {
+  if (handle->compressionType == COMPRESSED) {
+    writeOffset = aicqpc::writeElement(compressed->codecs.data(), numSegments,
+                                       *handle->qpcBuffer, writeOffset, commit);
+  }
+
+  if (handle->compressionType != FASTPATH) {
     // Set names offset
     for (segmentCount = 0; segmentCount < numSegments; ++segmentCount) {
       (offsets->imageNameOffsets)->push_back(writeOffset);
@@ -99,9 +320,16 @@ static uint64_t writeQAicQpcObject(QAicQpcHandle *handle,
     // Set image buffer offset
     for (segmentCount = 0; segmentCount < numSegments; ++segmentCount) {
       (offsets->imageStartOffsets)->push_back(writeOffset);
-      writeOffset = aicqpc::writeElement(
-          segments[segmentCount].start, segments[segmentCount].size,
-          *handle->qpcBuffer, writeOffset, commit);
+      if (compressed != nullptr) {
+        writeOffset = aicqpc::writeElement(
+            compressed->payloads[segmentCount],
+            compressed->codecs[segmentCount].storedSize, *handle->qpcBuffer,
+            writeOffset, commit);
+      } else {
+        writeOffset = aicqpc::writeElement(
+            segments[segmentCount].start, segments[segmentCount].size,
+            *handle->qpcBuffer, writeOffset, commit);
+      }
     }
   }
 
@@ -118,7 +346,7 @@ static void fixupQAicQpcObject(QAicQpcHandle *handle, uint8_t *base) {
       reinterpret_cast<QpcSegment *>(computeAddr(base, offsets->imagesOffset));
 
   // No fixup needed for the segment contents in case of fastpath
-  if (handle->compressionType == SLOWPATH) {
+  if (handle->compressionType != FASTPATH) {
     for (segmentCount = 0; segmentCount < aicQpc->numImages; ++segmentCount) {
       aicQpc->images[segmentCount].name = reinterpret_cast<char *>(
           computeAddr(base, offsets->imageNameOffsets->at(segmentCount)));
@@ -187,6 +415,32 @@ static void destroyQpcOffsetsObject(QAicQpcOffsets *qpcOffsetsObj) {
   free(qpcOffsetsObj);
 }
 
+static QAicQpcMapping *createQpcMappingObject(void *addr, size_t size) {
+  QAicQpcMapping *retObj = (QAicQpcMapping *)malloc(sizeof(QAicQpcMapping));
+
+  if (!retObj) {
+    return nullptr;
+  }
+
+  retObj->addr = addr;
+  retObj->size = size;
+  retObj->segments = new std::vector<QpcSegment>();
+  retObj->buffers = new std::vector<std::vector<uint8_t>>();
+
+  return retObj;
+}
+
+static void destroyQpcMappingObject(QAicQpcMapping *qpcMappingObj) {
+  if (qpcMappingObj == nullptr) {
+    return;
+  }
+
+  munmap(qpcMappingObj->addr, qpcMappingObj->size);
+  delete qpcMappingObj->segments;
+  delete qpcMappingObj->buffers;
+  free(qpcMappingObj);
+}
+
 int createQpcHandle(QAicQpcHandle **handle, CompressionType c) {
   *handle = (QAicQpcHandle *)malloc(sizeof(QAicQpcHandle));
   if (NULL == *handle) {
@@ -196,6 +450,7 @@ int createQpcHandle(QAicQpcHandle **handle, CompressionType c) {
   (*handle)->compressionType = static_cast<uint64_t>(c);
 
   // Default init
+  (*handle)->qpcMapping = nullptr;
   (*handle)->qpcBuffer = new std::vector<uint8_t>();
   (*handle)->qpcOffsets = createQpcOffsetsObject();
 
@@ -376,21 +631,34 @@ static int convertNetworkElfSection(
   return 0;
 }
 
-static void serializeFromVector(QAicQpcHandle *handle,
-                                std::vector<QpcSegment> &segmentVector) {
+static int serializeFromVector(QAicQpcHandle *handle,
+                               std::vector<QpcSegment> &segmentVector,
+                               const QpcCodec *codecs = nullptr) {
+  // Compress the segments up front so both passes see the same payloads
+  QpcCompressedSegments compressed;
+  if (handle->compressionType == COMPRESSED) {
+    if (int rc = compressSegments(segmentVector, codecs, compressed);
+        rc != 0) {
+      return rc;
+    }
+  }
+  const QpcCompressedSegments *payloads =
+      handle->compressionType == COMPRESSED ? &compressed : nullptr;
+
   // Clear the buffer
   (handle->qpcBuffer)->clear();
   uint64_t qpcBufferSize = 0;
   qpcBufferSize =
       writeQAicQpcObject(handle, &segmentVector[0], segmentVector.size(),
-                         false); // Try run no commits
+                         payloads, false); // Try run no commits
   // Resize the buffer
   (handle->qpcBuffer)->resize(qpcBufferSize);
   // commit the changes
-  qpcBufferSize =
-      writeQAicQpcObject(handle, &segmentVector[0], segmentVector.size(), true);
+  qpcBufferSize = writeQAicQpcObject(handle, &segmentVector[0],
+                                     segmentVector.size(), payloads, true);
 
   fixupQAicQpcObject(handle, (handle->qpcBuffer)->data());
+  return 0;
 }
 
 int convertNetworkElfSection(
@@ -398,8 +666,19 @@ int convertNetworkElfSection(
     size_t &serialQpcSz, const std::string &sourceSectionName,
     const std::string &destSectionName,
     std::function<std::vector<uint8_t>(const uint8_t *, size_t)> convFunction) {
-  std::vector<QpcSegment> segmentVector{qpc->images,
-                                        qpc->images + qpc->numImages};
+  std::vector<QpcSegment> segmentVector;
+  std::vector<std::vector<uint8_t>> segmentBuffers;
+  const QpcSegmentCodec *segmentCodecs = getSegmentCodecs(qpc, qpc->images);
+  if (int rc = decompressSegments(qpc->images, segmentCodecs, qpc->numImages,
+                                  segmentVector, segmentBuffers);
+      rc != 0) {
+    return rc;
+  }
+  // Keep the codec of every segment when serializing the new QPC
+  std::vector<QpcCodec> codecVector;
+  for (uint64_t i = 0; segmentCodecs && i < qpc->numImages; ++i) {
+    codecVector.push_back(static_cast<QpcCodec>(segmentCodecs[i].codec));
+  }
 
   // Find network elf
   std::vector<QpcSegment>::iterator networkElfIt =
@@ -426,6 +705,13 @@ int convertNetworkElfSection(
       networkElf.size(), 0, networkElfIt->name,
       reinterpret_cast<uint8_t *>(const_cast<char *>(networkElf.data())));
 
+  if (!codecVector.empty()) {
+    auto networkElfCodecIt =
+        codecVector.begin() + (networkElfIt - segmentVector.begin());
+    QpcCodec networkElfCodec = *networkElfCodecIt;
+    codecVector.erase(networkElfCodecIt);
+    codecVector.push_back(networkElfCodec);
+  }
   segmentVector.erase(networkElfIt);
   segmentVector.push_back(newElf);
 
@@ -435,7 +721,12 @@ int convertNetworkElfSection(
       rc != 0) {
     return rc;
   }
-  serializeFromVector(handle, segmentVector);
+  if (int rc = serializeFromVector(
+          handle, segmentVector,
+          codecVector.empty() ? nullptr : codecVector.data());
+      rc != 0) {
+    return rc;
+  }
   if (int rc = getSerializedQpc(handle, &serialQpc, &serialQpcSz); rc != 0) {
     return rc;
   }
@@ -445,6 +736,11 @@ int convertNetworkElfSection(
 
 int buildFromSegments(QAicQpcHandle *handle, const QpcSegment *segments,
                       size_t numSegments) {
+  return buildFromSegments(handle, segments, nullptr, numSegments);
+}
+
+int buildFromSegments(QAicQpcHandle *handle, const QpcSegment *segments,
+                      const QpcCodec *codecs, size_t numSegments) {
   // Calculate QPC buffer size and resize it
   std::vector<QpcSegment> segmentVector;
   std::string networkElf; // This is only needed till this function returns
@@ -457,11 +753,22 @@ int buildFromSegments(QAicQpcHandle *handle, const QpcSegment *segments,
     return -EINVAL;
   }
 
-  segmentVector.assign(segments, segments + numSegments);
+  // Mapped handles are read-only
+  if (handle->qpcMapping != nullptr) {
+    return -EPERM;
+  }
 
-  serializeFromVector(handle, segmentVector);
+  // Only compressed QPCs have a codec table
+  for (size_t i = 0; codecs && i < numSegments; ++i) {
+    if (codecs[i] != QPC_CODEC_NONE &&
+        handle->compressionType != COMPRESSED) {
+      return -EINVAL;
+    }
+  }
 
-  return 0;
+  segmentVector.assign(segments, segments + numSegments);
+
+  return serializeFromVector(handle, segmentVector, codecs);
 }
 
 int getSerializedQpc(QAicQpcHandle *handle, uint8_t **serializedQpc,
@@ -471,6 +778,12 @@ int getSerializedQpc(QAicQpcHandle *handle, uint8_t **serializedQpc,
     return -EINVAL;
   }
 
+  if (handle->qpcMapping != nullptr) {
+    *serializedQpc = reinterpret_cast<uint8_t *>(handle->qpcMapping->addr);
+    *serializedQpcSize = handle->qpcMapping->qpc.hdr.size;
+    return 0;
+  }
+
   *serializedQpc = (handle->qpcBuffer)->data();
   *serializedQpcSize = (handle->qpcBuffer)->size();
 
@@ -482,6 +795,11 @@ int getQpc(QAicQpcHandle *handle, QAicQpc **qpc) {
     return -EINVAL;
   }
 
+  if (handle->qpcMapping != nullptr) {
+    *qpc = &handle->qpcMapping->qpc;
+    return 0;
+  }
+
   *qpc = reinterpret_cast<QAicQpc *>((handle->qpcBuffer)->data());
 
   return 0;
@@ -502,6 +820,22 @@ int buildFromQpc(QAicQpcHandle *handle, const QAicQpc *qpc) {
     return -EINVAL;
   }
 
+  if (handle->qpcMapping != nullptr) {
+    return -EPERM;
+  }
+
+  if (qpc->hdr.compressionType == COMPRESSED) {
+    std::vector<QpcSegment> segments;
+    std::vector<std::vector<uint8_t>> buffers;
+    if (int rc = decompressSegments(qpc->images,
+                                    getSegmentCodecs(qpc, qpc->images),
+                                    qpc->numImages, segments, buffers);
+        rc != 0) {
+      return rc;
+    }
+    return buildFromSegments(handle, segments.data(), segments.size());
+  }
+
   (void)buildFromSegments(handle, qpc->images, qpc->numImages);
 
   return 0;
@@ -511,11 +845,179 @@ void destroyQpcHandle(QAicQpcHandle *handle) {
   if (handle == nullptr) {
     return;
   }
+  destroyQpcMappingObject(handle->qpcMapping);
   destroyQpcOffsetsObject(handle->qpcOffsets);
   delete handle->qpcBuffer;
   free(handle);
 }
 
+// Checks that the QPC at base is complete and that every segment lies inside
+// it, and builds the segment table with the addresses resolved against base.
+// codecs receives the codec table of COMPRESSED QPCs.
+static int validateQpcImage(const uint8_t *base, size_t size,
+                            std::vector<QpcSegment> &segments,
+                            std::vector<QpcSegmentCodec> &codecs) {
+  if (size < sizeof(QAicQpc)) {
+    std::cout << "Error: QPC is truncated" << std::endl;
+    return -EINVAL;
+  }
+
+  const QAicQpc *qpc = reinterpret_cast<const QAicQpc *>(base);
+  if (qpc->hdr.magicNumber != AICQPC_MAGIC_NUMBER) {
+    std::cout << "Error: Not a QPC, bad magic number" << std::endl;
+    return -EINVAL;
+  }
+  if (qpc->hdr.majorVersion != AICQPC_MAJOR_VERSION) {
+    std::cout << "Error: Unsupported QPC version "
+              << unsigned(qpc->hdr.majorVersion) << std::endl;
+    return -EINVAL;
+  }
+  // Fast path QPCs reference memory outside of the QPC
+  if (qpc->hdr.compressionType != SLOWPATH &&
+      qpc->hdr.compressionType != COMPRESSED) {
+    std::cout << "Error: Unsupported QPC compression type "
+              << qpc->hdr.compressionType << std::endl;
+    return -EINVAL;
+  }
+  if (qpc->hdr.size < sizeof(QAicQpc) || qpc->hdr.size > size) {
+    std::cout << "Error: QPC size " << qpc->hdr.size
+              << " does not match the file size " << size << std::endl;
+    return -EINVAL;
+  }
+
+  uint64_t qpcSize = qpc->hdr.size;
+  bool isCompressed = qpc->hdr.compressionType == COMPRESSED;
+  uint64_t entrySize =
+      sizeof(QpcSegment) + (isCompressed ? sizeof(QpcSegmentCodec) : 0);
+  uint64_t imagesOffset = computeOffset(qpc, qpc->images);
+  if (imagesOffset > qpcSize || imagesOffset % alignof(QpcSegment) != 0 ||
+      qpc->numImages > (qpcSize - imagesOffset) / entrySize) {
+    std::cout << "Error: QPC segment table is out of bounds" << std::endl;
+    return -EINVAL;
+  }
+
+  const QpcSegment *images =
+      reinterpret_cast<const QpcSegment *>(base + imagesOffset);
+  const QpcSegmentCodec *imageCodecs = getSegmentCodecs(qpc, images);
+  segments.clear();
+  segments.reserve(qpc->numImages);
+  codecs.clear();
+  for (uint64_t i = 0; i < qpc->numImages; ++i) {
+    const QpcSegment &s = images[i];
+    // Compressed segments occupy storedSize bytes
+    uint64_t storedSize = s.size;
+    if (isCompressed) {
+      codecs.push_back(imageCodecs[i]);
+      storedSize = imageCodecs[i].storedSize;
+      if (imageCodecs[i].codec == QPC_CODEC_NONE && storedSize != s.size) {
+        std::cout << "Error: QPC segment " << i << " has a bad stored size"
+                  << std::endl;
+        return -EINVAL;
+      }
+    }
+    uint64_t nameOffset = computeOffset(qpc, s.name);
+    uint64_t startOffset = computeOffset(qpc, s.start);
+    if (nameOffset >= qpcSize ||
+        memchr(base + nameOffset, '\0', qpcSize - nameOffset) == nullptr) {
+      std::cout << "Error: QPC segment " << i << " name is out of bounds"
+                << std::endl;
+      return -EINVAL;
+    }
+    if (startOffset > qpcSize || storedSize > qpcSize - startOffset ||
+        s.offset > s.size) {
+      std::cout << "Error: QPC segment "
+                << reinterpret_cast<const char *>(base + nameOffset)
+                << " is out of bounds" << std::endl;
+      return -EINVAL;
+    }
+    segments.emplace_back(s.size, s.offset,
+                          const_cast<char *>(reinterpret_cast<const char *>(
+                              base + nameOffset)),
+                          const_cast<uint8_t *>(base + startOffset));
+  }
+
+  return 0;
+}
+
+int mapQpcFile(QAicQpcHandle **handle, const std::string &qpcPath) {
+  if (handle == nullptr) {
+    return -EINVAL;
+  }
+  *handle = nullptr;
+
+  int fd = open(qpcPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    int rc = -errno;
+    std::cout << "Error: Unable to open QPC for reading: " << qpcPath
+              << std::endl;
+    return rc;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int rc = -errno;
+    close(fd);
+    return rc;
+  }
+  size_t fileSize = static_cast<size_t>(st.st_size);
+  if (fileSize < sizeof(QAicQpc)) {
+    close(fd);
+    std::cout << "Error: QPC is truncated: " << qpcPath << std::endl;
+    return -EINVAL;
+  }
+
+  void *addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  close(fd);
+  if (addr == MAP_FAILED) {
+    int rc = -errno;
+    std::cout << "Error: Unable to map QPC: " << qpcPath << std::endl;
+    return rc;
+  }
+
+  QAicQpcMapping *mapping = createQpcMappingObject(addr, fileSize);
+  if (mapping == nullptr) {
+    munmap(addr, fileSize);
+    return -ENOMEM;
+  }
+
+  const uint8_t *base = reinterpret_cast<const uint8_t *>(addr);
+  std::vector<QpcSegment> storedSegments;
+  std::vector<QpcSegmentCodec> codecs;
+  if (int rc = validateQpcImage(base, fileSize, storedSegments, codecs);
+      rc != 0) {
+    std::cout << "Error: Invalid QPC: " << qpcPath << std::endl;
+    destroyQpcMappingObject(mapping);
+    return rc;
+  }
+  if (int rc = decompressSegments(storedSegments.data(),
+                                  codecs.empty() ? nullptr : codecs.data(),
+                                  storedSegments.size(), *mapping->segments,
+                                  *mapping->buffers);
+      rc != 0) {
+    std::cout << "Error: Invalid QPC: " << qpcPath << std::endl;
+    destroyQpcMappingObject(mapping);
+    return rc;
+  }
+
+  // The handle's QAicQpc looks like a fixed up, uncompressed copy based at
+  // the mapping
+  mapping->qpc.hdr = reinterpret_cast<const QAicQpc *>(base)->hdr;
+  mapping->qpc.hdr.compressionType = SLOWPATH;
+  mapping->qpc.hdr.base = reinterpret_cast<uint64_t>(base);
+  mapping->qpc.numImages = mapping->segments->size();
+  mapping->qpc.images = mapping->segments->data();
+
+  int rc = createQpcHandle(handle, SLOWPATH);
+  if (rc != 0) {
+    destroyQpcMappingObject(mapping);
+    return rc;
+  }
+  (*handle)->qpcMapping = mapping;
+
+  return 0;
+}
+
 // Helper function. Generally the user should be able to maintain a QAicQpc
 // handle,
 // But the following function will provide a copied and fixed up qpc buffer
@@ -556,6 +1058,44 @@ uint8_t *copyQpcBuffer(uint8_t *destination, uint8_t *source, size_t destSize) {
   return destination;
 }
 
+// Looks up segName in qpc, resolving its addresses against base.
+static bool findQPCSegment(const QAicQpc *qpc, uint8_t *base,
+                           const char *segName, uint8_t **segBuf,
+                           size_t *segSize, size_t offset) {
+  const QpcSegment *images =
+      reinterpret_cast<const QpcSegment *>(resolveAddr(qpc, base, qpc->images));
+  const QpcSegmentCodec *codecs = getSegmentCodecs(qpc, images);
+
+  for (uint64_t count = 0; count < qpc->numImages; count++) {
+    const QpcSegment *segment = &(images[count]);
+    const char *name = reinterpret_cast<const char *>(
+        resolveAddr(qpc, base, segment->name));
+    if (strcmp(segName, name) == 0) {
+      // Compressed segments cannot be returned without a copy
+      if (codecs != nullptr && codecs[count].codec != QPC_CODEC_NONE) {
+        return false;
+      }
+      uint8_t *start = resolveAddr(qpc, base, segment->start);
+
+      // segment->offset is always 0 for all images sans
+      // constants.bin. At this point for compile time
+      // constants we only have 2 sections.
+      if (segment->offset > 0 && offset == 0) {
+        // Load static compile time constants.
+        *segBuf = start;
+        *segSize = segment->offset;
+      } else {
+        *segBuf = start + segment->offset;
+        *segSize = segment->size - segment->offset;
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
 bool getQPCSegment(const uint8_t *source, const char *segName, uint8_t **segBuf,
                    size_t *segSize, size_t offset) {
   bool retVal = false;
@@ -568,35 +1108,42 @@ bool getQPCSegment(const uint8_t *source, const char *segName, uint8_t **segBuf,
   if (source != nullptr) {
     // Check if the user passed in a QPC image
     if (memcmp(source, (void *)&qpcMagic, sizeof(uint32_t)) == 0) {
-      // This is a qpc image. Get the constantsdesc
-      const QAicQpc *qpc = reinterpret_cast<const QAicQpc *>(source);
-
-      for (uint64_t count = 0; count < qpc->numImages; count++) {
-        QpcSegment *segment = &(qpc->images[count]);
-        if (strcmp(segName, segment->name) == 0) {
-
-          // segment->offset is always 0 for all images sans
-          // constants.bin. At this point for compile time
-          // constants we only have 2 sections.
-          if (segment->offset > 0 && offset == 0) {
-            // Load static compile time constants.
-            *segBuf = segment->start;
-            *segSize = segment->offset;
-          } else {
-            *segBuf = segment->start + segment->offset;
-            *segSize = segment->size - segment->offset;
-          }
-
-          retVal = true;
-          break;
-        }
-      }
+      // This is a qpc image. Resolve the addresses relative to source so that
+      // QPC files read or mapped as is (hdr.base == 0) are handled without a
+      // fixed up copy.
+      retVal = findQPCSegment(reinterpret_cast<const QAicQpc *>(source),
+                              const_cast<uint8_t *>(source), segName, segBuf,
+                              segSize, offset);
     }
   }
 
   return retVal;
 }
 
+bool getQPCSegment(QAicQpcHandle *handle, const char *segName,
+                   uint8_t **segBuf, size_t *segSize, size_t offset) {
+  uint8_t *serializedQpc = nullptr;
+  size_t serializedQpcSize = 0;
+
+  if (segName == nullptr || segBuf == nullptr) {
+    return false;
+  }
+
+  // The mapped QAicQpc holds the uncompressed segments
+  if (handle != nullptr && handle->qpcMapping != nullptr) {
+    QAicQpc *qpc = &handle->qpcMapping->qpc;
+    return findQPCSegment(qpc, reinterpret_cast<uint8_t *>(qpc->hdr.base),
+                          segName, segBuf, segSize, offset);
+  }
+
+  if (getSerializedQpc(handle, &serializedQpc, &serializedQpcSize) != 0 ||
+      serializedQpcSize == 0) {
+    return false;
+  }
+
+  return getQPCSegment(serializedQpc, segName, segBuf, segSize, offset);
+}
+
 std::vector<QpcSegment>::iterator
 getQPCSegment(std::vector<QpcSegment> &segmentVector, std::string segmentName) {
   for (auto it = segmentVector.begin(); it != segmentVector.end(); it++) {
@@ -607,37 +1154,149 @@ getQPCSegment(std::vector<QpcSegment> &segmentVector, std::string segmentName) {
   return segmentVector.end();
 }
 
-static int binaryFileToBuffer(const std::string &filePath,
-                              std::vector<uint8_t> &buf) {
-  std::ifstream ifs(filePath, std::ifstream::ate | std::ifstream::binary);
-  if (!ifs) {
-    std::cout
-        << "Error: buildFromSegments failed. Unable to read segment from file: "
-        << filePath << std::endl;
-    return -EINVAL;
+// Buffered writer of a QPC to a file descriptor. Offsets are relative to the
+// position of the descriptor when the writer is created. Writes are
+// positioned, so the offsets can be fixed up after the fact with seekp().
+class QpcFdWriter {
+public:
+  explicit QpcFdWriter(int fd) : fd_(fd) {
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (start < 0) {
+      error_ = -errno;
+      return;
+    }
+    start_ = start;
+    buffer_.reserve(bufferSize);
   }
-  size_t fileSize = static_cast<std::size_t>(ifs.tellg());
-  buf.resize(fileSize);
-  ifs.seekg(std::ios_base::beg);
-  ifs.read((char *)buf.data(), buf.size());
-  ifs.close();
-  return 0;
-}
 
-template <typename T>
-void write(std::ofstream &qpcFile, const T *src, int elts) {
-  uint64_t pos = qpcFile.tellp();
-  while (alignTo(pos, alignof(T)) != pos) {
-    qpcFile.write(0, 1);
-    ++pos;
+  ~QpcFdWriter() { flush(); }
+
+  uint64_t tellp() const { return pos_ + buffer_.size(); }
+
+  void write(const char *src, size_t bytes) {
+    while (bytes > 0 && error_ == 0) {
+      size_t n = std::min(bytes, bufferSize - buffer_.size());
+      buffer_.insert(buffer_.end(), src, src + n);
+      src += n;
+      bytes -= n;
+      if (buffer_.size() == bufferSize) {
+        flush();
+      }
+    }
+  }
+
+  void put(char c) { write(&c, 1); }
+
+  void align(uint64_t alignment) {
+    while (alignTo(tellp(), alignment) != tellp()) {
+      put(0);
+    }
+  }
+
+  void seekp(uint64_t pos) {
+    flush();
+    pos_ = pos;
+  }
+
+  // Writes out the buffer and returns 0 or a negative errno
+  int flush() {
+    size_t done = 0;
+    while (done < buffer_.size() && error_ == 0) {
+      ssize_t n = pwrite(fd_, buffer_.data() + done, buffer_.size() - done,
+                         start_ + pos_ + done);
+      if (n < 0 && errno != EINTR) {
+        error_ = -errno;
+      } else if (n > 0) {
+        done += n;
+      }
+    }
+    pos_ += done;
+    buffer_.clear();
+    return error_;
+  }
+
+  // Leaves the descriptor positioned at the end of the QPC
+  int finish(uint64_t size) {
+    if (flush() == 0 && lseek(fd_, start_ + size, SEEK_SET) < 0) {
+      error_ = -errno;
+    }
+    return error_;
   }
+
+  explicit operator bool() const { return error_ == 0; }
+
+private:
+  static constexpr size_t bufferSize = 64 * 1024;
+  int fd_;
+  int error_{0};
+  uint64_t start_{0};
+  uint64_t pos_{0};
+  std::vector<uint8_t> buffer_;
+};
+
+template <typename T>
+void write(QpcFdWriter &qpcFile, const T *src, uint64_t elts) {
+  qpcFile.align(alignof(T));
   size_t bytes = elts * sizeof(T);
   qpcFile.write(reinterpret_cast<const char *>(src), bytes);
 }
 
-/// Incrementally write constants from inputFile to qpcFile
-int writeConstants(std::ofstream &qpcFile, const std::string &inputFilePath,
-                   std::vector<QpcSegment> &segments, int idx) {
+/// Write a segment of size bytes to qpcFile one chunk at a time, compressing
+/// each chunk with the codec. nextChunk returns the next chunk of the segment
+/// or nullptr on error. codec.storedSize is set to the number of bytes
+/// written.
+static int
+writeSegmentData(QpcFdWriter &qpcFile, uint64_t size, QpcSegmentCodec &codec,
+                 const std::function<const uint8_t *(size_t)> &nextChunk) {
+  uint64_t numChunks = getNumChunks(size, codec.chunkSize);
+  uint64_t dataOffset = qpcFile.tellp();
+
+  // The chunk sizes are unknown at this point, so we'll have to come back and
+  // fix them up after the fact.
+  std::vector<uint64_t> chunkSizes;
+  if (codec.codec == QPC_CODEC_ZLIB) {
+    chunkSizes.resize(numChunks, 0);
+    write(qpcFile, reinterpret_cast<const uint8_t *>(chunkSizes.data()),
+          chunkSizes.size() * sizeof(uint64_t));
+  }
+
+  std::vector<uint8_t> compressed;
+  for (uint64_t i = 0; i < numChunks; ++i) {
+    size_t chunkBytes =
+        std::min<uint64_t>(codec.chunkSize, size - i * codec.chunkSize);
+    const uint8_t *chunk = nextChunk(chunkBytes);
+    if (chunk == nullptr) {
+      return -EINVAL;
+    }
+    if (codec.codec == QPC_CODEC_ZLIB) {
+      if (int rc = compressChunk(chunk, chunkBytes, compressed); rc != 0) {
+        return rc;
+      }
+      chunkSizes[i] = compressed.size();
+      write(qpcFile, compressed.data(), compressed.size());
+    } else {
+      write(qpcFile, chunk, chunkBytes);
+    }
+  }
+
+  uint64_t endOffset = qpcFile.tellp();
+  codec.storedSize = endOffset - dataOffset;
+
+  if (codec.codec == QPC_CODEC_ZLIB) {
+    qpcFile.seekp(dataOffset);
+    write(qpcFile, reinterpret_cast<const uint8_t *>(chunkSizes.data()),
+          chunkSizes.size() * sizeof(uint64_t));
+    qpcFile.seekp(endOffset);
+  }
+
+  return qpcFile ? 0 : -EIO;
+}
+
+/// Incrementally write a segment from inputFilePath to qpcFile, one chunk at
+/// a time, and record its size.
+static int writeSegmentFromFile(QpcFdWriter &qpcFile,
+                                const std::string &inputFilePath,
+                                QpcSegment &segment, QpcSegmentCodec &codec) {
 
   std::ifstream inputFile(inputFilePath,
                           std::ifstream::ate | std::ifstream::binary);
@@ -650,28 +1309,26 @@ int writeConstants(std::ofstream &qpcFile, const std::string &inputFilePath,
 
   size_t fileSize = static_cast<std::size_t>(inputFile.tellg());
 
-  // Load in constants.bin 1MB at a time
+  // Load in the file one chunk (1MB) at a time
   inputFile.seekg(std::ios_base::beg);
-  constexpr int numBytesToLoad = 1024 * 1024;
-  std::vector<uint8_t> segmentBuf(numBytesToLoad);
-  while (inputFile.read((char *)segmentBuf.data(), numBytesToLoad)) {
-    write(qpcFile, segmentBuf.data(), segmentBuf.size());
-  }
-
-  // Now load any trailing bytes that didn't fit into buffer
-  int numBytesRemaining = fileSize % numBytesToLoad;
-  if (numBytesRemaining > 0) {
-    inputFile.clear();
-    inputFile.seekg(fileSize - numBytesRemaining);
-    segmentBuf.resize(numBytesRemaining);
-    while (inputFile.read((char *)segmentBuf.data(), segmentBuf.size())) {
-      write(qpcFile, segmentBuf.data(), segmentBuf.size());
-    }
+  std::vector<uint8_t> segmentBuf(
+      std::min<uint64_t>(codec.chunkSize, fileSize));
+  int res = writeSegmentData(
+      qpcFile, fileSize, codec, [&](size_t bytes) -> const uint8_t * {
+        if (!inputFile.read((char *)segmentBuf.data(), bytes)) {
+          return nullptr;
+        }
+        return segmentBuf.data();
+      });
+  if (res != 0) {
+    std::cout << "Error: buildFromSegments failed. Unable to write segment "
+                 "from file: "
+              << inputFilePath << std::endl;
+    return res;
   }
 
   // Record the size of this segment
-  segments[idx].start = segmentBuf.data();
-  segments[idx].size = fileSize;
+  segment.size = fileSize;
 
   inputFile.close();
 
@@ -681,6 +1338,25 @@ int writeConstants(std::ofstream &qpcFile, const std::string &inputFilePath,
 // Builds the QPC from \p segments.  Writes QPC to \p outputPath.
 int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
                       const std::string &qpcPath) {
+  // Write the QPC to disk.
+  int fd = open(qpcPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0666);
+  if (fd < 0) {
+    std::cout << "Error: Unable to open QPC for writing: " << qpcPath
+              << std::endl;
+    return -EBADF;
+  }
+
+  int res = buildFromSegments(segmentVec, fd);
+  if (close(fd) != 0 && res == 0) {
+    res = -errno;
+  }
+  return res;
+}
+
+// Builds the QPC from \p segments.  Writes QPC to \p qpcFd.
+int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
+                      int qpcFd) {
   if (segmentVec.empty()) {
     std::cout
         << "Error: buildFromSegments failed. No segment descriptors provided."
@@ -710,40 +1386,22 @@ int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
   // Make a copy of the segments, so we can modify the offsets.
   std::vector<QpcSegment> segments;
   segments.reserve(segmentVec.size());
-  // Maps the segment name to a segment buffer that gets loaded from disk.
-  std::unordered_map<std::string, std::vector<uint8_t>>
-      segmentNameToSegmentBuffer;
-  // Keep track of the path to the constants.bin file so it can be loaded later
-  std::string constantsFilePath;
+  // Codec of every segment, the QPC is only COMPRESSED if one is used
+  std::vector<QpcSegmentCodec> codecs;
+  bool isCompressed = false;
   for (auto &sd : segmentVec) {
     auto &s = sd.segment;
     segments.emplace_back(s.size, s.offset, s.name, s.start);
-    if (sd.kind == QPC_SEGMENT_FILE) {
-      // Don't buffer constants, write them out directly later
-      if (s.name == constantsBinaryFileName) {
-        constantsFilePath = sd.filePath;
-        continue;
-      }
-
-      assert(!sd.filePath.empty());
-      auto &segmentBuf = segmentNameToSegmentBuffer[s.name];
-      int res = binaryFileToBuffer(sd.filePath, segmentBuf);
-      if (res != 0)
-        return res;
-
-      assert(s.start == nullptr);
-      segments.back().start = segmentBuf.data();
-      assert(s.size == 0);
-      segments.back().size = segmentBuf.size();
-    }
+    codecs.push_back({sd.codec, AICQPC_DEFAULT_CHUNK_SIZE, 0});
+    isCompressed |= sd.codec != QPC_CODEC_NONE;
+    // File segments are streamed when the segment data is written
+    assert(sd.kind != QPC_SEGMENT_FILE || !sd.filePath.empty());
+    assert(sd.kind != QPC_SEGMENT_FILE || s.start == nullptr);
   }
 
-  // Write the QPC to disk.
-  std::ofstream qpcFile(qpcPath,
-                        std::ios::out | std::ios::trunc | std::ios::binary);
+  QpcFdWriter qpcFile(qpcFd);
   if (!qpcFile) {
-    std::cout << "Error: Unable to open QPC for writing: " << qpcPath
-              << std::endl;
+    std::cout << "Error: Unable to write QPC, bad file descriptor" << std::endl;
     return -EBADF;
   }
 
@@ -753,7 +1411,7 @@ int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
   // we'll have to come back and fix them up after the fact.
   QAicQpc qpc;
   qpc.hdr.size = 0;
-  qpc.hdr.compressionType = SLOWPATH;
+  qpc.hdr.compressionType = isCompressed ? COMPRESSED : SLOWPATH;
   qpc.hdr.base = 0;
   qpc.numImages = numSegments;
   qpc.images = nullptr;
@@ -767,6 +1425,8 @@ int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
   // we'll have to come back and fix them up after the fact.
   for (auto &s : segments)
     write(qpcFile, &s, 1);
+  if (isCompressed)
+    write(qpcFile, codecs.data(), numSegments);
 
   // Write the segment names.
   for (int i = 0; i < numSegments; ++i) {
@@ -775,17 +1435,27 @@ int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
     write(qpcFile, segName, strlen(segName) + 1);
   }
 
-  // Write the segment data.
+  // Write the segment data, 8 byte aligned like serialized QPCs. File
+  // segments are streamed from disk so only one chunk of a segment is held in
+  // memory at a time.
   for (int i = 0; i < numSegments; ++i) {
+    qpcFile.align(8);
     segmentDataOffsets[i] = qpcFile.tellp();
-    // If this segment is the constants file, write it directly from
-    // the binary file (it hasn't been stored in the segments buffer).
-    if (segments[i].name == constantsBinaryFileName) {
-      int res = writeConstants(qpcFile, constantsFilePath, segments, i);
+    if (segmentVec[i].kind == QPC_SEGMENT_FILE) {
+      int res = writeSegmentFromFile(qpcFile, segmentVec[i].filePath,
+                                     segments[i], codecs[i]);
       if (res != 0)
         return res;
     } else {
-      write(qpcFile, segments[i].start, segments[i].size);
+      const uint8_t *segmentData = segments[i].start;
+      int res = writeSegmentData(qpcFile, segments[i].size, codecs[i],
+                                 [&](size_t bytes) {
+                                   const uint8_t *chunk = segmentData;
+                                   segmentData += bytes;
+                                   return chunk;
+                                 });
+      if (res != 0)
+        return res;
     }
   }
 
@@ -801,22 +1471,31 @@ int buildFromSegments(const std::vector<QpcSegmentDesc> &segmentVec,
   }
 
   // Go to the beginning and write the updated QPC.
-  qpcFile.seekp(std::ios_base::beg);
+  qpcFile.seekp(0);
   write(qpcFile, &qpc, 1);
 
   // Write the segments with the updated offsets.
   for (auto &s : segments)
     write(qpcFile, &s, 1);
+  if (isCompressed)
+    write(qpcFile, codecs.data(), numSegments);
 
-  qpcFile.close();
+  if (int res = qpcFile.finish(qpc.hdr.size); res != 0) {
+    std::cout << "Error: Unable to write QPC: " << strerror(-res) << std::endl;
+    return res;
+  }
   return 0;
 }
 
 std::unique_ptr<uint8_t[]>
 getNetworkElfSectionDataFromQpc(QAicQpc *qpc, std::string sectionName,
                                 size_t &size) {
-  std::vector<QpcSegment> segmentVector{qpc->images,
-                                        qpc->images + qpc->numImages};
+  std::vector<QpcSegment> segmentVector;
+  std::vector<std::vector<uint8_t>> segmentBuffers;
+  if (decompressSegments(qpc->images, getSegmentCodecs(qpc, qpc->images),
+                         qpc->numImages, segmentVector, segmentBuffers) != 0) {
+    return nullptr;
+  }
   // Find network elf
   std::vector<QpcSegment>::iterator networkElfIt =
       getQPCSegment(segmentVector, networkElfFileName);
@@ -3,13 +3,16 @@
 
 #include <bitset>
 #include <set>
+#include <sstream>
 #include <vector>
 
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MathExtras.h"
 
 #include "../../runtime/lib/AICDefsInternal.h"
+#include "../../runtime/lib/Trace.h"
 #include "Program.h"
 #include "ProgramDesc.h"
 #include "networkdesc/qpc/inc/QAicQpc.h"
@@ -21,8 +24,10 @@ using namespace qaic;
 
 const uint32_t VTCM_MAX_SIZE = 8 * 1024 * 1024;  /*8MB VTCM*/
 const uint32_t L2TCM_MAX_SIZE = 1 * 1024 * 1024; /*1MB L2TCM*/
-const uint32_t COMPUTE_MAX_SEMAPHORES = 2;
+const uint32_t COMPUTE_MAX_SEMAPHORES = 32;
+const uint32_t COMPUTE_SEMAPHORES_PER_IO_GROUP = 2; /*Input and output*/
 const uint32_t DB_SIZE = 4; /*Bytes per doorbell*/
+const uint32_t MAX_TRACE_ENTRIES = 1U << 20; /*Per thread trace ring*/
 
 static uint64_t alignTo(uint64_t x, uint64_t m) {
   return ((x + (m - 1)) & ~(m - 1)); // Only works if alignment is 2^n
@@ -103,7 +108,8 @@ static AICFlatbufMDPortType getPortType(AicMetadataFlat::AICMDPortType portInfoT
 }
 
 
-std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() const {
+std::unique_ptr<MetadataFlatbufferWriter>
+ComputeProgram::generateMetadata(ProgramConstants *constants) const {
   auto &nm_proto = config_.get();
   if (nm_proto.hwversionmajor() != 2) {
     llvm::errs() << "Config Error: hwVersionMajor isn't valid. Supported "
@@ -131,8 +137,23 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   // Number of NSPs
   metadata->setNumNSPs(numNsps);
 
+  // I/O groups
+  uint32_t numIOGroups = 1;
+  for (auto const &buff : nm_proto.inputs())
+    numIOGroups = std::max(numIOGroups, buff.iogroup() + 1);
+  for (auto const &buff : nm_proto.outputs())
+    numIOGroups = std::max(numIOGroups, buff.iogroup() + 1);
+  const uint32_t maxIOGroups =
+      COMPUTE_MAX_SEMAPHORES / COMPUTE_SEMAPHORES_PER_IO_GROUP;
+  if (numIOGroups > maxIOGroups) {
+    llvm::errs() << "Config Error: ioGroup isn't valid. Supported values are: "
+                    "0-" +
+                        std::to_string(maxIOGroups - 1) + "\n";
+    exit(-1);
+  }
+
   // Number of semaphores
-  metadata->setNumSemaphores(COMPUTE_MAX_SEMAPHORES);
+  metadata->setNumSemaphores(numIOGroups * COMPUTE_SEMAPHORES_PER_IO_GROUP);
 
   DoorbellOps doorbellOps_in, doorbellOps_out;
   SemaphoreOps semaphoreOps_in, semaphoreOps_out;
@@ -140,8 +161,13 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   uint16_t fileNum = 0;
   uint64_t hostOffset = 0;
   uint8_t dynamic_entry = 0;
-  const uint16_t inputSem = 0;
-  const uint16_t outputSem = 1;
+  // Semaphores of I/O group N
+  auto inputSem = [](uint16_t ioGroup) {
+    return ioGroup * COMPUTE_SEMAPHORES_PER_IO_GROUP;
+  };
+  auto outputSem = [](uint16_t ioGroup) {
+    return ioGroup * COMPUTE_SEMAPHORES_PER_IO_GROUP + 1;
+  };
 
   size_t ddrBuffersSize = 0;
   size_t l2tcmBuffersSize = 1; // AICMetadataWriter won't allow 0
@@ -152,8 +178,11 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   uint32_t numThreads, numHmxThreads, numHvxThreads;
   getNumThreads(numThreads, numHmxThreads, numHvxThreads, nm_proto);
 
+  // 0 and 1 both mean the inputs are used where the host puts them
+  uint32_t numInputSlots = std::max(1U, nm_proto.numinputslots());
+
   // MC ID 0 is for L2TCM doorbells
-  // DBNum is for input buffer DBs, then output buffer DBs
+  // DBNum is for input buffer DBs, then output buffer DBs, each by I/O group
   // MC ID 1:N is for input buffers to VTCM/L2TCM
   // MC ID N+1:M is for output buffers to VTCM/L2TCM
   // MC ID is a "don't care" for DDR buffers
@@ -176,6 +205,18 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
     if (!buff.nodoorbell())
       numDBs++;
   }
+  if (numInputSlots > 1)
+    numDBs += numInputSlots * nm_proto.inputs_size();
+  if (nm_proto.allreducesize() > 0 && !nm_proto.nspcollectives()) {
+    llvm::errs() << "Config Error: allReduceSize needs nspCollectives\n";
+    exit(-1);
+  }
+  if (nm_proto.nspcollectives())
+    numDBs += 2 * numNsps + (nm_proto.allreducesize() > 0);
+  bool traceRings = nm_proto.traceentries() > 0 &&
+                    nm_proto.tracebackend() == aicnwdesc::RING;
+  if (traceRings)
+    numDBs++;
   if (numDBs < 281) {
     numDBs = 281;
   } else {
@@ -197,6 +238,7 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   //  - exit DB
   //  - udma dummy descriptor
   //  - udma descriptors (8 per thread?)
+  //  - task deques, if taskDequeSize is set
   //  - user data
   uint32_t udmaDummyStartDescOffset = alignTo(DBSpaceSize, CACHE_LINE_SIZE);
   uint32_t udmaBufferStartOffset = alignTo(
@@ -207,7 +249,19 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   metadata->initL2TCMResize(udmaDummyStartDescOffset +
                             sizeof(aic::DMADescriptor));
 
+  // Deques hold a power of 2 of tasks, so the runtime wraps with a mask
+  uint32_t taskDequeSize = 0;
+  if (nm_proto.taskdequesize() > 0)
+    taskDequeSize = CACHE_LINE_SIZE +
+                    alignTo(PowerOf2Ceil(nm_proto.taskdequesize()) *
+                                TASK_DESC_SIZE,
+                            CACHE_LINE_SIZE);
+  uint32_t taskDequesStartOffset = udmaBufferStartOffset + udmaBufferSize;
+  uint32_t taskDequesSize = numThreads * NUM_TASK_AFFINITIES * taskDequeSize;
+
   size_t reservedL2TCMSize = udmaDummyStartDescOffset + udmaBufferSize;
+  if (taskDequesSize > 0)
+    reservedL2TCMSize = taskDequesStartOffset + taskDequesSize;
   l2tcmBuffersSize = std::max(l2tcmBuffersSize, reservedL2TCMSize);
 
   // Initialize the dummy Descriptor to done
@@ -231,12 +285,15 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
 
   mcId++;
 
-  ProgramDesc progDesc(/*exitDB*/ numDBs - 1, inputSem, outputSem, numThreads);
+  ProgramDesc progDesc(/*exitDB*/ numDBs - 1, inputSem(0), outputSem(0),
+                       numThreads);
+  progDesc.setNumHvxThreads(numHvxThreads);
   assert(numDBs - 1 == 280);
 
   auto processBuff = [&](const aicnwdesc::IODescription &buff,
                          usageType_t usage, uint16_t semNum,
-                         uint16_t semWaitVal, uint16_t semInitVal, bool last) {
+                         uint16_t semWaitVal, uint16_t semInitVal, bool last,
+                         uint64_t buffDBNum) {
     SemaphoreOps semaphoreOps;
     DoorbellOps doorbellOps;
 
@@ -306,6 +363,12 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
       ddrBuffersSize = std::max(ddrBuffersSize, devOffset + dmaSize);
     }
 
+    if (usage == USAGE_INTERNAL && buff.iogroup() != 0) {
+      llvm::errs() << "Config Error: Only Input and Output buffers can have "
+                      "an ioGroup\n";
+      exit(-1);
+    }
+
     if (usage != USAGE_INTERNAL) {
       if (buff.insyncfence() != 0 && buff.insyncfence() != 1) {
         llvm::errs() << "Config Error: inSyncFence must be 0 or 1\n";
@@ -328,7 +391,7 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
     }
 
     // I/O DB
-    uint64_t DBOffset = DBNum * DB_SIZE;
+    uint64_t DBOffset = buffDBNum * DB_SIZE;
     if (usage != USAGE_INTERNAL) {
       metadata->addDoorbellOp(doorbellOps, AICMDDoorballOpSize32, /*mcId*/ 0,
                               DBOffset, DBData);
@@ -350,7 +413,7 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
     }
 
     progDesc.addBuffer(buff,
-                       /*waitDBNum*/ DBNum,
+                       /*waitDBNum*/ buffDBNum,
                        /*ioDBNum*/ 0,
                        /*waitDBVal*/ DBData,
                        /*ioDBVal*/ DBData,
@@ -359,8 +422,8 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
                        /*buffMCID*/ isMC(memType) ? mcId - 1 : 0,
                        /*nspMask*/ nspMask,
                        /*usage*/ usage,
-                       /*allowPartial*/ buff.allowpartial());
-    DBNum++;
+                       /*allowPartial*/ buff.allowpartial(),
+                       /*ioGroup*/ buff.iogroup());
 
     if (usage != USAGE_INTERNAL) {
       // I/O DMA
@@ -374,39 +437,157 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
     }
   };
 
-  uint16_t inMask = 0;
-  uint16_t outMask = 0;
-  for (auto const &buff : nm_proto.inputs()) {
-    inMask |= getNspMask(buff, numNsps);
+  std::vector<uint16_t> inMasks(numIOGroups, 0);
+  std::vector<uint16_t> outMasks(numIOGroups, 0);
+  std::vector<int> lastInput(numIOGroups, -1);
+  std::vector<int> lastOutput(numIOGroups, -1);
+  for (int i = 0; i < nm_proto.inputs_size(); i++) {
+    auto const &buff = nm_proto.inputs(i);
+    inMasks[buff.iogroup()] |= getNspMask(buff, numNsps);
+    lastInput[buff.iogroup()] = i;
   }
-  for (auto const &buff : nm_proto.outputs()) {
-    outMask |= getNspMask(buff, numNsps);
+  for (int i = 0; i < nm_proto.outputs_size(); i++) {
+    auto const &buff = nm_proto.outputs(i);
+    outMasks[buff.iogroup()] |= getNspMask(buff, numNsps);
+    lastOutput[buff.iogroup()] = i;
+  }
+
+  // Each I/O group has its own input and output semaphore. The input DMAs
+  // of a group start once every NSP with inputs in the group has
+  // incremented its input semaphore, and the output DMAs once every NSP with
+  // outputs in the group has decremented its output semaphore.
+  for (uint16_t ioGroup = 0; ioGroup < numIOGroups; ioGroup++) {
+    progDesc.addIOGroup(inputSem(ioGroup), outputSem(ioGroup));
+    metadata->initSemaphore(inputSem(ioGroup), /*semInitVal*/ 0);
+    metadata->initSemaphore(
+        outputSem(ioGroup),
+        std::bitset<aic::MAX_NUM_CORES>(outMasks[ioGroup]).count());
+  }
+
+  // I/O DBs are numbered by usage, then by I/O group, so the DBs the runtime
+  // clears together are contiguous
+  std::vector<uint64_t> inputDBNums(nm_proto.inputs_size());
+  std::vector<uint64_t> outputDBNums(nm_proto.outputs_size());
+  for (uint16_t ioGroup = 0; ioGroup < numIOGroups; ioGroup++) {
+    for (int i = 0; i < nm_proto.inputs_size(); i++) {
+      if (nm_proto.inputs(i).iogroup() == ioGroup)
+        inputDBNums[i] = DBNum++;
+    }
+  }
+  for (uint16_t ioGroup = 0; ioGroup < numIOGroups; ioGroup++) {
+    for (int i = 0; i < nm_proto.outputs_size(); i++) {
+      if (nm_proto.outputs(i).iogroup() == ioGroup)
+        outputDBNums[i] = DBNum++;
+    }
   }
 
   // Input buffers
-  uint16_t semNum = inputSem;
-  uint16_t semInitVal = 0;
-  uint16_t semWaitVal = std::bitset<aic::MAX_NUM_CORES>(inMask).count();
-  int lastIndex = nm_proto.inputs_size() - 1;
-  metadata->initSemaphore(semNum, semInitVal);
-  for (int i = 0; i < nm_proto.inputs_size(); i++)
-    processBuff(nm_proto.inputs(i), USAGE_INPUT, semNum, semWaitVal, semInitVal,
-                i == lastIndex);
+  for (int i = 0; i < nm_proto.inputs_size(); i++) {
+    uint16_t ioGroup = nm_proto.inputs(i).iogroup();
+    uint16_t semWaitVal =
+        std::bitset<aic::MAX_NUM_CORES>(inMasks[ioGroup]).count();
+    processBuff(nm_proto.inputs(i), USAGE_INPUT, inputSem(ioGroup), semWaitVal,
+                /*semInitVal*/ 0, i == lastInput[ioGroup], inputDBNums[i]);
+  }
 
   // Output buffers
-  semNum = outputSem;
-  semInitVal = std::bitset<aic::MAX_NUM_CORES>(outMask).count();
-  semWaitVal = 0;
-  lastIndex = nm_proto.outputs_size() - 1;
-  metadata->initSemaphore(semNum, semInitVal);
-  for (int i = 0; i < nm_proto.outputs_size(); i++)
-    processBuff(nm_proto.outputs(i), USAGE_OUTPUT, semNum, semWaitVal,
-                semInitVal, i == lastIndex);
+  for (int i = 0; i < nm_proto.outputs_size(); i++) {
+    uint16_t ioGroup = nm_proto.outputs(i).iogroup();
+    uint16_t semInitVal =
+        std::bitset<aic::MAX_NUM_CORES>(outMasks[ioGroup]).count();
+    processBuff(nm_proto.outputs(i), USAGE_OUTPUT, outputSem(ioGroup),
+                /*semWaitVal*/ 0, semInitVal, i == lastOutput[ioGroup],
+                outputDBNums[i]);
+  }
 
   // Internal buffers
   for (auto const &buff : nm_proto.internalbuffers())
     processBuff(buff, USAGE_INTERNAL, /*semNum*/ 0, /*semWaitVal*/ 0,
-                /*semInitVal*/ 0, /*lastIndex*/ false);
+                /*semInitVal*/ 0, /*lastIndex*/ false, DBNum++);
+
+  // Input slots
+  // Each slot is an internal copy of every input, placed after all other
+  // buffers in the input's memory. The runtime copies the inputs into a free
+  // slot so the host can send the next inputs while the slot is in use. The
+  // doorbell of a slot buffer is set while the slot is in use.
+  if (numInputSlots > 1) {
+    progDesc.setInputSlots(numInputSlots);
+    for (uint32_t slot = 0; slot < numInputSlots; slot++) {
+      for (auto const &buff : nm_proto.inputs()) {
+        aicnwdesc::IODescription slotBuff = buff;
+        slotBuff.set_nodoorbell(false);
+        slotBuff.set_allowpartial(false);
+        slotBuff.set_iogroup(0);
+        slotBuff.set_devoffset(0);
+        slotBuff.set_baseaddroffset(0);
+        if (buff.dest() == aicnwdesc::DDR) {
+          uint32_t nspMask = getNspMask(buff, numNsps);
+          if (numNsps != 1 && ((nspMask & (nspMask - 1)) != 0)) {
+            llvm::errs() << "Config Error: DDR inputs must be limited to a "
+                            "single NSP when numInputSlots is greater than 1\n";
+            exit(-1);
+          }
+          slotBuff.set_devoffset(alignTo(ddrBuffersSize, CACHE_LINE_SIZE));
+        } else if (buff.dest() == aicnwdesc::L2TCM) {
+          slotBuff.set_baseaddroffset(alignTo(l2tcmBuffersSize, 1U << 12));
+        } else {
+          slotBuff.set_baseaddroffset(alignTo(vtcmBuffersSize, 1U << 12));
+        }
+        processBuff(slotBuff, USAGE_INTERNAL, /*semNum*/ 0, /*semWaitVal*/ 0,
+                    /*semInitVal*/ 0, /*lastIndex*/ false, DBNum++);
+      }
+    }
+  }
+
+  // NSP collectives
+  // nspBarrier and allReduce each have a DB per NSP, which NSP N sets on
+  // every NSP through MC ID 0 when it arrives. The allReduce scratch buffer
+  // holds every NSP's contribution twice, so an NSP can start the next
+  // allReduce while the others still reduce the previous one.
+  if (nm_proto.nspcollectives()) {
+    uint16_t nspBarrierDB = DBNum;
+    uint16_t allReduceDB = DBNum + numNsps;
+    for (int i = 0; i < 2 * numNsps; i++)
+      metadata->initL2TCMWord((DBNum++) * DB_SIZE, 0);
+    progDesc.setNSPCollectives(numNsps, nspBarrierDB, allReduceDB);
+
+    if (nm_proto.allreducesize() > 0) {
+      uint32_t allReduceSize =
+          alignTo(nm_proto.allreducesize(), CACHE_LINE_SIZE);
+      aicnwdesc::IODescription reduceBuff;
+      reduceBuff.set_type(aicnwdesc::Int8Ty);
+      reduceBuff.add_dims(2 * numNsps * allReduceSize);
+      reduceBuff.set_dest(aicnwdesc::VTCM);
+      reduceBuff.set_baseaddroffset(alignTo(vtcmBuffersSize, 1U << 12));
+      progDesc.setAllReduceBuffer(allReduceSize);
+      processBuff(reduceBuff, USAGE_INTERNAL, /*semNum*/ 0, /*semWaitVal*/ 0,
+                  /*semInitVal*/ 0, /*lastIndex*/ false, DBNum++);
+    }
+  }
+
+  // Trace rings
+  // Each thread of each NSP has a trace ring in shared DDR, after all other
+  // DDR buffers. Ring entries are rounded up to a power of 2 so the runtime
+  // wraps with a mask. The STM backend needs no buffer.
+  if (nm_proto.tracebackend() == aicnwdesc::STM)
+    progDesc.setTraceBackend(TRACE_BACKEND_STM);
+  if (traceRings) {
+    if (nm_proto.traceentries() > MAX_TRACE_ENTRIES) {
+      llvm::errs() << "Config Error: traceEntries can't be more than " +
+                          std::to_string(MAX_TRACE_ENTRIES) + "\n";
+      exit(-1);
+    }
+    uint32_t traceEntries = std::max<uint64_t>(
+        PowerOf2Ceil(nm_proto.traceentries()), TRACE_MIN_ENTRIES);
+    aicnwdesc::IODescription traceBuff;
+    traceBuff.set_type(aicnwdesc::Int8Ty);
+    traceBuff.add_dims(numNsps * numThreads * traceRingSize(traceEntries));
+    traceBuff.set_dest(aicnwdesc::DDR);
+    traceBuff.set_devoffset(alignTo(ddrBuffersSize, CACHE_LINE_SIZE));
+    progDesc.setTraceBuffer(traceEntries);
+    processBuff(traceBuff, USAGE_INTERNAL, /*semNum*/ 0, /*semWaitVal*/ 0,
+                /*semInitVal*/ 0, /*lastIndex*/ false, DBNum++);
+  }
 
   // UDMA descriptors buffer
   aicnwdesc::IODescription udmaBuff;
@@ -425,6 +606,39 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   }
   progDesc.addUDMADescBuffer(udmaBuff, udmaDummyStartDescOffset, allNspsMask);
 
+  // Task deques buffer
+  if (taskDequesSize > 0) {
+    aicnwdesc::IODescription taskBuff;
+    taskBuff.set_type(aicnwdesc::Int8Ty);
+    taskBuff.add_dims(taskDequesSize);
+    taskBuff.set_devoffset(taskDequesStartOffset);
+    taskBuff.set_dest(aicnwdesc::L2TCM);
+    progDesc.addTaskDequesBuffer(taskBuff, taskDequeSize, allNspsMask);
+  }
+
+  // Arenas
+  // The runtime allocates from the VTCM and L2TCM after every buffer
+  if (nm_proto.vtcmarenasize() > 0) {
+    uint32_t arenaOffset = alignTo(vtcmBuffersSize, 1U << 12);
+    vtcmBuffersSize = arenaOffset + nm_proto.vtcmarenasize();
+    if (vtcmBuffersSize > VTCM_MAX_SIZE) {
+      llvm::errs() << "Config Error: VTCM buffers and arena can't go past " +
+                          std::to_string(VTCM_MAX_SIZE) + "\n";
+      exit(-1);
+    }
+    progDesc.setVTCMArena(arenaOffset, nm_proto.vtcmarenasize());
+  }
+  if (nm_proto.l2tcmarenasize() > 0) {
+    uint32_t arenaOffset = alignTo(l2tcmBuffersSize, 1U << 12);
+    l2tcmBuffersSize = arenaOffset + nm_proto.l2tcmarenasize();
+    if (l2tcmBuffersSize > L2TCM_MAX_SIZE) {
+      llvm::errs() << "Config Error: L2TCM buffers and arena can't go past " +
+                          std::to_string(L2TCM_MAX_SIZE) + "\n";
+      exit(-1);
+    }
+    progDesc.setL2TCMArena(arenaOffset, nm_proto.l2tcmarenasize());
+  }
+
   // VTCM Usage
   metadata->setVTCMSize(vtcmBuffersSize);
 
@@ -443,15 +657,9 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   // Single VTCM Page
   metadata->setSingleVTCMPage(nm_proto.singlevtcmpage());
 
-  // Program Description Constants file
-  std::ofstream constantsFile;
-  constantsFile.open("constants.bin", std::ios::binary | std::ios::out);
-  if (!constantsFile) {
-    llvm::errs() << "Unable to create constants.bin\n";
-    exit(-1);
-  }
-  uint32_t progDescSize = progDesc.serialize(constantsFile);
-  constantsFile.close();
+  // Program Description Constants
+  std::ostringstream constantsStream;
+  uint32_t progDescSize = progDesc.serialize(constantsStream);
 
   // Constants Usage
   metadata->setStaticConstantsSize(progDescSize);
@@ -460,21 +668,21 @@ std::unique_ptr<MetadataFlatbufferWriter> ComputeProgram::generateMetadata() con
   metadata->setDynamicConstantsECCEnabled(false);
   metadata->addConstantMapping(allNspsMask, /*offset*/ 0, progDescSize);
 
-  // Init constant descriptor bin.
-  std::ofstream constDescFile;
-  constDescFile.open("constantsdesc.bin", std::ios::binary | std::ios::out);
-  if (!constDescFile) {
-    llvm::errs() << "Unable to create constantsdesc.bin\n";
-    exit(-1);
-  }
+  // Init constant descriptor
   AICConstantDescriptor constDesc = {
       .staticConstantsSize = metadata->getStaticConstantsSize(),
       .dynamicConstantsSize = metadata->getDynamicConstantsSize(),
       .staticConstantsECCEnabled = metadata->getStaticConstantsECCEnabled(),
       .dynamicConstantsECCEnabled = metadata->getDynamicConstantsECCEnabled(),
   };
-  constDescFile.write((char *)&constDesc, sizeof(constDesc));
-  constDescFile.close();
+
+  if (constants) {
+    const std::string &progDescBuf = constantsStream.str();
+    constants->constants.assign(progDescBuf.begin(), progDescBuf.end());
+    const uint8_t *constDescPtr = reinterpret_cast<const uint8_t *>(&constDesc);
+    constants->constantsDesc.assign(constDescPtr,
+                                    constDescPtr + sizeof(constDesc));
+  }
 
   // Setup HVX threads
   nnc_activate_fp entryPoint =
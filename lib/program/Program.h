@@ -11,11 +11,24 @@
 
 namespace qaic {
 
+/**
+ * @brief The constants segments that accompany the metadata of a program.
+ */
+struct ProgramConstants {
+  std::vector<uint8_t> constants;     //< "constants.bin" - program descriptor
+  std::vector<uint8_t> constantsDesc; //< "constantsdesc.bin"
+};
+
 class Program {
 public:
   virtual ~Program() = default;
 
-  virtual std::unique_ptr<MetadataFlatbufferWriter> generateMetadata() const = 0;
+  /**
+   * @brief Generates the program metadata. If \p constants is not null it
+   * receives the contents of the constants segments of the QPC.
+   */
+  virtual std::unique_ptr<MetadataFlatbufferWriter>
+  generateMetadata(ProgramConstants *constants = nullptr) const = 0;
   virtual std::unique_ptr<aicnwdesc::networkDescriptor>
   generateNetworkDescriptor() const = 0;
   virtual bool validateQPC(QAicQpcHandle *handle) const = 0;
@@ -29,7 +42,8 @@ public:
   explicit ComputeProgram(ProgramConfig &&config);
 
   const ProgramConfig &getConfig() const { return config_; }
-  std::unique_ptr<MetadataFlatbufferWriter> generateMetadata() const override;
+  std::unique_ptr<MetadataFlatbufferWriter>
+  generateMetadata(ProgramConstants *constants = nullptr) const override;
   std::unique_ptr<aicnwdesc::networkDescriptor>
   generateNetworkDescriptor() const override;
   bool validateQPC(QAicQpcHandle *handle) const override;
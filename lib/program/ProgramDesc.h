@@ -81,8 +81,26 @@ private:
   uint16_t hasOutputsMask_{0};
   uint32_t udmaDescBuffNum_{0};
   uint32_t udmaDummyStartDescOffset_{0};
+  uint16_t numInputSlots_{0};
+  uint16_t inputSlotsBuffNum_{0};
+  uint16_t numHvxThreads_{0};
+  uint16_t taskDequesBuffNum_{0};
+  uint32_t taskDequeSize_{0};
+  uint16_t numCollectiveNSPs_{0};
+  uint16_t nspBarrierDB_{0};
+  uint16_t allReduceDB_{0};
+  uint16_t allReduceBuffNum_{0};
+  uint32_t allReduceSize_{0};
+  uint32_t vtcmArenaOffset_{0};
+  uint32_t vtcmArenaSize_{0};
+  uint32_t l2tcmArenaOffset_{0};
+  uint32_t l2tcmArenaSize_{0};
+  uint32_t traceBuffNum_{0};
+  uint32_t traceEntries_{0};
+  uint32_t traceBackend_{0};
 
   std::vector<BufferDesc_t> buffers_;
+  std::vector<IOGroupDesc_t> ioGroups_;
 
 public:
   ProgramDesc(uint16_t exitDB, uint16_t inputSem, uint16_t outputSem,
@@ -93,7 +111,8 @@ public:
   void addBuffer(const aicnwdesc::IODescription &desc, uint16_t waitDBNum,
                  uint16_t ioDBNum, uint32_t waitDBVal, uint32_t ioDBVal,
                  uint16_t ioMCID, uint16_t ioDBMCID, uint16_t buffMCID,
-                 uint16_t nspMask, usageType_t usage, bool allowPartial) {
+                 uint16_t nspMask, usageType_t usage, bool allowPartial,
+                 uint16_t ioGroup) {
     memLoc_t location;
     switch (desc.dest()) {
     case aicnwdesc::L2TCM:
@@ -122,14 +141,17 @@ public:
                            .buffMCID = buffMCID,
                            .nspMask = nspMask,
                            .usage = usage,
-                           .allowPartial = allowPartial};
+                           .allowPartial = allowPartial,
+                           .ioGroup = ioGroup};
     buffers_.push_back(std::move(buffer));
     if (usage == USAGE_INPUT) {
       numInputBuffs_++;
       hasInputsMask_ |= nspMask;
+      ioGroups_.at(ioGroup).hasInputsMask |= nspMask;
     } else if (usage == USAGE_OUTPUT) {
       numOutputBuffs_++;
       hasOutputsMask_ |= nspMask;
+      ioGroups_.at(ioGroup).hasOutputsMask |= nspMask;
     } else if (usage == USAGE_INTERNAL)
       numInternalBuffs_++;
   }
@@ -138,14 +160,121 @@ public:
                          uint32_t udmaDummyStartDescOffset, uint16_t nspMask) {
     udmaDummyStartDescOffset_ = udmaDummyStartDescOffset;
     udmaDescBuffNum_ = buffers_.size();
-    addBuffer(udmaBuff, 0, 0, 0, 0, 0, 0, 0, nspMask, USAGE_INTERNAL, 0);
+    addBuffer(udmaBuff, 0, 0, 0, 0, 0, 0, 0, nspMask, USAGE_INTERNAL, 0, 0);
+  }
+
+  void setNumHvxThreads(uint16_t numHvxThreads) {
+    numHvxThreads_ = numHvxThreads;
+  }
+
+  // taskDequeSize is the size in bytes of one task deque in the buffer
+  void addTaskDequesBuffer(aicnwdesc::IODescription &taskBuff,
+                           uint32_t taskDequeSize, uint16_t nspMask) {
+    taskDequeSize_ = taskDequeSize;
+    taskDequesBuffNum_ = buffers_.size();
+    addBuffer(taskBuff, 0, 0, 0, 0, 0, 0, 0, nspMask, USAGE_INTERNAL, 0, 0);
+  }
+
+  // nspBarrier and allReduce each use numNSPs doorbells, starting at
+  // nspBarrierDB and allReduceDB
+  void setNSPCollectives(uint16_t numNSPs, uint16_t nspBarrierDB,
+                         uint16_t allReduceDB) {
+    numCollectiveNSPs_ = numNSPs;
+    nspBarrierDB_ = nspBarrierDB;
+    allReduceDB_ = allReduceDB;
+  }
+
+  // The allReduce scratch buffer is the next buffer added
+  void setAllReduceBuffer(uint32_t allReduceSize) {
+    allReduceSize_ = allReduceSize;
+    allReduceBuffNum_ = buffers_.size();
+  }
+
+  void setVTCMArena(uint32_t offset, uint32_t size) {
+    vtcmArenaOffset_ = offset;
+    vtcmArenaSize_ = size;
+  }
+
+  void setL2TCMArena(uint32_t offset, uint32_t size) {
+    l2tcmArenaOffset_ = offset;
+    l2tcmArenaSize_ = size;
+  }
+
+  // The trace buffer is the next buffer added, with traceEntries entries per
+  // ring
+  void setTraceBuffer(uint32_t traceEntries) {
+    traceEntries_ = traceEntries;
+    traceBuffNum_ = buffers_.size();
+  }
+
+  void setTraceBackend(uint32_t traceBackend) { traceBackend_ = traceBackend; }
+
+  // I/O groups are numbered in the order they are added
+  void addIOGroup(uint16_t inputSem, uint16_t outputSem) {
+    IOGroupDesc_t ioGroup = {.inputSem = inputSem,
+                             .outputSem = outputSem,
+                             .hasInputsMask = 0,
+                             .hasOutputsMask = 0,
+                             .firstInputDB = 0,
+                             .numInputDBs = 0,
+                             .firstOutputDB = 0,
+                             .numOutputDBs = 0};
+    ioGroups_.push_back(ioGroup);
+  }
+
+  // The buffers of the input slots are the next numInputSlots * number of
+  // inputs buffers added.
+  void setInputSlots(uint16_t numInputSlots) {
+    numInputSlots_ = numInputSlots;
+    inputSlotsBuffNum_ = buffers_.size();
+  }
+
+  // Appends the doorbells of the group's buffers with the given usage
+  void addIODoorbells(std::vector<IODoorbell_t> &ioDoorbells, uint16_t ioGroup,
+                      usageType_t usage) {
+    for (uint16_t buffNum = 0; buffNum < buffers_.size(); buffNum++) {
+      const BufferDesc_t &buff = buffers_[buffNum];
+      if (buff.usage != usage || buff.ioGroup != ioGroup)
+        continue;
+      IODoorbell_t ioDoorbell = {.dbNum = buff.waitDBNum,
+                                 .buffNum = buffNum,
+                                 .dbVal = buff.waitDBVal};
+      ioDoorbells.push_back(ioDoorbell);
+    }
   }
 
   uint32_t serialize(std::ostream &f) {
-    if (SERIALIZED_PROGRAMDESC_VERSION == 1) {
+    if (SERIALIZED_PROGRAMDESC_VERSION == 10) {
       uint16_t numBuffs = buffers_.size();
       uint32_t buffOffset = sizeof(SerializedProgramDesc_t);
-      uint32_t size = buffOffset + (numBuffs * sizeof(BufferDesc_t));
+      uint16_t numIOGroups = ioGroups_.size();
+      uint32_t ioGroupsOffset =
+          buffOffset + (numBuffs * sizeof(BufferDesc_t));
+
+      std::vector<IOGroupDesc_t> ioGroups = ioGroups_;
+      std::vector<IODoorbell_t> ioDoorbells;
+      for (uint16_t g = 0; g < numIOGroups; g++) {
+        ioGroups[g].firstInputDB = ioDoorbells.size();
+        addIODoorbells(ioDoorbells, g, USAGE_INPUT);
+        ioGroups[g].numInputDBs =
+            ioDoorbells.size() - ioGroups[g].firstInputDB;
+      }
+      for (uint16_t g = 0; g < numIOGroups; g++) {
+        ioGroups[g].firstOutputDB = ioDoorbells.size();
+        addIODoorbells(ioDoorbells, g, USAGE_OUTPUT);
+        ioGroups[g].numOutputDBs =
+            ioDoorbells.size() - ioGroups[g].firstOutputDB;
+      }
+      uint16_t ioDoorbellFlags = IO_DOORBELLS_CONTIGUOUS;
+      for (size_t i = 1; i < ioDoorbells.size(); i++) {
+        if (i != numInputBuffs_ &&
+            ioDoorbells[i].dbNum != ioDoorbells[i - 1].dbNum + 1)
+          ioDoorbellFlags &= ~IO_DOORBELLS_CONTIGUOUS;
+      }
+      uint32_t ioDoorbellsOffset =
+          ioGroupsOffset + (numIOGroups * sizeof(IOGroupDesc_t));
+      uint32_t size =
+          ioDoorbellsOffset + (ioDoorbells.size() * sizeof(IODoorbell_t));
 
       f.write((char *)&SERIALIZED_PROGRAMDESC_VERSION,
               sizeof(SERIALIZED_PROGRAMDESC_VERSION));
@@ -164,10 +293,37 @@ public:
       f.write((char *)&udmaDescBuffNum_, sizeof(udmaDescBuffNum_));
       f.write((char *)&udmaDummyStartDescOffset_,
               sizeof(udmaDummyStartDescOffset_));
+      f.write((char *)&numInputSlots_, sizeof(numInputSlots_));
+      f.write((char *)&inputSlotsBuffNum_, sizeof(inputSlotsBuffNum_));
+      f.write((char *)&numIOGroups, sizeof(numIOGroups));
+      f.write((char *)&ioDoorbellFlags, sizeof(ioDoorbellFlags));
+      f.write((char *)&ioGroupsOffset, sizeof(ioGroupsOffset));
+      f.write((char *)&ioDoorbellsOffset, sizeof(ioDoorbellsOffset));
+      f.write((char *)&numHvxThreads_, sizeof(numHvxThreads_));
+      f.write((char *)&taskDequesBuffNum_, sizeof(taskDequesBuffNum_));
+      f.write((char *)&taskDequeSize_, sizeof(taskDequeSize_));
+      f.write((char *)&numCollectiveNSPs_, sizeof(numCollectiveNSPs_));
+      f.write((char *)&nspBarrierDB_, sizeof(nspBarrierDB_));
+      f.write((char *)&allReduceDB_, sizeof(allReduceDB_));
+      f.write((char *)&allReduceBuffNum_, sizeof(allReduceBuffNum_));
+      f.write((char *)&allReduceSize_, sizeof(allReduceSize_));
+      f.write((char *)&vtcmArenaOffset_, sizeof(vtcmArenaOffset_));
+      f.write((char *)&vtcmArenaSize_, sizeof(vtcmArenaSize_));
+      f.write((char *)&l2tcmArenaOffset_, sizeof(l2tcmArenaOffset_));
+      f.write((char *)&l2tcmArenaSize_, sizeof(l2tcmArenaSize_));
+      f.write((char *)&traceBuffNum_, sizeof(traceBuffNum_));
+      f.write((char *)&traceEntries_, sizeof(traceEntries_));
+      f.write((char *)&traceBackend_, sizeof(traceBackend_));
 
       for (auto &buff : buffers_) {
         f.write((char *)&buff, sizeof(buff));
       }
+      for (auto &ioGroup : ioGroups) {
+        f.write((char *)&ioGroup, sizeof(ioGroup));
+      }
+      for (auto &ioDoorbell : ioDoorbells) {
+        f.write((char *)&ioDoorbell, sizeof(ioDoorbell));
+      }
       return size;
     } else {
       llvm::errs() << "Unknown SERIALIZED_PROGRAMDESC_VERSION"
@@ -3,7 +3,10 @@
 
 #include "support/Debug.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include <fcntl.h>
 #include <fstream>
+#include <unistd.h>
 
 #include "QPCBuilder.h"
 
@@ -20,10 +23,17 @@ void QPCBuilder::addSegment(llvm::StringRef name, const uint8_t *ptr,
                                         << ") to QPC.\n");
 }
 
-bool QPCBuilder::addSegmentFromFile(llvm::StringRef name,
-                                    llvm::StringRef filePath) {
+void QPCBuilder::addSegment(llvm::StringRef name, std::vector<uint8_t> &&data,
+                            size_t offset) {
+  size_t size = data.size();
+  segmentBufferMap_.emplace(name, std::move(data));
+  segmentOffsets_.emplace(name, offset);
+  QAIC_DEBUG_STREAM("adding section \"" << name << "\" (size = " << size
+                                        << ") to QPC.\n");
+}
 
-  std::string fname = filePath.str();
+bool QPCBuilder::loadSegmentFile(const std::string &name,
+                                 const std::string &fname) {
   std::ifstream ifs(fname, std::ios::binary | std::ios::ate);
   if (!ifs) {
     llvm::errs() << "Failed to open " << fname << " for reading.\n";
@@ -33,14 +43,23 @@ bool QPCBuilder::addSegmentFromFile(llvm::StringRef name,
   std::ifstream::pos_type fileSize = ifs.tellg();
   ifs.seekg(0, std::ios::beg);
 
-  segmentBufferMap_[name.str()].resize(fileSize);
-  ifs.read((char *)&segmentBufferMap_[name.str()][0], fileSize);
+  segmentBufferMap_[name].resize(fileSize);
+  ifs.read((char *)&segmentBufferMap_[name][0], fileSize);
 
   // if we fail to read all bytes then error out and don't add the segment
   if (ifs.gcount() != fileSize) {
-    segmentBufferMap_.erase(name.str());
+    segmentBufferMap_.erase(name);
     return false;
   }
+  return true;
+}
+
+bool QPCBuilder::addSegmentFromFile(llvm::StringRef name,
+                                    llvm::StringRef filePath) {
+
+  if (!loadSegmentFile(name.str(), filePath.str()))
+    return false;
+  size_t fileSize = segmentBufferMap_[name.str()].size();
 
   QAIC_DEBUG_STREAM("adding section \""
                     << name << "\" (size = "
@@ -55,13 +74,37 @@ bool QPCBuilder::addSegmentFromFile(llvm::StringRef name,
   return true;
 }
 
+bool QPCBuilder::addStreamedSegmentFromFile(llvm::StringRef name,
+                                            llvm::StringRef filePath) {
+  uint64_t fileSize;
+  if (llvm::sys::fs::file_size(filePath, fileSize)) {
+    llvm::errs() << "Failed to open " << filePath << " for reading.\n";
+    return false;
+  }
+
+  QAIC_DEBUG_STREAM("adding streamed section \"" << name << "\" (size = "
+                                                 << fileSize << ") to QPC.\n");
+  segmentFiles_.emplace(name.str(), filePath.str());
+  // Same offset as addSegmentFromFile
+  segmentOffsets_.emplace(name.str(),
+                          name.equals("constants.bin") ? fileSize : 0);
+  return true;
+}
+
+void QPCBuilder::setSegmentCompression(llvm::StringRef name, QpcCodec codec) {
+  segmentCodecs_[name.str()] = codec;
+}
+
 void QPCBuilder::removeSegment(llvm::StringRef name) {
   segmentBufferMap_.erase(name.str());
+  segmentFiles_.erase(name.str());
   segmentOffsets_.erase(name.str());
+  segmentCodecs_.erase(name.str());
 }
 
 bool QPCBuilder::hasSegment(llvm::StringRef name) const {
-  bool has = (segmentBufferMap_.count(name.str()) == 1);
+  bool has = (segmentBufferMap_.count(name.str()) == 1) ||
+             (segmentFiles_.count(name.str()) == 1);
   assert(has == (segmentOffsets_.count(name.str()) == 1));
   return has;
 }
@@ -82,7 +125,18 @@ llvm::ArrayRef<uint8_t> QPCBuilder::getSegmentData(llvm::StringRef name) const {
 
 QAicQpcHandle *QPCBuilder::finalize() {
 
+  // The in-memory QPC needs the contents of the streamed segments
+  for (auto &kvp : segmentFiles_) {
+    if (!loadSegmentFile(kvp.first, kvp.second)) {
+      llvm::errs() << "Failed to read " << kvp.second << " into the QPC.\n";
+      return {};
+    }
+  }
+  segmentFiles_.clear();
+
   llvm::SmallVector<QpcSegment, 8> qpcSegments;
+  llvm::SmallVector<QpcCodec, 8> qpcCodecs;
+  bool isCompressed = false;
 
   // Create the QpcSegments from the buffer map
   for (auto &kvp : segmentBufferMap_) {
@@ -91,14 +145,21 @@ QAicQpcHandle *QPCBuilder::finalize() {
                              offset,
                              (char *)kvp.first.c_str(),
                              &kvp.second[0]);
+    auto codecItr = segmentCodecs_.find(kvp.first);
+    qpcCodecs.push_back(codecItr == segmentCodecs_.end() ? QPC_CODEC_NONE
+                                                         : codecItr->second);
+    isCompressed |= qpcCodecs.back() != QPC_CODEC_NONE;
   }
 
   QAicQpcHandle *qpcHandle = nullptr;
-  int res = createQpcHandle(&qpcHandle, CompressionType::SLOWPATH);
+  int res = createQpcHandle(&qpcHandle, isCompressed
+                                            ? CompressionType::COMPRESSED
+                                            : CompressionType::SLOWPATH);
   assert(res == 0 && "failed to create QPC handle");
   (void)res;
 
-  res = buildFromSegments(qpcHandle, qpcSegments.data(), qpcSegments.size());
+  res = buildFromSegments(qpcHandle, qpcSegments.data(), qpcCodecs.data(),
+                          qpcSegments.size());
   if (res != 0) {
     llvm::errs() << "Failed to build QPC from Segments: " << res << "\n";
     destroyQpcHandle(qpcHandle);
@@ -108,6 +169,7 @@ QAicQpcHandle *QPCBuilder::finalize() {
   // Remove the buffer copies now that we have commited them to the QPC.
   segmentBufferMap_.clear();
   segmentOffsets_.clear();
+  segmentCodecs_.clear();
 
   return qpcHandle;
 }
@@ -136,7 +198,55 @@ std::vector<uint8_t> QPCBuilder::finalizeToByteArray() {
   return buf;
 }
 
+bool QPCBuilder::finalizeToFile(int fd) {
+  std::vector<QpcSegmentDesc> segmentDescs;
+
+  // Same segment order as finalize()
+  for (auto &kvp : segmentOffsets_) {
+    char *name = const_cast<char *>(kvp.first.c_str());
+    auto codecItr = segmentCodecs_.find(kvp.first);
+    QpcCodec codec =
+        codecItr == segmentCodecs_.end() ? QPC_CODEC_NONE : codecItr->second;
+
+    auto fileItr = segmentFiles_.find(kvp.first);
+    if (fileItr != segmentFiles_.end()) {
+      segmentDescs.emplace_back(kvp.second, name, fileItr->second.c_str(),
+                                codec);
+    } else {
+      auto &buffer = segmentBufferMap_[kvp.first];
+      segmentDescs.emplace_back(buffer.size(), kvp.second, name, buffer.data(),
+                                codec);
+    }
+  }
+
+  int res = buildFromSegments(segmentDescs, fd);
+  if (res != 0) {
+    llvm::errs() << "Failed to write QPC: " << res << "\n";
+    return false;
+  }
+
+  reset();
+  return true;
+}
+
+bool QPCBuilder::finalizeToFile(llvm::StringRef path) {
+  int fd = ::open(path.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0666);
+  if (fd < 0) {
+    llvm::errs() << "Failed to open " << path << " for writing.\n";
+    return false;
+  }
+  bool res = finalizeToFile(fd);
+  if (::close(fd) != 0) {
+    llvm::errs() << "Failed to write " << path << ".\n";
+    res = false;
+  }
+  return res;
+}
+
 void QPCBuilder::reset() {
   segmentBufferMap_.clear();
+  segmentFiles_.clear();
   segmentOffsets_.clear();
+  segmentCodecs_.clear();
 }
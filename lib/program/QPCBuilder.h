@@ -33,6 +33,17 @@ public:
   void addSegment(llvm::StringRef name, const uint8_t *ptr, size_t size,
                   size_t offset = 0);
 
+  /**
+   * @brief Adds a segment to the QPC with the given name, taking ownership of
+   * the data instead of copying it.
+   *
+   * @param name The name of the segment
+   * @param data The data of the segment
+   * @param offset An offset for dynamic constant data
+   */
+  void addSegment(llvm::StringRef name, std::vector<uint8_t> &&data,
+                  size_t offset = 0);
+
   /**
    * @brief Adds a segment to the QPC with the given name.
    *
@@ -68,6 +79,28 @@ public:
    */
   bool addSegmentFromFile(llvm::StringRef name, llvm::StringRef filePath);
 
+  /**
+   * @brief Adds a segment to the QPC with the given name. The contents of the
+   * segment are streamed from a file when the QPC is written by
+   * finalizeToFile(), so they are never held in memory. The file must exist
+   * until the QPC is finalized. getSegmentData() returns an empty array for
+   * these segments.
+   *
+   * @param name The name of the segment.
+   * @param filePath The path to a file to stream into the segment.
+   */
+  bool addStreamedSegmentFromFile(llvm::StringRef name,
+                                  llvm::StringRef filePath);
+
+  /**
+   * @brief Sets the codec used to store a segment. The QPC is finalized as a
+   * COMPRESSED QPC if any segment uses a codec other than QPC_CODEC_NONE.
+   *
+   * @param name The name of the segment, it does not need to be added yet.
+   * @param codec The codec to compress the segment with.
+   */
+  void setSegmentCompression(llvm::StringRef name, QpcCodec codec);
+
   /**
    * @brief Remove a segment with the given name.
    */
@@ -91,7 +124,7 @@ public:
   /**
    * @brief Get the number of segments added to this QPC
    */
-  size_t getNumSegments() const { return segmentBufferMap_.size(); }
+  size_t getNumSegments() const { return segmentOffsets_.size(); }
 
   /**
    * @brief Finalizes the QPC and returns it to the caller.
@@ -110,6 +143,23 @@ public:
    */
   std::vector<uint8_t> finalizeToByteArray();
 
+  /**
+   * @brief Finalizes the QPC and streams it to a file descriptor.
+   *
+   * The header, segment table and segments are written straight to the
+   * descriptor, which must be seekable, and memory use is bounded by the
+   * in-memory segments regardless of the size of the streamed ones.
+   *
+   * @param fd The file descriptor to write the QPC at.
+   * @return true on success.
+   */
+  bool finalizeToFile(int fd);
+
+  /**
+   * @brief Finalizes the QPC and streams it to the file at path.
+   */
+  bool finalizeToFile(llvm::StringRef path);
+
   /**
    * @brief Resets the builder to its default initial state.
    *
@@ -118,8 +168,12 @@ public:
   void reset();
 
 private:
+  bool loadSegmentFile(const std::string &name, const std::string &filePath);
+
   std::map<std::string, std::vector<uint8_t>> segmentBufferMap_;
+  std::map<std::string, std::string> segmentFiles_;
   std::map<std::string, size_t> segmentOffsets_;
+  std::map<std::string, QpcCodec> segmentCodecs_;
 };
 } // namespace qaic
 
@@ -0,0 +1,210 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include "../../runtime/lib/Trace.h"
+#include "STMDecoder.h"
+
+using namespace llvm;
+using namespace qaic;
+
+namespace {
+
+// Reads the nibbles of an STPv2 stream. Fields are most significant nibble
+// first.
+class NibbleReader {
+public:
+  explicit NibbleReader(ArrayRef<uint8_t> stream) : stream_(stream) {}
+
+  bool read(uint8_t &nibble) {
+    if (pos_ == stream_.size() * 2)
+      return false;
+    uint8_t byte = stream_[pos_ / 2];
+    nibble = pos_ % 2 ? byte >> 4 : byte & 0xF;
+    pos_++;
+    return true;
+  }
+
+  bool read(unsigned numNibbles, uint64_t &value) {
+    value = 0;
+    for (unsigned i = 0; i < numNibbles; i++) {
+      uint8_t nibble;
+      if (!read(nibble))
+        return false;
+      value = value << 4 | nibble;
+    }
+    return true;
+  }
+
+private:
+  ArrayRef<uint8_t> stream_;
+  size_t pos_{0};
+};
+
+// The STPv2 packets, by opcode. Opcodes 0xF<N> and 0xF0<N> take 2 and 3
+// nibbles.
+struct Packet {
+  enum Kind { OTHER, DATA, FREQ, ASYNC, INVALID };
+  Kind kind;
+  unsigned numNibbles; // Payload, before the timestamp
+  bool hasTimestamp;
+};
+
+Packet getPacket(uint16_t opcode) {
+  switch (opcode) {
+  case 0x0: // NULL
+    return {Packet::OTHER, 0, false};
+  case 0x1: // M8
+  case 0x2: // MERR
+  case 0x3: // C8
+  case 0xF2: // GERR
+    return {Packet::OTHER, 2, false};
+  case 0x4: // D8, D16, D32, D64
+  case 0x5:
+  case 0x6:
+  case 0x7:
+    return {Packet::DATA, 2U << (opcode - 0x4), false};
+  case 0x8: // D8MTS, D16MTS, D32MTS, D64MTS
+  case 0x9:
+  case 0xA:
+  case 0xB:
+    return {Packet::DATA, 2U << (opcode - 0x8), true};
+  case 0xC: // D4
+  case 0xFD: // D4M
+    return {Packet::DATA, 1, false};
+  case 0xD: // D4MTS
+  case 0xFC: // D4TS
+    return {Packet::DATA, 1, true};
+  case 0xE: // FLAG_TS
+  case 0xF01: // NULL_TS
+    return {Packet::OTHER, 0, true};
+  case 0xF1: // M16
+  case 0xF3: // C16
+    return {Packet::OTHER, 4, false};
+  case 0xF4: // D8TS, D16TS, D32TS, D64TS
+  case 0xF5:
+  case 0xF6:
+  case 0xF7:
+    return {Packet::DATA, 2U << (opcode - 0xF4), true};
+  case 0xF8: // D8M, D16M, D32M, D64M
+  case 0xF9:
+  case 0xFA:
+  case 0xFB:
+    return {Packet::DATA, 2U << (opcode - 0xF8), false};
+  case 0xFE: // FLAG
+    return {Packet::OTHER, 0, false};
+  case 0xFF:
+    return {Packet::ASYNC, 0, false};
+  case 0xF00: // VERSION
+    return {Packet::OTHER, 1, false};
+  case 0xF06: // TRIG
+    return {Packet::OTHER, 2, false};
+  case 0xF07: // TRIG_TS
+    return {Packet::OTHER, 2, true};
+  case 0xF08: // FREQ
+    return {Packet::FREQ, 8, false};
+  default:
+    return {Packet::INVALID, 0, false};
+  }
+}
+
+// Reads a timestamp. Its first nibble is the number of nibbles that follow, 1
+// to 12, 0xD for 14 or 0xE for 16. Timestamps of fewer than 16 nibbles
+// replace the low nibbles of the previous one.
+bool readTimestamp(NibbleReader &in, uint64_t &timestamp, bool &valid) {
+  uint8_t size;
+  if (!in.read(size))
+    return false;
+  valid = size >= 1 && size <= 0xE;
+  if (!valid)
+    return true;
+
+  unsigned numNibbles = size == 0xD ? 14 : size == 0xE ? 16 : size;
+  uint64_t value;
+  if (!in.read(numNibbles, value))
+    return false;
+  if (numNibbles == 16)
+    timestamp = value;
+  else
+    timestamp = (timestamp & ~((1ULL << (4 * numNibbles)) - 1)) | value;
+  return true;
+}
+} // namespace
+
+bool qaic::decodeSTMTrace(ArrayRef<uint8_t> stream,
+                          std::vector<TraceRecord> &records,
+                          uint32_t *timestampFreq) {
+  NibbleReader in(stream);
+  bool foundAsync = false;
+  bool synced = false;
+  unsigned numFs = 0;
+  uint64_t timestamp = 0;
+  uint32_t freq = 0;
+
+  uint8_t nibble;
+  while (in.read(nibble)) {
+    // ASYNC is at least 21 0xF nibbles followed by a 0
+    if (!synced) {
+      if (nibble == 0xF) {
+        numFs++;
+        continue;
+      }
+      synced = nibble == 0 && numFs >= 21;
+      foundAsync |= synced;
+      numFs = 0;
+      continue;
+    }
+
+    uint16_t opcode = nibble;
+    if (opcode == 0xF) {
+      if (!in.read(nibble))
+        break;
+      opcode = 0xF0 | nibble;
+      if (opcode == 0xF0) {
+        if (!in.read(nibble))
+          break;
+        opcode = 0xF00 | nibble;
+      }
+    }
+
+    Packet packet = getPacket(opcode);
+    if (packet.kind == Packet::ASYNC) {
+      synced = false;
+      numFs = 2;
+      continue;
+    }
+    if (packet.kind == Packet::INVALID) {
+      synced = false;
+      numFs = 0;
+      continue;
+    }
+
+    uint64_t value;
+    if (!in.read(packet.numNibbles, value))
+      break;
+    if (packet.hasTimestamp) {
+      bool valid;
+      if (!readTimestamp(in, timestamp, valid))
+        break;
+      if (!valid) {
+        synced = false;
+        numFs = 0;
+        continue;
+      }
+    }
+
+    if (packet.kind == Packet::FREQ)
+      freq = (uint32_t)value;
+    if (packet.kind != Packet::DATA || packet.numNibbles != 16 ||
+        value >> 60 != TRACE_STM_TAG)
+      continue;
+    uint8_t kind = (value >> 48) & 0xF;
+    if (kind > TRACE_END)
+      continue;
+    records.push_back({(uint16_t)((value >> 56) & 0xF),
+                       (uint16_t)((value >> 52) & 0xF), timestamp,
+                       (uint16_t)(value >> 32), kind, (uint32_t)value});
+  }
+  if (timestampFreq)
+    *timestampFreq = freq;
+  return foundAsync;
+}
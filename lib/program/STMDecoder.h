@@ -0,0 +1,41 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#ifndef _QAIC_STMDECODER_H_
+#define _QAIC_STMDECODER_H_
+
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include "TraceDecoder.h"
+
+namespace qaic {
+
+/**
+ * @brief Reads the events of a program built with --trace-backend=stm from a
+ * captured STM stream.
+ *
+ * The stream is MIPI STPv2 as stored by the QDSS sink, two nibbles per byte
+ * with the first in the low nibble. Decoding starts at the first ASYNC. The
+ * events are the 64-bit data packets that carry TRACE_STM_TAG, in stream
+ * order, with the timestamp of their packet, or of the last timestamped
+ * packet if theirs has none. Other data, e.g. of other STM masters, is
+ * skipped. A malformed packet drops the stream until the next ASYNC and a
+ * packet cut off by the end of the capture is ignored.
+ *
+ * The timestamps are in ticks of the STM timestamp clock, whose frequency
+ * the FREQ packets give.
+ *
+ * @param stream The captured stream
+ * @param records Receives the events
+ * @param timestampFreq If not null, receives the frequency in Hz of the last
+ * FREQ packet, or 0 if there is none
+ * @return false if the stream has no ASYNC, i.e. isn't an STM capture
+ */
+bool decodeSTMTrace(llvm::ArrayRef<uint8_t> stream,
+                    std::vector<TraceRecord> &records,
+                    uint32_t *timestampFreq = nullptr);
+} // namespace qaic
+
+#endif
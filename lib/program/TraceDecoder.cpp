@@ -0,0 +1,121 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <utility>
+
+#include "llvm/Support/FormatVariadic.h"
+
+#include "../../runtime/lib/AICDefsInternal.h"
+#include "../../runtime/lib/Trace.h"
+#include "TraceDecoder.h"
+
+using namespace llvm;
+using namespace qaic;
+
+bool qaic::decodeTrace(ArrayRef<uint8_t> traceBuffer, uint32_t numEntries,
+                       std::vector<TraceRecord> &records) {
+  if (numEntries == 0 || (numEntries & (numEntries - 1)))
+    return false;
+  uint32_t ringSize = traceRingSize(numEntries);
+  if (traceBuffer.size() % ringSize)
+    return false;
+
+  for (size_t offset = 0; offset < traceBuffer.size(); offset += ringSize) {
+    TraceRingHeader_t header;
+    memcpy(&header, &traceBuffer[offset], sizeof(header));
+    if (header.capacity != numEntries)
+      continue;
+
+    // Once the ring wraps it holds the last numEntries events
+    uint32_t first = 0;
+    if (header.numEvents > numEntries)
+      first = header.numEvents - numEntries;
+    for (uint32_t n = first; n < header.numEvents; n++) {
+      TraceEntry_t entry;
+      memcpy(&entry,
+             &traceBuffer[offset + TRACE_RING_HEADER_SIZE +
+                          (n & (numEntries - 1)) * sizeof(TraceEntry_t)],
+             sizeof(entry));
+      records.push_back({header.nsp, header.thread, entry.timestamp,
+                         entry.event, entry.kind, entry.payload});
+    }
+  }
+  return true;
+}
+
+std::string qaic::getTraceEventName(uint16_t event) {
+  switch (event) {
+  case TRACE_DMA_SUBMIT:
+    return "DMA submit";
+  case TRACE_DMA_WAIT:
+    return "DMA wait";
+  case TRACE_NSP_WAIT:
+    return "NSP wait";
+  case TRACE_ACTIVATE:
+    return "activate";
+  case TRACE_DOORBELL:
+    return "doorbell";
+  case TRACE_DDR_BW:
+    return "DDR bandwidth";
+  default:
+    return "event " + std::to_string(event);
+  }
+}
+
+static const char *getPhase(uint8_t kind) {
+  switch (kind) {
+  case TRACE_BEGIN:
+    return "B";
+  case TRACE_END:
+    return "E";
+  default:
+    return "i";
+  }
+}
+
+void qaic::writeChromeTrace(ArrayRef<TraceRecord> records, raw_ostream &os,
+                            uint32_t ticksPerSecond) {
+  uint64_t start = UINT64_MAX;
+  std::set<std::pair<uint16_t, uint16_t>> threads;
+  for (auto &record : records) {
+    start = std::min(start, record.timestamp);
+    threads.insert({record.nsp, record.thread});
+  }
+  // Without a frequency the timestamps are UTIMER ticks, UTimerFreqMS per ms
+  double ticksPerUs =
+      ticksPerSecond ? ticksPerSecond / 1e6 : aic::UTimerFreqMS / 1000.0;
+
+  os << "{\"traceEvents\":[\n";
+  const char *separator = "";
+  std::set<uint16_t> nsps;
+  for (auto &thread : threads) {
+    if (nsps.insert(thread.first).second) {
+      os << separator
+         << formatv("{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{0},"
+                    "\"args\":{{\"name\":\"NSP{0}\"}}",
+                    thread.first);
+      separator = ",\n";
+    }
+    os << separator
+       << formatv("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{0},"
+                  "\"tid\":{1},\"args\":{{\"name\":\"Thread {1}\"}}",
+                  thread.first, thread.second);
+    separator = ",\n";
+  }
+  for (auto &record : records) {
+    os << separator
+       << formatv("{{\"name\":\"{0}\",\"ph\":\"{1}\",\"ts\":{2:F3},"
+                  "\"pid\":{3},\"tid\":{4},",
+                  getTraceEventName(record.event), getPhase(record.kind),
+                  (record.timestamp - start) / ticksPerUs, record.nsp,
+                  record.thread);
+    if (record.kind != TRACE_BEGIN && record.kind != TRACE_END)
+      os << "\"s\":\"t\",";
+    os << formatv("\"args\":{{\"payload\":{0}}}", record.payload);
+    separator = ",\n";
+  }
+  os << "\n]}\n";
+}
@@ -0,0 +1,59 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#ifndef _QAIC_TRACEDECODER_H_
+#define _QAIC_TRACEDECODER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace qaic {
+
+/**
+ * @brief An event read from a trace ring
+ */
+struct TraceRecord {
+  uint16_t nsp;
+  uint16_t thread;
+  uint64_t timestamp; ///< UTIMER ticks, or STM timestamp ticks
+  uint16_t event;
+  uint8_t kind; ///< TraceKind
+  uint32_t payload;
+};
+
+/**
+ * @brief Reads the trace rings written by the runtime's traceEvent.
+ *
+ * The events of each ring are returned oldest first, ring by ring. Rings of
+ * threads that didn't run are skipped.
+ *
+ * @param traceBuffer Contents of the program's trace buffer
+ * @param numEntries traceEntries of the serialized program descriptor
+ * @param records Receives the events
+ * @return false if the buffer doesn't hold whole rings of numEntries
+ */
+bool decodeTrace(llvm::ArrayRef<uint8_t> traceBuffer, uint32_t numEntries,
+                 std::vector<TraceRecord> &records);
+
+/**
+ * @brief Gets the name of an event, "event <N>" for events of the program.
+ */
+std::string getTraceEventName(uint16_t event);
+
+/**
+ * @brief Writes the events as Chrome trace JSON, as loaded by
+ * chrome://tracing and Perfetto. Each NSP is a process and each of its
+ * threads a thread. Timestamps are in microseconds from the earliest event.
+ *
+ * @param ticksPerSecond Frequency of the record timestamps in Hz, 0 for the
+ * UTIMER
+ */
+void writeChromeTrace(llvm::ArrayRef<TraceRecord> records,
+                      llvm::raw_ostream &os, uint32_t ticksPerSecond = 0);
+} // namespace qaic
+
+#endif
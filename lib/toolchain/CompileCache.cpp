@@ -0,0 +1,116 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include <algorithm>
+#include <sys/time.h>
+#include <tuple>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+
+#include "CompileCache.h"
+#include "support/Debug.h"
+
+#define DEBUG_TYPE "toolchain"
+
+using namespace llvm;
+using namespace qaic;
+
+constexpr uint64_t CompileCache::DEFAULT_MAX_SIZE;
+
+CompileCache::CompileCache(StringRef dir, uint64_t maxSize)
+    : dir_(dir.str()), maxSize_(maxSize) {}
+
+std::string CompileCache::computeKey(ArrayRef<StringRef> inputs) {
+  MD5 hash;
+  for (auto &input : inputs) {
+    uint64_t size = input.size();
+    hash.update(ArrayRef<uint8_t>((const uint8_t *)&size, sizeof(size)));
+    hash.update(input);
+  }
+  MD5::MD5Result result;
+  hash.final(result);
+  return result.digest().str().str();
+}
+
+std::string CompileCache::getEntryPath(StringRef key) const {
+  SmallString<256> path(dir_);
+  sys::path::append(path, key.take_front(2), key);
+  return path.str().str();
+}
+
+bool CompileCache::lookup(StringRef key, StringRef outputFile) const {
+  auto entry = getEntryPath(key);
+  if (!sys::fs::exists(entry))
+    return false;
+
+  // The entry may be pruned by another compiler at any point, a failed copy
+  // is a miss.
+  if (sys::fs::copy_file(entry, outputFile)) {
+    sys::fs::remove(outputFile);
+    return false;
+  }
+
+  // Mark the entry as recently used
+  utimes(entry.c_str(), nullptr);
+
+  QAIC_DEBUG_STREAM("compile cache hit " << key << " -> " << outputFile
+                                         << "\n");
+  return true;
+}
+
+bool CompileCache::store(StringRef key, StringRef file) const {
+  auto entry = getEntryPath(key);
+  if (sys::fs::create_directories(sys::path::parent_path(entry)))
+    return false;
+
+  // Copy to a unique name next to the entry and rename it into place so
+  // readers never see a partial entry.
+  SmallString<256> tempPath;
+  if (sys::fs::createUniqueFile(entry + ".tmp-%%%%%%%%", tempPath))
+    return false;
+  if (sys::fs::copy_file(file, tempPath) ||
+      sys::fs::rename(tempPath, entry)) {
+    sys::fs::remove(tempPath);
+    return false;
+  }
+
+  QAIC_DEBUG_STREAM("compile cache store " << file << " -> " << key << "\n");
+  return true;
+}
+
+uint64_t CompileCache::prune() const {
+  // (last use, size, path) of every entry
+  std::vector<std::tuple<sys::TimePoint<>, uint64_t, std::string>> entries;
+  uint64_t totalSize = 0;
+
+  std::error_code ec;
+  for (sys::fs::recursive_directory_iterator it(dir_, ec), end;
+       it != end && !ec; it.increment(ec)) {
+    auto status = it->status();
+    if (!status || status->type() != sys::fs::file_type::regular_file)
+      continue;
+    entries.emplace_back(status->getLastModificationTime(), status->getSize(),
+                         it->path());
+    totalSize += status->getSize();
+  }
+
+  if (totalSize <= maxSize_)
+    return 0;
+
+  std::sort(entries.begin(), entries.end());
+  uint64_t target = maxSize_ / 10 * 9;
+  uint64_t removed = 0;
+  for (auto &entry : entries) {
+    if (totalSize - removed <= target)
+      break;
+    if (!sys::fs::remove(std::get<2>(entry)))
+      removed += std::get<1>(entry);
+  }
+
+  QAIC_DEBUG_STREAM("compile cache pruned " << removed << " bytes\n");
+  return removed;
+}
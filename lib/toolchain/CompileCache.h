@@ -0,0 +1,75 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#ifndef _QAIC_TOOLCHAIN_COMPILECACHE_H_
+#define _QAIC_TOOLCHAIN_COMPILECACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace qaic {
+
+/**
+ * @brief A content addressed cache of compiler outputs.
+ *
+ * Entries are stored as <dir>/<first 2 hex digits of key>/<key>. Entries are
+ * published with a rename so several compilers, in one process or many, can
+ * share the directory. Hits refresh the modification time of the entry and
+ * prune() removes the least recently used entries once the cache is larger
+ * than its maximum size.
+ */
+class CompileCache {
+public:
+  /// Default maximum size of the cache in bytes.
+  static constexpr uint64_t DEFAULT_MAX_SIZE = 5ULL * 1024 * 1024 * 1024;
+
+  explicit CompileCache(llvm::StringRef dir,
+                        uint64_t maxSize = DEFAULT_MAX_SIZE);
+
+  /**
+   * @brief Gets the cache directory.
+   */
+  llvm::StringRef getDirectory() const { return dir_; }
+
+  /**
+   * @brief Gets the size in bytes prune() trims the cache to.
+   */
+  uint64_t getMaxSize() const { return maxSize_; }
+
+  /**
+   * @brief Computes the key for a list of inputs. Every input takes part in
+   * the hash, including where one ends and the next starts.
+   */
+  static std::string computeKey(llvm::ArrayRef<llvm::StringRef> inputs);
+
+  /**
+   * @brief Copies the entry for \p key to \p outputFile.
+   * @return true on a hit, false if there is no entry or it can't be copied.
+   */
+  bool lookup(llvm::StringRef key, llvm::StringRef outputFile) const;
+
+  /**
+   * @brief Adds \p file to the cache as the entry for \p key.
+   * @return true if the entry was stored.
+   */
+  bool store(llvm::StringRef key, llvm::StringRef file) const;
+
+  /**
+   * @brief Removes the least recently used entries until the cache is no
+   * larger than 90% of the maximum size, if it is over the maximum size.
+   * @return The number of bytes removed.
+   */
+  uint64_t prune() const;
+
+private:
+  std::string getEntryPath(llvm::StringRef key) const;
+
+  std::string dir_;
+  uint64_t maxSize_;
+};
+} // namespace qaic
+
+#endif
@@ -6,6 +6,9 @@
 #include "support/Debug.h"
 #include "support/StringList.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 
 using namespace llvm;
@@ -16,7 +19,8 @@ using namespace llvm;
 
 qaic::Compiler::Compiler()
     : ToolBase("Compiler"), compilerMode_(Unknown), optLevel_(O1),
-      debugFlag_(false), saveTemps_(false), cxxStandard_(cxx_unknown) {}
+      debugFlag_(false), saveTemps_(false), cxxStandard_(cxx_unknown),
+      cache_(nullptr) {}
 
 std::vector<std::string>
 qaic::Compiler::HexagonProcConfig::getCommandLine() const {
@@ -49,6 +53,12 @@ qaic::Compiler::HexagonProcConfig::getCommandLine() const {
   return args;
 }
 
+bool qaic::Compiler::isSourceFile(llvm::StringRef file) {
+  auto ext = sys::path::extension(file).lower();
+  return ext == ".cc" || ext == ".cxx" || ext == ".cpp" || ext == ".c" ||
+         ext == ".s";
+}
+
 void qaic::Compiler::addIncludePath(llvm::StringRef path) {
   std::string arg = "-I";
   arg += path;
@@ -123,9 +133,6 @@ int qaic::Compiler::execute() {
     return -1;
   }
 
-  StringList args;
-  args.push_back(compilerPath);
-
   if (sourceFile_.empty()) {
     REPORT_TOOL_ERROR("no source file given.\n");
     return 1;
@@ -136,26 +143,51 @@ int qaic::Compiler::execute() {
     return 1;
   }
 
+  StringRef modeFlag;
   if (compilerMode_ == CompilerMode::PreProcess) {
-    args.push_back("-E");
-    args.push_back(sourceFile_);
-    args.push_back("-o");
-    args.push_back(outputFile_);
+    modeFlag = "-E";
   } else if (compilerMode_ == CompilerMode::Compile) {
-    args.push_back("-c");
-    args.push_back(sourceFile_);
-    args.push_back("-o");
-    args.push_back(outputFile_);
+    modeFlag = "-c";
   } else if (compilerMode_ == CompilerMode::CompileNoAssemble) {
-    args.push_back("-S");
-    args.push_back(sourceFile_);
-    args.push_back("-o");
-    args.push_back(outputFile_);
+    modeFlag = "-S";
   } else {
     REPORT_TOOL_ERROR("mode is unspecified\n");
     return -1;
   }
 
+  StringList flags;
+  getFlags(flags, cxx);
+
+  // Look the output up in the compile cache. Pre-processing is cheap enough
+  // not to cache, assembly is not pre-processed and -save-temps needs the
+  // compiler to run.
+  std::string cacheKey;
+  if (cache_ && compilerMode_ != CompilerMode::PreProcess && ext != ".s" &&
+      !saveTemps_) {
+    int rc = getCacheKey(compilerPath, modeFlag, flags, cacheKey);
+    if (rc != 0)
+      return rc;
+    if (cache_->lookup(cacheKey, outputFile_))
+      return 0;
+  }
+
+  StringList args;
+  args.push_back(compilerPath);
+  args.push_back(modeFlag);
+  args.push_back(sourceFile_);
+  args.push_back("-o");
+  args.push_back(outputFile_);
+  for (auto &arg : flags) {
+    args.push_back(arg);
+  }
+
+  int rc = runProcessWithArgs(compilerPath, args.getRefList());
+  if (rc == 0 && !cacheKey.empty())
+    cache_->store(cacheKey, outputFile_);
+  return rc;
+}
+
+void qaic::Compiler::getFlags(StringList &args, bool cxx) const {
   std::vector<std::string> procArgs =
       hexagonProcConfig_.getCommandLine();
   for (auto &arg : procArgs) {
@@ -231,6 +263,64 @@ int qaic::Compiler::execute() {
   for (auto &arg : additionalCommandLineArgs_) {
     args.push_back(arg);
   }
+}
+
+int qaic::Compiler::getCacheKey(StringRef compilerPath, StringRef modeFlag,
+                                const StringList &flags, std::string &key) {
+  // Pre-process the source to a temporary file
+  SmallString<128> preprocessedPath;
+  if (auto ec = sys::fs::createTemporaryFile(sys::path::stem(sourceFile_), "i",
+                                             preprocessedPath)) {
+    REPORT_TOOL_ERROR("can't create temporary file: " << ec.message() << "\n");
+    return ec.value();
+  }
+
+  StringList args;
+  args.push_back(compilerPath);
+  args.push_back("-E");
+  args.push_back(sourceFile_);
+  args.push_back("-o");
+  args.push_back(preprocessedPath);
+  for (auto &arg : flags) {
+    args.push_back(arg);
+  }
+  args.push_back("-Wno-unused-command-line-argument");
+
+  int rc = runProcessWithArgs(compilerPath, args.getRefList());
+  auto bufferOrErr = MemoryBuffer::getFile(preprocessedPath);
+  sys::fs::remove(preprocessedPath);
+  if (rc != 0)
+    return rc;
+  if (!bufferOrErr) {
+    REPORT_TOOL_ERROR("can't read " << preprocessedPath << "\n");
+    return bufferOrErr.getError().value();
+  }
+
+  // The compiler binary stands in for its version; a reinstalled toolchain
+  // changes its size or modification time.
+  sys::fs::file_status compilerStatus;
+  if (auto ec = sys::fs::status(compilerPath, compilerStatus)) {
+    REPORT_TOOL_ERROR("can't stat " << compilerPath << "\n");
+    return ec.value();
+  }
+  std::string compilerVersion =
+      std::to_string(compilerStatus.getSize()) + ":" +
+      std::to_string(compilerStatus.getLastModificationTime()
+                         .time_since_epoch()
+                         .count());
+
+  std::vector<StringRef> inputs = {compilerPath, compilerVersion, modeFlag};
+  for (auto &arg : flags) {
+    inputs.push_back(arg);
+  }
+
+  // Debug info records the working directory
+  SmallString<128> cwd;
+  if (debugFlag_ && !sys::fs::current_path(cwd)) {
+    inputs.push_back(cwd);
+  }
 
-  return runProcessWithArgs(compilerPath, args.getRefList());
+  inputs.push_back(bufferOrErr.get()->getBuffer());
+  key = CompileCache::computeKey(inputs);
+  return 0;
 }
@@ -6,7 +6,9 @@
 
 #include "llvm/Support/Error.h"
 
+#include "CompileCache.h"
 #include "ToolBase.h"
+#include "support/StringList.h"
 
 namespace qaic {
 
@@ -52,6 +54,12 @@ public:
 
   explicit Compiler();
 
+  /**
+   * @brief Returns true if the extension of \p file is one the compiler
+   * accepts as source (C, C++ or assembly).
+   */
+  static bool isSourceFile(llvm::StringRef file);
+
   /**
    * @brief Sets the compilation mode.
    */
@@ -166,7 +174,26 @@ public:
    */
   void setLinkStandardLibsFlag(bool flag) { linkStandardLibs_ = flag; }
 
+  /**
+   * @brief Sets the cache consulted before compiling, nullptr disables
+   * caching. The cache is not owned by the compiler.
+   */
+  void setCompileCache(CompileCache *cache) { cache_ = cache; }
+
 private:
+  /**
+   * @brief Gets the flags that follow the mode, input and output arguments.
+   */
+  void getFlags(StringList &args, bool cxx) const;
+
+  /**
+   * @brief Computes the compile cache key from the pre-processed source, the
+   * flags and the compiler binary.
+   * @return 0 on success or a process exit code
+   */
+  int getCacheKey(llvm::StringRef compilerPath, llvm::StringRef modeFlag,
+                  const StringList &flags, std::string &key);
+
   CompilerMode compilerMode_;
   OptLevel optLevel_;
   bool debugFlag_;
@@ -181,6 +208,7 @@ private:
   HexagonProcConfig hexagonProcConfig_;
   CxxStd cxxStandard_;
   bool linkStandardLibs_;
+  CompileCache *cache_;
 };
 } // namespace qaic
 #endif
@@ -0,0 +1,688 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include "Emulator.h"
+
+#include "libdev/os_host.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+
+using namespace qaic;
+using namespace qaic::emu;
+
+static_assert(sizeof(void *) == sizeof(uint32_t),
+              "The device emulator must be built as 32-bit host code since "
+              "the runtime keeps device addresses in 32-bit fields");
+
+namespace {
+
+// State of an emulated NSP thread.
+struct ThreadState {
+  Emulator *emu;
+  unsigned nsp;
+  unsigned threadId;
+  jmp_buf exitJmp;
+};
+
+thread_local ThreadState *currentThread = nullptr;
+Emulator *activeEmulator = nullptr;
+
+unsigned popcount(uint32_t x) { return __builtin_popcount(x); }
+
+// AICExecContext callbacks. These have no user data argument, so they find
+// the emulator through the calling thread.
+void emuLog(unsigned int mask, unsigned int /*dataCount*/,
+            const char *formatStr, ...) {
+  ThreadState *ts = currentThread;
+  va_list args;
+  va_start(args, formatStr);
+  activeEmulator->log(ts ? ts->nsp : 0, ts ? ts->threadId : 0, mask,
+                      formatStr, args);
+  va_end(args);
+}
+
+// Unwinds the NSP thread back to Emulator::run without running destructors.
+// The runtime exits a thread from _qaic_start after activate() returned or
+// from ERR_FATAL, the only case that skips frames of the program.
+[[noreturn]] void emuExitThread() { longjmp(currentThread->exitJmp, 1); }
+
+void emuErrFatal(const err_const_type *constBlk, uint32_t code1,
+                 uint32_t code2, uint32_t code3) {
+  ThreadState *ts = currentThread;
+  activeEmulator->fatal(ts->nsp, ts->threadId, constBlk, code1, code2, code3);
+  emuExitThread();
+}
+
+void emuNotifyHang() {
+  ThreadState *ts = currentThread;
+  std::cerr << "NSP" << ts->nsp << " thread " << ts->threadId
+            << " reported a hang\n";
+}
+
+void emuSetPMUReg(int /*regId*/, unsigned int /*regValue*/) {}
+
+void emuReadPMUCnt(uint32_t counters[MAX_PMU_COUNTERS]) {
+  memset(counters, 0, MAX_PMU_COUNTERS * sizeof(uint32_t));
+}
+
+void emuUdmaRead(unsigned int /*regId*/, unsigned int *val) { *val = 0; }
+
+} // namespace
+
+extern "C" {
+
+int os_host_nsp_index() { return currentThread ? currentThread->nsp : 0; }
+
+void os_host_udma_link(aic::DMADescriptor * /*tail*/,
+                       aic::DMADescriptor *desc) {
+  activeEmulator->udmaLink(currentThread->nsp, currentThread->threadId, desc);
+}
+
+uint32_t os_host_udma_poll() {
+  return activeEmulator->udmaPoll(currentThread->nsp, currentThread->threadId);
+}
+
+uint32_t os_host_udma_wait() {
+  return activeEmulator->udmaWait(currentThread->nsp, currentThread->threadId);
+}
+
+void os_host_hostsem_command(void *s, uint8_t op, uint8_t semNum,
+                             uint16_t semVal) {
+  activeEmulator->hostSemCommand(s, op, semNum, semVal);
+}
+
+void os_host_pause(int /*sleepCount*/) { std::this_thread::yield(); }
+
+uint64_t os_host_timestamp() {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+  // UTimerFreqMS ticks per ms is 19.2 ticks per us.
+  return (uint64_t)ns * 12 / 625;
+}
+
+void os_host_thread_finished(uint8_t /*virtualThreadId*/) {
+  activeEmulator->threadFinished();
+}
+
+} // extern "C"
+
+Emulator::Emulator(EmulatorConfig config) : config_(std::move(config)) {
+  if (config_.constants.size() < sizeof(SerializedProgramDesc_t)) {
+    std::cerr << "Emulator: constants are too small to hold a program "
+                 "descriptor\n";
+    return;
+  }
+
+  if (!allocate(constants_, config_.constants.size(), 2048))
+    return;
+  memcpy(constants_.base, config_.constants.data(), constants_.size);
+
+  progDesc_ = (const SerializedProgramDesc_t *)constants_.base;
+  if (progDesc_->serialVersion != SERIALIZED_PROGRAMDESC_VERSION) {
+    std::cerr << "Emulator: expected SERIALIZED_PROGRAMDESC_VERSION "
+              << SERIALIZED_PROGRAMDESC_VERSION << " but found "
+              << progDesc_->serialVersion << "\n";
+    return;
+  }
+  if (progDesc_->size > constants_.size ||
+      progDesc_->buffersOffset +
+              progDesc_->numBuffs * sizeof(BufferDesc_t) >
+          constants_.size ||
+      progDesc_->ioGroupsOffset +
+              progDesc_->numIOGroups * sizeof(IOGroupDesc_t) >
+          constants_.size ||
+      progDesc_->ioDoorbellsOffset +
+              (progDesc_->numInputBuffs + progDesc_->numOutputBuffs) *
+                  sizeof(IODoorbell_t) >
+          constants_.size) {
+    std::cerr << "Emulator: program descriptor is truncated\n";
+    return;
+  }
+  progBuffers_ =
+      (const BufferDesc_t *)(constants_.base + progDesc_->buffersOffset);
+  progIOGroups_ =
+      (const IOGroupDesc_t *)(constants_.base + progDesc_->ioGroupsOffset);
+
+  numThreads_ = progDesc_->numThreads;
+  if (numThreads_ < 1 || numThreads_ > (unsigned)aic::MAX_NUM_THREADS) {
+    std::cerr << "Emulator: invalid number of threads " << numThreads_
+              << "\n";
+    return;
+  }
+
+  // The UDMA descriptor buffer is allocated on every NSP.
+  uint32_t allNspsMask = progBuffers_[progDesc_->udmaDescBuffNum].nspMask;
+  numNSPs_ = 32 - __builtin_clz(allNspsMask | 1);
+  if (config_.numNSPs != 0) {
+    if (config_.numNSPs < numNSPs_ ||
+        config_.numNSPs > (unsigned)aic::MAX_NUM_CORES) {
+      std::cerr << "Emulator: program needs " << numNSPs_
+                << " NSPs but was asked to emulate " << config_.numNSPs
+                << "\n";
+      return;
+    }
+    numNSPs_ = config_.numNSPs;
+  }
+
+  inputs_.resize(progDesc_->numInputBuffs);
+
+  if (!setupMemory() || !setupMulticast())
+    return;
+  setupExecContexts();
+  initialized_ = true;
+}
+
+Emulator::~Emulator() {
+  for (auto &w : mcWindows_) {
+    if (w.window.base)
+      munmap(w.window.base, w.window.size);
+  }
+}
+
+const BufferDesc_t *Emulator::getBufferDesc(unsigned buffNum) const {
+  return buffNum < progDesc_->numBuffs ? &progBuffers_[buffNum] : nullptr;
+}
+
+bool Emulator::setInput(unsigned inputNum, std::vector<uint8_t> data) {
+  if (inputNum >= inputs_.size()) {
+    std::cerr << "Emulator: program only has " << inputs_.size()
+              << " inputs\n";
+    return false;
+  }
+  inputs_[inputNum] = std::move(data);
+  return true;
+}
+
+bool Emulator::allocate(Region &region, uint32_t size, uint32_t align) {
+  size_t allocSize = (size + align - 1) / align * align;
+  void *p = aligned_alloc(align, allocSize);
+  if (!p) {
+    std::cerr << "Emulator: unable to allocate " << size << " bytes\n";
+    return false;
+  }
+  memset(p, 0, allocSize);
+  allocations_.emplace_back((uint8_t *)p, free);
+  region.base = (uint8_t *)p;
+  region.size = size;
+  return true;
+}
+
+bool Emulator::setupMemory() {
+  uint32_t ddrSize = config_.sharedDDRSize;
+  if (ddrSize == 0) {
+    ddrSize = 4096;
+    for (unsigned i = 0; i < progDesc_->numBuffs; ++i) {
+      const BufferDesc_t &buff = progBuffers_[i];
+      if (buff.location == DDR)
+        ddrSize = std::max(ddrSize, buff.offset + buff.size);
+    }
+  }
+  if (!allocate(sharedDDR_, ddrSize, 4096) ||
+      !allocate(l2CachedDDR_, 4096, 4096))
+    return false;
+  if (config_.networkHeapSize &&
+      !allocate(networkHeap_, config_.networkHeapSize, 4096))
+    return false;
+
+  nsps_.resize(numNSPs_);
+  for (auto &nsp : nsps_) {
+    if (!allocate(nsp.l2tcm, config_.l2tcmSize, 4096) ||
+        !allocate(nsp.vtcm, config_.vtcmSize, 4096))
+      return false;
+    initL2TCM(nsp);
+  }
+
+  for (unsigned i = 0; i < 32; ++i) {
+    semaphoreInfo_[i].semAddress = (uint32_t)(uintptr_t)semaphores_;
+    semaphoreInfo_[i].semNum = i;
+  }
+  for (unsigned g = 0; g < progDesc_->numIOGroups; ++g) {
+    semaphores_[progIOGroups_[g].inputSem] = 0;
+    semaphores_[progIOGroups_[g].outputSem] =
+        popcount(progIOGroups_[g].hasOutputsMask);
+  }
+  return true;
+}
+
+// Mirrors the initL2TCMWord calls generateMetadata emits.
+void Emulator::initL2TCM(NSP &nsp) {
+  uint32_t *dbs = (uint32_t *)nsp.l2tcm.base;
+  for (unsigned i = 0; i < progDesc_->numBuffs; ++i) {
+    const BufferDesc_t &buff = progBuffers_[i];
+    if (buff.usage == USAGE_OUTPUT)
+      dbs[buff.waitDBNum] = buff.waitDBVal;
+  }
+  dbs[progDesc_->exitDB] = 0;
+
+  aic::DMADescriptor *dummyDesc =
+      (aic::DMADescriptor *)(nsp.l2tcm.base +
+                             progDesc_->udmaDummyStartDescOffset);
+  memset(dummyDesc, 0, sizeof(*dummyDesc));
+  dummyDesc->done = 1;
+}
+
+bool Emulator::setupMulticast() {
+  // MC ID 0 is the doorbell space in L2TCM on every NSP, the buffer MC IDs
+  // follow.
+  uint32_t allNspsMask = (1U << numNSPs_) - 1;
+  mcWindows_.resize(1);
+  mcWindows_[0].location = L2TCM;
+  mcWindows_[0].nspMask = allNspsMask;
+  for (unsigned i = 0; i < progDesc_->numBuffs; ++i) {
+    const BufferDesc_t &buff = progBuffers_[i];
+    if (buff.location == DDR || i == progDesc_->udmaDescBuffNum ||
+        (progDesc_->taskDequeSize && i == progDesc_->taskDequesBuffNum))
+      continue;
+    if (buff.buffMCID >= mcWindows_.size())
+      mcWindows_.resize(buff.buffMCID + 1);
+    mcWindows_[buff.buffMCID].location = buff.location;
+    mcWindows_[buff.buffMCID].nspMask = buff.nspMask;
+  }
+
+  // Reserve an inaccessible address range for each window so that stray
+  // accesses from the NSP threads fault instead of corrupting memory.
+  for (auto &w : mcWindows_) {
+    w.window.size =
+        w.location == VTCM ? config_.vtcmSize : config_.l2tcmSize;
+    void *p = mmap(nullptr, w.window.size, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+      std::cerr << "Emulator: unable to reserve multicast window\n";
+      return false;
+    }
+    w.window.base = (uint8_t *)p;
+    mcAddresses_.push_back(p);
+  }
+  return true;
+}
+
+void Emulator::setupExecContexts() {
+  for (unsigned n = 0; n < numNSPs_; ++n) {
+    AICExecContext &ctx = nsps_[n].execCtx;
+    ctx.virtualNSPId = n;
+    ctx.baseL2TCM = nsps_[n].l2tcm.base;
+    ctx.baseVTCM = nsps_[n].vtcm.base;
+    ctx.baseConstantDataMem = constants_.base;
+    ctx.baseSharedDDR = sharedDDR_.base;
+    ctx.baseL2CachedDDR = l2CachedDDR_.base;
+    ctx.mcAddresses = mcAddresses_.data();
+    ctx.startTimeStamp = os_host_timestamp();
+    ctx.logFuncPtr = emuLog;
+    ctx.exitThread = emuExitThread;
+    ctx.setPMUReg = emuSetPMUReg;
+    ctx.readPMUCnt = emuReadPMUCnt;
+    ctx.errFuncPtr = emuErrFatal;
+    ctx.notifyHangPtr = emuNotifyHang;
+    ctx.udmaReadFuncPtr = emuUdmaRead;
+    ctx.semaphoreListPtr = semaphoreInfo_;
+    ctx.networkHeapAddr = networkHeap_.base;
+    ctx.networkHeapSize = networkHeap_.size;
+    ctx.ddrBWMonRegVaddr = (uint8_t *)&ddrBWMon_;
+  }
+}
+
+bool Emulator::isDDR(const uint8_t *addr) const {
+  for (const Region *r :
+       {&constants_, &sharedDDR_, &l2CachedDDR_, &networkHeap_}) {
+    if (addr >= r->base && addr < r->base + r->size)
+      return true;
+  }
+  return false;
+}
+
+uint8_t *Emulator::locationBase(unsigned nsp, memLoc_t location) const {
+  switch (location) {
+  case L2TCM:
+    return nsps_[nsp].l2tcm.base;
+  case VTCM:
+    return nsps_[nsp].vtcm.base;
+  case DDR:
+    return sharedDDR_.base;
+  default:
+    return nullptr;
+  }
+}
+
+uint8_t *Emulator::bufferAddr(unsigned nsp, const BufferDesc_t &buff) const {
+  return locationBase(nsp, buff.location) + buff.offset;
+}
+
+int Emulator::run(nnc_activate_fp entryPoint) {
+  if (!initialized_)
+    return -1;
+  activeEmulator = this;
+
+  for (unsigned n = 0; n < numNSPs_; ++n) {
+    engines_.emplace_back(new UDMAEngine);
+    engines_.back()->thread = std::thread(&Emulator::udmaEngineMain, this, n);
+  }
+  std::thread host(&Emulator::hostMain, this);
+
+  std::vector<std::thread> threads;
+  for (unsigned n = 0; n < numNSPs_; ++n) {
+    for (unsigned t = 0; t < numThreads_; ++t) {
+      threads.emplace_back([this, entryPoint, n, t]() {
+        ThreadState ts;
+        ts.emu = this;
+        ts.nsp = n;
+        ts.threadId = t;
+        currentThread = &ts;
+        // exitThread longjmps back here.
+        if (setjmp(ts.exitJmp) == 0)
+          entryPoint(&nsps_[n].execCtx, t, t);
+        currentThread = nullptr;
+      });
+    }
+  }
+
+  for (auto &t : threads)
+    t.join();
+  exitRequested_ = true;
+  host.join();
+
+  for (auto &engine : engines_) {
+    {
+      std::lock_guard<std::mutex> guard(engine->lock);
+      engine->stop = true;
+    }
+    engine->cond.notify_all();
+    engine->thread.join();
+  }
+  engines_.clear();
+  activeEmulator = nullptr;
+
+  return failed_ ? -1 : 0;
+}
+
+void Emulator::log(unsigned nsp, unsigned threadId, unsigned mask,
+                   const char *fmt, va_list args) {
+  if (!(mask & config_.logMask))
+    return;
+  // The runtime logs bare newlines to flush the device log.
+  if (strcmp(fmt, "\n") == 0)
+    return;
+  std::lock_guard<std::mutex> guard(logLock_);
+  printf("[NSP%u:T%u] ", nsp, threadId);
+  vprintf(fmt, args);
+  size_t len = strlen(fmt);
+  if (len == 0 || fmt[len - 1] != '\n')
+    printf("\n");
+  fflush(stdout);
+}
+
+void Emulator::fatal(unsigned nsp, unsigned threadId,
+                     const err_const_type *errConst, uint32_t code1,
+                     uint32_t code2, uint32_t code3) {
+  {
+    std::lock_guard<std::mutex> guard(logLock_);
+    fprintf(stderr, "[NSP%u:T%u] FATAL %s:%u: ", nsp, threadId,
+            errConst->fname, errConst->line);
+    fprintf(stderr, errConst->fmt, code1, code2, code3);
+    fprintf(stderr, "\n");
+  }
+  failed_ = true;
+  requestExit();
+}
+
+// UDMA engine
+void Emulator::udmaLink(unsigned nsp, unsigned threadId,
+                        aic::DMADescriptor *desc) {
+  UDMAEngine &engine = *engines_[nsp];
+  ++engine.pending[threadId];
+  {
+    std::lock_guard<std::mutex> guard(engine.lock);
+    engine.queue.push_back({desc, threadId});
+  }
+  engine.cond.notify_one();
+}
+
+uint32_t Emulator::udmaPoll(unsigned nsp, unsigned threadId) {
+  UDMAEngine &engine = *engines_[nsp];
+  if (uint32_t dm0 = engine.errorDM0[threadId])
+    return dm0;
+  return engine.pending[threadId] ? aic::DMA_state_run : aic::DMA_state_idle;
+}
+
+uint32_t Emulator::udmaWait(unsigned nsp, unsigned threadId) {
+  UDMAEngine &engine = *engines_[nsp];
+  while (engine.pending[threadId] && !engine.errorDM0[threadId])
+    std::this_thread::yield();
+  return udmaPoll(nsp, threadId);
+}
+
+void Emulator::udmaEngineMain(unsigned nsp) {
+  UDMAEngine &engine = *engines_[nsp];
+  for (;;) {
+    DMAJob job;
+    {
+      std::unique_lock<std::mutex> guard(engine.lock);
+      engine.cond.wait(guard,
+                       [&] { return engine.stop || !engine.queue.empty(); });
+      if (engine.queue.empty())
+        return;
+      job = engine.queue.front();
+      engine.queue.pop_front();
+    }
+
+    // Walk the chain. The next pointer has to be read before the done bit is
+    // set since the thread may reuse the descriptor as soon as it is done.
+    for (aic::DMADescriptor *desc = job.head; desc;) {
+      if (!processDescriptor(nsp, desc)) {
+        engine.errorDM0[job.threadId] =
+            (uint32_t)(uintptr_t)desc | aic::DMA_state_error;
+        break;
+      }
+      aic::DMADescriptor *next = (aic::DMADescriptor *)(uintptr_t)desc->next;
+      __atomic_fetch_or(&desc->word1, 1U << 31, __ATOMIC_RELEASE);
+      desc = next;
+    }
+    --engine.pending[job.threadId];
+  }
+}
+
+bool Emulator::processDescriptor(unsigned nsp, aic::DMADescriptor *desc) {
+  uint32_t word1 = __atomic_load_n(&desc->word1, __ATOMIC_ACQUIRE);
+  uint32_t length = word1 & 0xffffff;
+  if (((word1 >> 24) & 0xf) != 0)
+    return false;
+  if (length == 0)
+    return true;
+
+  const uint8_t *src = (const uint8_t *)(uintptr_t)desc->src;
+  uint8_t *dst = (uint8_t *)(uintptr_t)desc->dst;
+  if (isDDR(src))
+    __atomic_fetch_add(&ddrBWMon_.readBytes, length, __ATOMIC_RELAXED);
+  if (isDDR(dst))
+    __atomic_fetch_add(&ddrBWMon_.writeBytes, length, __ATOMIC_RELAXED);
+
+  auto copy = [length, src](uint8_t *to) {
+    if (length == aic::DB_SIZE && ((uintptr_t)to & (aic::DB_SIZE - 1)) == 0) {
+      // Doorbell update
+      uint32_t val;
+      memcpy(&val, src, sizeof(val));
+      __atomic_store_n((uint32_t *)to, val, __ATOMIC_RELEASE);
+    } else {
+      memcpy(to, src, length);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+  };
+
+  for (const auto &w : mcWindows_) {
+    if (dst < w.window.base || dst >= w.window.base + w.window.size)
+      continue;
+    uint32_t offset = dst - w.window.base;
+    if (offset + length > w.window.size)
+      return false;
+    for (unsigned n = 0; n < numNSPs_; ++n) {
+      if (n != nsp && (w.nspMask & (1U << n)))
+        copy(locationBase(n, w.location) + offset);
+    }
+    return true;
+  }
+
+  copy(dst);
+  return true;
+}
+
+// GSM semaphores
+void Emulator::hostSemCommand(void *s, uint8_t op, uint8_t semNum,
+                              uint16_t semVal) {
+  std::atomic<int32_t> *sems = (std::atomic<int32_t> *)s;
+  switch (op) {
+  case OS_HOST_SEMOP_INIT:
+    sems[semNum] = semVal;
+    break;
+  case OS_HOST_SEMOP_INC:
+    ++sems[semNum];
+    break;
+  case OS_HOST_SEMOP_DEC:
+    --sems[semNum];
+    break;
+  default:
+    break;
+  }
+}
+
+// Emulated host/firmware
+void Emulator::writeDoorbell(unsigned nsp, uint32_t dbNum, uint32_t val) {
+  uint32_t *dbs = (uint32_t *)nsps_[nsp].l2tcm.base;
+  __atomic_store_n(&dbs[dbNum], val, __ATOMIC_RELEASE);
+}
+
+void Emulator::requestExit() {
+  exitRequested_ = true;
+  for (unsigned n = 0; n < numNSPs_; ++n)
+    writeDoorbell(n, progDesc_->exitDB, 1);
+}
+
+// Input DMA requests wait for every NSP with inputs in the I/O group to
+// increment the group's input semaphore, copy the inputs, ring the buffer
+// doorbells on all NSPs and then reset the semaphore.
+bool Emulator::sendInputs(unsigned ioGroup) {
+  const IOGroupDesc_t &group = progIOGroups_[ioGroup];
+  std::atomic<int32_t> &sem = semaphores_[group.inputSem];
+  if (sem.load() != (int32_t)popcount(group.hasInputsMask))
+    return false;
+
+  for (unsigned i = 0; i < progDesc_->numInputBuffs; ++i) {
+    const BufferDesc_t &buff = progBuffers_[i];
+    if (buff.ioGroup != ioGroup)
+      continue;
+    const std::vector<uint8_t> &data = inputs_[i];
+    for (unsigned n = 0; n < numNSPs_; ++n) {
+      if (buff.location != DDR && !(buff.nspMask & (1U << n)))
+        continue;
+      uint8_t *dst = bufferAddr(n, buff);
+      uint32_t size = buff.size;
+      if (buff.allowPartial) {
+        BufferDescPartialHeader_t hdr;
+        hdr.offset = sizeof(hdr);
+        hdr.size = std::min<uint32_t>(data.size(), buff.size - sizeof(hdr));
+        memcpy(dst, &hdr, sizeof(hdr));
+        dst += hdr.offset;
+        size = hdr.size;
+      }
+      uint32_t copySize = std::min<uint32_t>(size, data.size());
+      memcpy(dst, data.data(), copySize);
+      memset(dst + copySize, 0, size - copySize);
+      if (buff.location == DDR)
+        break;
+    }
+  }
+  for (unsigned i = 0; i < progDesc_->numInputBuffs; ++i) {
+    const BufferDesc_t &buff = progBuffers_[i];
+    if (buff.ioGroup != ioGroup)
+      continue;
+    for (unsigned n = 0; n < numNSPs_; ++n)
+      writeDoorbell(n, buff.waitDBNum, buff.waitDBVal);
+  }
+  sem = 0;
+  return true;
+}
+
+// Output DMA requests wait for every NSP with outputs in the I/O group to
+// decrement the group's output semaphore, copy the outputs, ring the buffer
+// doorbells on all NSPs and then reset the semaphore.
+bool Emulator::receiveOutputs(unsigned ioGroup, unsigned inference) {
+  const IOGroupDesc_t &group = progIOGroups_[ioGroup];
+  std::atomic<int32_t> &sem = semaphores_[group.outputSem];
+  if (sem.load() != 0)
+    return false;
+
+  unsigned firstOutput = progDesc_->numInputBuffs;
+  for (unsigned i = 0; i < progDesc_->numOutputBuffs; ++i) {
+    const BufferDesc_t &buff = progBuffers_[firstOutput + i];
+    if (buff.ioGroup != ioGroup)
+      continue;
+    unsigned n = buff.location == DDR ? 0 : __builtin_ctz(buff.nspMask | 1);
+    if (outputCallback_)
+      outputCallback_(inference, i, bufferAddr(n, buff), buff.size);
+  }
+  for (unsigned i = 0; i < progDesc_->numOutputBuffs; ++i) {
+    const BufferDesc_t &buff = progBuffers_[firstOutput + i];
+    if (buff.ioGroup != ioGroup)
+      continue;
+    for (unsigned n = 0; n < numNSPs_; ++n)
+      writeDoorbell(n, buff.waitDBNum, buff.waitDBVal);
+  }
+  sem = popcount(group.hasOutputsMask);
+  return true;
+}
+
+void Emulator::hostMain() {
+  const unsigned numIOGroups = progDesc_->numIOGroups;
+  const unsigned numThreads = numNSPs_ * numThreads_;
+  // Each I/O group is serviced independently
+  std::vector<unsigned> inputsSent(numIOGroups, 0);
+  std::vector<unsigned> outputsReceived(numIOGroups, 0);
+  unsigned numOutputGroups = 0;
+  unsigned numOutputGroupsDone = 0;
+  for (unsigned g = 0; g < numIOGroups; ++g) {
+    if (progIOGroups_[g].hasOutputsMask)
+      ++numOutputGroups;
+  }
+  // Once all outputs have been received, give the threads a moment to finish
+  // before ringing the exit doorbell for threads that loop forever.
+  const auto exitGrace = std::chrono::milliseconds(100);
+  std::chrono::steady_clock::time_point outputsDone;
+
+  while (!exitRequested_) {
+    // Sample before servicing I/O so semaphore updates made before the last
+    // thread finished are seen.
+    bool allFinished = numThreadsFinished_ == numThreads;
+    bool progress = false;
+
+    for (unsigned g = 0; g < numIOGroups; ++g) {
+      const IOGroupDesc_t &group = progIOGroups_[g];
+      if (group.hasInputsMask && inputsSent[g] < config_.numInferences &&
+          sendInputs(g)) {
+        ++inputsSent[g];
+        progress = true;
+      }
+      if (group.hasOutputsMask && outputsReceived[g] < config_.numInferences &&
+          receiveOutputs(g, outputsReceived[g])) {
+        if (++outputsReceived[g] == config_.numInferences &&
+            ++numOutputGroupsDone == numOutputGroups)
+          outputsDone = std::chrono::steady_clock::now();
+        progress = true;
+      }
+    }
+
+    if (allFinished)
+      break;
+    if (numOutputGroups && numOutputGroupsDone == numOutputGroups &&
+        std::chrono::steady_clock::now() - outputsDone > exitGrace)
+      break;
+    if (!progress)
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  requestExit();
+}
@@ -0,0 +1,218 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#ifndef _QAIC_EMULATOR_H_
+#define _QAIC_EMULATOR_H_
+
+#include <atomic>
+#include <cstdarg>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AICDefsInternal.h"
+#include "AICMetadata.h"
+#include "AICMetadataExecCtx.h"
+#include "SerializedProgramDesc.h"
+
+namespace qaic {
+namespace emu {
+
+/**
+ * @brief Configuration of an emulated device run
+ */
+struct EmulatorConfig {
+  /// Contents of the constants.bin produced by qaic-cc (the serialized program
+  /// descriptor).
+  std::vector<uint8_t> constants;
+  /// Number of NSPs to emulate. 0 derives it from the program descriptor.
+  unsigned numNSPs{0};
+  /// Number of inferences the emulated host drives before requesting exit.
+  unsigned numInferences{1};
+  uint32_t l2tcmSize{1 << 20};
+  uint32_t vtcmSize{8 << 20};
+  /// Shared DDR size. 0 derives it from the DDR buffer descriptors.
+  uint32_t sharedDDRSize{0};
+  uint32_t networkHeapSize{0};
+  /// Log levels (nnc_log_masks) that are printed.
+  unsigned logMask{NNC_LOG_MASK_FATAL | NNC_LOG_MASK_ERROR |
+                   NNC_LOG_MASK_WARN | NNC_LOG_MASK_INFO};
+};
+
+/**
+ * @brief Host-side emulator for a compute program
+ *
+ * Emulates the L2TCM, VTCM and shared DDR of each NSP, the L2TCM doorbells,
+ * the host semaphores, a UDMA engine per NSP that walks DMADescriptor
+ * chains and a DDR bandwidth monitor that counts the DDR bytes the engines
+ * copy, then runs numNSPs x numThreads OS threads through the program entry
+ * point.  The emulated host sends the inputs, collects the outputs and rings
+ * the exit doorbell the same way the firmware does for the metadata that
+ * generateMetadata produces.
+ *
+ * The runtime stores device addresses in 32-bit fields (DMADescriptor,
+ * SemaphoreInfo), so the emulator and the host runtime are built as 32-bit
+ * host code.
+ *
+ * The NSP threads exit through longjmp, which doesn't run destructors. When
+ * activate() fails with ERR_FATAL, the objects on its stack are never
+ * destroyed, so programs shouldn't rely on destructors for cleanup that the
+ * rest of the run depends on, e.g. releasing a lock.
+ */
+class Emulator {
+public:
+  using OutputCallback =
+      std::function<void(unsigned inference, unsigned outputNum,
+                         const uint8_t *data, uint32_t size)>;
+
+  /**
+   * @brief Sets up the emulated device. Problems with the configuration or
+   *        the program descriptor are printed and leave the emulator
+   *        uninitialized, see isInitialized().
+   */
+  explicit Emulator(EmulatorConfig config);
+  ~Emulator();
+  Emulator(const Emulator &) = delete;
+  Emulator &operator=(const Emulator &) = delete;
+
+  /// True if the constructor succeeded. Nothing else may be called otherwise.
+  bool isInitialized() const { return initialized_; }
+
+  /**
+   * @brief Sets the data the host sends to input \p inputNum every inference.
+   *        Data is truncated or zero padded to the buffer size.
+   *
+   * @return false if the program has no input \p inputNum
+   */
+  bool setInput(unsigned inputNum, std::vector<uint8_t> data);
+
+  /**
+   * @brief Sets the function called with each output buffer the host receives
+   */
+  void setOutputCallback(OutputCallback callback) {
+    outputCallback_ = std::move(callback);
+  }
+
+  /**
+   * @brief Runs the program to completion
+   *
+   * @param entryPoint The thread entry point, normally _qaic_start
+   * @return 0 on success, non-zero if the program reported a fatal error or
+   *         the emulator isn't initialized
+   */
+  int run(nnc_activate_fp entryPoint);
+
+  unsigned getNumNSPs() const { return numNSPs_; }
+  const SerializedProgramDesc_t *getProgramDesc() const { return progDesc_; }
+  const BufferDesc_t *getBufferDesc(unsigned buffNum) const;
+  /// Contents of a buffer on an NSP, e.g. the trace buffer after run()
+  const uint8_t *getBufferData(unsigned nsp, unsigned buffNum) const {
+    return bufferAddr(nsp, *getBufferDesc(buffNum));
+  }
+
+  // Entry points for the os_host_* hooks.
+  void udmaLink(unsigned nsp, unsigned threadId, aic::DMADescriptor *desc);
+  uint32_t udmaPoll(unsigned nsp, unsigned threadId);
+  uint32_t udmaWait(unsigned nsp, unsigned threadId);
+  void hostSemCommand(void *s, uint8_t op, uint8_t semNum, uint16_t semVal);
+  void threadFinished() { ++numThreadsFinished_; }
+  void log(unsigned nsp, unsigned threadId, unsigned mask, const char *fmt,
+           va_list args);
+  void fatal(unsigned nsp, unsigned threadId, const err_const_type *errConst,
+             uint32_t code1, uint32_t code2, uint32_t code3);
+
+private:
+  struct Region {
+    uint8_t *base{nullptr};
+    uint32_t size{0};
+  };
+
+  struct NSP {
+    Region l2tcm;
+    Region vtcm;
+    AICExecContext execCtx{};
+  };
+
+  // A multicast window: an address range handed out through mcAddresses
+  // that the UDMA engine redirects to the same offset in every NSP in the
+  // mask, except the NSP issuing the DMA.
+  struct MCWindow {
+    Region window;
+    qaic::memLoc_t location{qaic::LOC_INVALID};
+    uint32_t nspMask{0};
+  };
+
+  struct DMAJob {
+    aic::DMADescriptor *head;
+    unsigned threadId;
+  };
+
+  struct UDMAEngine {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<DMAJob> queue;
+    std::atomic<uint32_t> pending[aic::MAX_NUM_THREADS]{};
+    std::atomic<uint32_t> errorDM0[aic::MAX_NUM_THREADS]{};
+    bool stop{false};
+  };
+
+  bool allocate(Region &region, uint32_t size, uint32_t align);
+  bool setupMemory();
+  bool setupMulticast();
+  void setupExecContexts();
+  void initL2TCM(NSP &nsp);
+  uint8_t *locationBase(unsigned nsp, qaic::memLoc_t location) const;
+  uint8_t *bufferAddr(unsigned nsp, const BufferDesc_t &buff) const;
+  bool isDDR(const uint8_t *addr) const;
+
+  void udmaEngineMain(unsigned nsp);
+  bool processDescriptor(unsigned nsp, aic::DMADescriptor *desc);
+  void hostMain();
+  bool sendInputs(unsigned ioGroup);
+  bool receiveOutputs(unsigned ioGroup, unsigned inference);
+  void writeDoorbell(unsigned nsp, uint32_t dbNum, uint32_t val);
+  void requestExit();
+
+  EmulatorConfig config_;
+  const SerializedProgramDesc_t *progDesc_{nullptr};
+  const BufferDesc_t *progBuffers_{nullptr};
+  const IOGroupDesc_t *progIOGroups_{nullptr};
+  unsigned numNSPs_{0};
+  unsigned numThreads_{0};
+
+  std::vector<std::unique_ptr<uint8_t, void (*)(void *)>> allocations_;
+  Region constants_;
+  Region sharedDDR_;
+  Region l2CachedDDR_;
+  Region networkHeap_;
+  // Stand-in for the DDR bandwidth monitor registers. Only DMA traffic is
+  // counted, the NSP threads' own DDR accesses aren't seen by the emulator.
+  aic::DDRBWMonRegs_t ddrBWMon_{};
+  std::vector<NSP> nsps_;
+  std::vector<MCWindow> mcWindows_;
+  std::vector<void *> mcAddresses_;
+
+  // GSM semaphores, addressed through SemaphoreInfo::semAddress.
+  std::atomic<int32_t> semaphores_[32]{};
+  SemaphoreInfo semaphoreInfo_[32]{};
+
+  std::vector<std::unique_ptr<UDMAEngine>> engines_;
+  std::vector<std::vector<uint8_t>> inputs_;
+  OutputCallback outputCallback_;
+
+  bool initialized_{false};
+  std::atomic<unsigned> numThreadsFinished_{0};
+  std::atomic<bool> exitRequested_{false};
+  std::atomic<bool> failed_{false};
+  std::mutex logLock_;
+};
+
+} // namespace emu
+} // namespace qaic
+
+#endif // _QAIC_EMULATOR_H_
@@ -0,0 +1,129 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+// Launcher for programs built for the device emulator. Link it together with
+// the host build of the program, qaicemu, qaicrt_host and devRuntime_host.
+
+#include "Emulator.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+extern "C" {
+void _qaic_start(void *ctx, uint8_t virtualThreadId, uint32_t stid);
+}
+
+using namespace qaic::emu;
+
+static void usage(const char *argv0) {
+  std::cerr << "Usage: " << argv0
+            << " <constants.bin> [-i <input file>]... [-o <output dir>]\n"
+               "       [-n <num NSPs>] [--num-iter <N>] [--heap-size <bytes>]\n"
+               "       [--trace <trace file>] [-v]\n";
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f)
+    return false;
+  data.assign(std::istreambuf_iterator<char>(f),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+
+int main(int argc, char **argv) {
+  EmulatorConfig config;
+  std::string constantsPath;
+  std::vector<std::string> inputPaths;
+  std::string outputDir;
+  std::string tracePath;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "-i") && hasValue) {
+      inputPaths.push_back(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && hasValue) {
+      outputDir = argv[++i];
+    } else if (!strcmp(argv[i], "-n") && hasValue) {
+      config.numNSPs = std::stoul(argv[++i]);
+    } else if (!strcmp(argv[i], "--num-iter") && hasValue) {
+      config.numInferences = std::stoul(argv[++i]);
+    } else if (!strcmp(argv[i], "--heap-size") && hasValue) {
+      // heapSize from the program config
+      config.networkHeapSize = std::stoul(argv[++i]);
+    } else if (!strcmp(argv[i], "--trace") && hasValue) {
+      tracePath = argv[++i];
+    } else if (!strcmp(argv[i], "-v")) {
+      config.logMask |= NNC_LOG_MASK_DEBUG;
+    } else if (argv[i][0] != '-' && constantsPath.empty()) {
+      constantsPath = argv[i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (constantsPath.empty()) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  if (!readFile(constantsPath, config.constants)) {
+    std::cerr << "Unable to read " << constantsPath << "\n";
+    return -1;
+  }
+
+  Emulator emu(std::move(config));
+  if (!emu.isInitialized())
+    return -1;
+
+  for (unsigned i = 0; i < inputPaths.size(); ++i) {
+    std::vector<uint8_t> data;
+    if (!readFile(inputPaths[i], data)) {
+      std::cerr << "Unable to read " << inputPaths[i] << "\n";
+      return -1;
+    }
+    if (!emu.setInput(i, std::move(data)))
+      return -1;
+  }
+
+  // Same naming as qaic-runner --write-output-dir
+  emu.setOutputCallback([&outputDir](unsigned inference, unsigned outputNum,
+                                     const uint8_t *data, uint32_t size) {
+    if (outputDir.empty()) {
+      std::cout << "Received outputBuff_" << outputNum << " (" << size
+                << " bytes) for inference " << inference << "\n";
+      return;
+    }
+    std::string path = outputDir + "/outputBuff_" + std::to_string(outputNum) +
+                       "-activation-0-inf-" + std::to_string(inference) +
+                       ".bin";
+    std::ofstream f(path, std::ios::binary);
+    if (!f) {
+      std::cerr << "Unable to write " << path << "\n";
+      return;
+    }
+    f.write((const char *)data, size);
+  });
+
+  int rc = emu.run(_qaic_start);
+
+  // The trace buffer, for qaic-trace
+  if (!tracePath.empty()) {
+    const qaic::SerializedProgramDesc_t *progDesc = emu.getProgramDesc();
+    if (progDesc->traceEntries == 0) {
+      std::cerr << "The program wasn't built with traceEntries\n";
+      return -1;
+    }
+    std::ofstream f(tracePath, std::ios::binary);
+    if (!f) {
+      std::cerr << "Unable to write " << tracePath << "\n";
+      return -1;
+    }
+    f.write((const char *)emu.getBufferData(0, progDesc->traceBuffNum),
+            emu.getBufferDesc(progDesc->traceBuffNum)->size);
+  }
+  return rc;
+}
@@ -26,8 +26,20 @@ const int DB_SIZE = 4;
 #define CACHE_LINE_SIZE 128
 #define NUM_UDMA_CACHELINES_PER_THREAD 2
 
+// Each thread has a task deque per TaskAffinity: a cache line holding the
+// deque indices, followed by the tasks.
+#define NUM_TASK_AFFINITIES 3
+#define TASK_DESC_SIZE 8
+
 const int UTimerFreqMS = 19200;
 
+// DDR bandwidth monitor registers, at AICExecContext::ddrBWMonRegVaddr. Free
+// running counts of the bytes the device read from and wrote to DDR.
+typedef struct {
+  uint64_t readBytes;
+  uint64_t writeBytes;
+} DDRBWMonRegs_t;
+
 const unsigned DMA_state_mask = 0x3;
 const unsigned DMA_state_idle = 0;
 const unsigned DMA_state_run = 1;
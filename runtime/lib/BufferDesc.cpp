@@ -80,55 +80,173 @@ uint32_t getBufferSize(int buffNum) {
   }
 }
 
-void broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
-                       const int8_t *src, const uint32_t *dbVal, int threadId,
-                       bool waitForDone) {
+// Whether addr is outside this NSP's TCMs, i.e. in DDR
+static bool isUncachedAddr(const void *addr) {
+  CoreInfo *ctx = getNSPContext();
+  const int8_t *p = (const int8_t *)addr;
+  return !((p >= (int8_t *)ctx->baseL2TCM &&
+            p < ((int8_t *)ctx->baseL2TCM + libdev_l2tcm_size())) ||
+           (p >= (int8_t *)ctx->baseVTCM &&
+            p < ((int8_t *)ctx->baseVTCM + libdev_vtcm_size())));
+}
+
+void dmaBatchInit(DMABatch *batch, int threadId) {
+  libdev_dma_batch_init(batch, threadId);
+}
+
+void dmaBatchCopy(DMABatch *batch, void *dst, const void *src, unsigned size) {
+  int8_t *d = (int8_t *)dst;
+  const int8_t *s = (const int8_t *)src;
+  // Check that there is no overlap between src and dst buffers.
+  assert((d < s && d + size <= s) || (s < d && s + size <= d));
+
+  libdev_dma_batch_add(batch, d, /*dstOffset*/ 0, s, size,
+                       /*isMulticast*/ false, isUncachedAddr(dst),
+                       isUncachedAddr(src));
+}
+
+void dmaBatchCopy2D(DMABatch *batch, void *dst, const void *src,
+                    unsigned rowSize, unsigned numRows, unsigned dstStride,
+                    unsigned srcStride) {
+  assert(rowSize <= dstStride && rowSize <= srcStride &&
+         "Rows of a 2D copy overlap!");
+  libdev_dma_batch_add_2d(batch, (int8_t *)dst, (const int8_t *)src, rowSize,
+                          numRows, dstStride, srcStride, isUncachedAddr(dst),
+                          isUncachedAddr(src));
+}
+
+void dmaBatchBroadcastToBuffer(DMABatch *batch, int buffNum, int32_t dstOffset,
+                               int size, const int8_t *src) {
   const BufferDesc_t *buff = &_progBuffers[buffNum];
   CoreInfo *ctx = getNSPContext();
   assert(((uint32_t)(dstOffset + size) <= buff->size) &&
          "Broadcast would overrun target buffer!");
 
-  // split large (UDMAMaxSize) transfers into multiple transfers
-  while (size) {
-    int transferSize = (size < UDMAMaxSize) ? size : UDMAMaxSize;
-    bool last = (transferSize == size);
-
-    // Detect broadcast to self, since we can't multicast to self
-    if (buff->nspMask == (0x1 << ctx->virtualNSPId)) {
-      int8_t *dst = (int8_t *)getBufferAddr(buffNum) + dstOffset;
-      bool toUncached = buff->location == DDR;
-      bool fromUncached =
-          !((src >= (int8_t *)ctx->baseL2TCM &&
-             src < ((int8_t *)ctx->baseL2TCM + libdev_l2tcm_size())) ||
-            (src >= (int8_t *)ctx->baseVTCM &&
-             src < ((int8_t *)ctx->baseVTCM +
-                    libdev_vtcm_size()))); // src->location == DDR;
-
-      libdev_copyVTCM(dst, src, transferSize, toUncached, fromUncached, dbVal,
-                      /*dbOnlyCheckedLocally*/ true, /*updateDBs*/ last,
-		      /*doRelease*/ true, threadId, buff->waitDBNum);
-    }
-    // Broadcast to the other NSPs
-    if (buff->nspMask & ~(0x1 << ctx->virtualNSPId)) {
-      int8_t *dst =
-          (int8_t *)ctx->mcBaseAddresses[buff->buffMCID] + buff->offset;
-
-      libdev_multicastVTCM(dst, dstOffset, src, transferSize, dbVal,
-                           /*dbOnlyCheckedLocally*/ false, /*updateDBs*/ last,
-			   threadId, buff->waitDBNum, /*mcId*/ 0);
-    }
+  // Detect broadcast to self, since we can't multicast to self
+  if (buff->nspMask == (0x1 << ctx->virtualNSPId)) {
+    int8_t *dst = (int8_t *)getBufferAddr(buffNum) + dstOffset;
+    bool toUncached = buff->location == DDR;
+    libdev_dma_batch_add(batch, dst, /*dstOffset*/ 0, src, size,
+                         /*isMulticast*/ false, toUncached,
+                         isUncachedAddr(src));
+  }
+  // Broadcast to the other NSPs
+  if (buff->nspMask & ~(0x1 << ctx->virtualNSPId)) {
+    int8_t *dst = (int8_t *)ctx->mcBaseAddresses[buff->buffMCID] + buff->offset;
+    libdev_dma_batch_add(batch, dst, dstOffset, src, size,
+                         /*isMulticast*/ true, /*destBypass*/ true,
+                         /*srcBypass*/ false);
+  }
+}
+
+DMAHandle dmaBatchSubmit(DMABatch *batch, int buffNum, const uint32_t *dbVal,
+                         bool waitForDone) {
+  const BufferDesc_t *buff = &_progBuffers[buffNum];
+  CoreInfo *ctx = getNSPContext();
+  bool dbOnlyCheckedLocally = !(buff->nspMask & ~(0x1 << ctx->virtualNSPId));
+  traceInstant(TRACE_DMA_SUBMIT, batch->numDescs, batch->threadId);
+  DMAHandle handle = libdev_dma_batch_submit(
+      batch, dbVal, dbOnlyCheckedLocally, /*updateDBs*/ true,
+      /*doRelease*/ true, buff->waitDBNum, /*mcId*/ 0);
+  if (waitForDone)
+    os_udma_wait();
+  return handle;
+}
+
+DMAHandle dmaBatchSubmit(DMABatch *batch, bool waitForDone) {
+  traceInstant(TRACE_DMA_SUBMIT, batch->numDescs, batch->threadId);
+  DMAHandle handle = libdev_dma_batch_submit(
+      batch, nullptr, /*dbOnlyCheckedLocally*/ true, /*updateDBs*/ false,
+      /*doRelease*/ true, /*DBNum*/ 0, /*mcId*/ 0);
+  if (waitForDone)
+    os_udma_wait();
+  return handle;
+}
+
+bool isTransferDone(DMAHandle handle) {
+  return !handle || (os_load_acquire(&((uint32_t *)handle)[1]) & (1U << 31));
+}
 
-    size -= transferSize;
+void waitForTransfer(DMAHandle handle, int threadId) {
+  if (!handle)
+    return;
+  traceBegin(TRACE_DMA_WAIT, 0, threadId);
+  os_udma_wait_done(handle, threadId);
+  traceEnd(TRACE_DMA_WAIT, 0, threadId);
+}
+
+DMAHandle broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
+                            const int8_t *src, const uint32_t *dbVal,
+                            int threadId, bool waitForDone) {
+  // All chunks and the multicast go out as one descriptor chain with a single
+  // doorbell update at the end.
+  DMABatch batch;
+  dmaBatchInit(&batch, threadId);
+  DMAHandle handle = nullptr;
+  if (size) {
+    dmaBatchBroadcastToBuffer(&batch, buffNum, dstOffset, size, src);
+    handle = dmaBatchSubmit(&batch, buffNum, dbVal, /*waitForDone*/ false);
   }
   if (waitForDone)
     os_udma_wait();
+  return handle;
 }
 
-void broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
-                       const int8_t *src, int threadId, bool waitForDone) {
+DMAHandle broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
+                            const int8_t *src, int threadId, bool waitForDone) {
   const BufferDesc_t *buff = &_progBuffers[buffNum];
-  broadcastToBuffer(buffNum, dstOffset, size, src, &buff->waitDBVal, threadId,
-                    waitForDone);
+  return broadcastToBuffer(buffNum, dstOffset, size, src, &buff->waitDBVal,
+                           threadId, waitForDone);
+}
+
+static void arenasInit(Arena *arenas, uint8_t *base, uint32_t size) {
+  uint32_t numThreads = _progDesc->numThreads;
+  uint32_t threadSize = (size / numThreads) & ~(CACHE_LINE_SIZE - 1);
+  for (uint32_t t = 0; t < numThreads; t++) {
+    arenas[t].base = base + t * threadSize;
+    arenas[t].size = threadSize;
+    arenas[t].used = 0;
+  }
+}
+
+void _arenasInit() {
+  CoreInfo *ctx = getNSPContext();
+  arenasInit(ctx->vtcmArenas, ctx->baseVTCM + _progDesc->vtcmArenaOffset,
+             _progDesc->vtcmArenaSize);
+  arenasInit(ctx->l2tcmArenas, ctx->baseL2TCM + _progDesc->l2tcmArenaOffset,
+             _progDesc->l2tcmArenaSize);
+}
+
+Arena *getArena(memLoc_t location, int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  switch (location) {
+  case VTCM:
+    return &ctx->vtcmArenas[threadId];
+  case L2TCM:
+    return &ctx->l2tcmArenas[threadId];
+  default:
+    ERR_FATAL(ctx->errFuncPtr, "Arenas are in VTCM and L2TCM, not location %d",
+              location, 0, 0);
+    __builtin_unreachable();
+  }
+}
+
+void *arenaAlloc(Arena *arena, uint32_t size, uint32_t align) {
+  assert(align && !(align & (align - 1)) && "Alignment isn't a power of 2!");
+  uintptr_t addr = ((uintptr_t)arena->base + arena->used + align - 1) &
+                   ~(uintptr_t)(align - 1);
+  uint32_t end = (addr - (uintptr_t)arena->base) + size;
+  if (end > arena->size || end < size)
+    return nullptr;
+  arena->used = end;
+  return (void *)addr;
+}
+
+uint32_t arenaMark(const Arena *arena) { return arena->used; }
+
+void arenaRelease(Arena *arena, uint32_t mark) {
+  assert(mark <= arena->used && "Mark is past the end of the arena!");
+  arena->used = mark;
 }
 
 int inputBufferNum(int buffNum) {
@@ -6,6 +6,10 @@
 
 #include <stdint.h>
 
+namespace aic {
+struct DMADescriptor;
+} // namespace aic
+
 namespace qaic {
 
 enum usageType_t {
@@ -39,7 +43,8 @@ typedef struct {
   uint16_t buffMCID;     // MCID to use to send buffer data within QPC
   uint16_t nspMask;      // Which NSPs have this buffer allocated (when not DDR)
   usageType_t usage;     // Input/Output/Internal usage
-  uint32_t allowPartial; // If non-zero, buffer contains header
+  uint16_t allowPartial; // If non-zero, buffer contains header
+  uint16_t ioGroup;      // I/O group of an input or output buffer
 } BufferDesc_t;
 static_assert(sizeof(BufferDesc_t) == 40,
               "BufferDesc_t is expected to be 40 bytes!");
@@ -47,11 +52,137 @@ static_assert(sizeof(BufferDesc_t) == 40,
 const BufferDesc_t *getBufferInfo(int buffNum);
 void *getBufferAddr(int buffNum);
 uint32_t getBufferSize(int buffNum);
-void broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
-                       const int8_t *src, const uint32_t *dbVal, int threadId,
-                       bool waitForDone);
-void broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
-                       const int8_t *src, int threadId, bool WaitForDone);
+
+/***
+ * Identifies a submitted DMA transfer: the last descriptor of its chain. The
+ * UDMA engine completes a thread's descriptors in order, so once it is done
+ * the whole transfer is done. nullptr is a transfer that is already done.
+ *
+ * The descriptor goes back to the thread's descriptor ring when it is done, a
+ * handle must be waited on before the same thread issues another ring's worth
+ * of descriptors.
+ ***/
+typedef aic::DMADescriptor *DMAHandle;
+
+/***
+ * Returns true if the transfer is complete, without blocking
+ ***/
+bool isTransferDone(DMAHandle handle);
+
+/***
+ * Blocks until the transfer is complete, other transfers of the thread may
+ * still be in flight
+ ***/
+void waitForTransfer(DMAHandle handle, int threadId);
+
+DMAHandle broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
+                            const int8_t *src, const uint32_t *dbVal,
+                            int threadId, bool waitForDone);
+DMAHandle broadcastToBuffer(int buffNum, int32_t dstOffset, int size,
+                            const int8_t *src, int threadId, bool waitForDone);
+
+/***
+ * A list of DMA copies issued by one thread. The copies are chained into a
+ * single UDMA descriptor list that dmaBatchSubmit links to the DMA engine
+ * with one doorbell update after the last copy, instead of a link and a
+ * doorbell update per copy.
+ *
+ * The descriptors come from the thread's descriptor ring. A batch that
+ * outgrows the ring is linked to the engine early, the doorbell update still
+ * follows all of the copies.
+ *
+ * A thread must not issue other DMAs, e.g. broadcastToBuffer or the copies of
+ * a second batch, between dmaBatchInit and dmaBatchSubmit: they would take
+ * descriptors from the ring that the batch hasn't linked yet and wait for
+ * them until the hang timeout. Debug builds assert this.
+ ***/
+typedef struct {
+  aic::DMADescriptor *head;
+  aic::DMADescriptor *tail;
+  uint32_t numDescs;
+  int threadId;
+} DMABatch;
+
+/***
+ * Starts an empty batch for the given thread
+ ***/
+void dmaBatchInit(DMABatch *batch, int threadId);
+
+/***
+ * Adds a copy between DDR and this NSP's TCMs to the batch
+ ***/
+void dmaBatchCopy(DMABatch *batch, void *dst, const void *src, unsigned size);
+
+/***
+ * Adds a strided copy of numRows rows of rowSize bytes to the batch, e.g. a
+ * tile of a row-major tensor. Row i is copied from src + i * srcStride to
+ * dst + i * dstStride. Rows that are contiguous in both src and dst are
+ * merged into a single transfer.
+ ***/
+void dmaBatchCopy2D(DMABatch *batch, void *dst, const void *src,
+                    unsigned rowSize, unsigned numRows, unsigned dstStride,
+                    unsigned srcStride);
+
+/***
+ * Adds the copies broadcastToBuffer would do to the batch, without the
+ * doorbell update
+ ***/
+void dmaBatchBroadcastToBuffer(DMABatch *batch, int buffNum, int32_t dstOffset,
+                               int size, const int8_t *src);
+
+/***
+ * Links the batch to the DMA engine and resets it so it can be reused.
+ * Returns the handle of the transfer, which includes the doorbell update.
+ *
+ * - buffNum/dbVal select the doorbell that is updated once all copies are
+ *   done: the buffer's wait doorbell on every NSP the buffer is on. Without
+ *   them no doorbell is updated.
+ * - waitForDone can be set to block until the DMA engine is idle
+ ***/
+DMAHandle dmaBatchSubmit(DMABatch *batch, int buffNum, const uint32_t *dbVal,
+                         bool waitForDone);
+DMAHandle dmaBatchSubmit(DMABatch *batch, bool waitForDone);
+
+/***
+ * Arenas
+ *
+ * With vtcmArenaSize or l2tcmArenaSize in the program config, the VTCM or
+ * L2TCM after every buffer is an arena, split evenly between the threads of
+ * the NSP. Each thread allocates from its own part without locking, by
+ * bumping a pointer, and frees by rolling it back to a mark, so tile buffers
+ * can be reused between phases of a kernel.
+ ***/
+typedef struct {
+  uint8_t *base;
+  uint32_t size;
+  uint32_t used;
+} Arena;
+
+const uint32_t HVX_VECTOR_SIZE = 128;
+
+/***
+ * Returns the thread's part of the VTCM or L2TCM arena
+ ***/
+Arena *getArena(memLoc_t location, int threadId);
+
+/***
+ * Returns size bytes aligned to align (a power of 2, e.g. CACHE_LINE_SIZE
+ * or HVX_VECTOR_SIZE), or nullptr if the arena doesn't have them.
+ ***/
+void *arenaAlloc(Arena *arena, uint32_t size, uint32_t align);
+
+/***
+ * Returns a mark that arenaRelease can roll the arena back to
+ ***/
+uint32_t arenaMark(const Arena *arena);
+
+/***
+ * Frees everything allocated since the mark was taken
+ ***/
+void arenaRelease(Arena *arena, uint32_t mark);
+
+void _arenasInit();
+
 int inputBufferNum(int buffNum);
 int outputBufferNum(int buffNum);
 int internalBufferNum(int buffNum);
@@ -5,6 +5,8 @@
 
 #include "NSPContext.h"
 #include "SerializedProgramDesc.h"
+#include "libdev/libdev_assert.h"
+#include "libdev/libdev_defs.h"
 #include "libdev/os-inlines.h"
 #include "libdev/os.h"
 
@@ -24,95 +26,202 @@ void clearBufferValid(int buffNum) {
   os_doorbell_local_write4b(&dbs[waitDBNum], 0);
 }
 
-void waitForBuffer(int buffNum, uint32_t waitDBVal, bool clear) {
+void waitForBuffer(int buffNum, uint32_t waitDBVal, bool clear,
+                   int threadId) {
   const BufferDesc_t *buff = &_progBuffers[buffNum];
   uint16_t waitDBNum = buff->waitDBNum;
   uint32_t *dbs = (uint32_t *)getNSPContext()->baseL2TCM;
   os_doorbell_wait_eq((nsp_doorbell_t)&dbs[waitDBNum], waitDBVal,
-                      /*doTimeoutCheck*/ false,
-                      /*threadId*/ 0);
+                      /*doTimeoutCheck*/ false, threadId);
   if (clear) {
     os_doorbell_local_write4b(&dbs[waitDBNum], 0);
   }
 }
 
-void waitForBuffer(int buffNum, bool clear) {
+void waitForBuffer(int buffNum, bool clear, int threadId) {
   const BufferDesc_t *buff = &_progBuffers[buffNum];
-  waitForBuffer(buffNum, buff->waitDBVal, clear);
+  waitForBuffer(buffNum, buff->waitDBVal, clear, threadId);
 }
 
-void waitForAllInputsReady(bool clear) {
-  const uint16_t numBuffs = _progDesc->numInputBuffs;
-  const uint16_t numInputs = _progDesc->numInputBuffs;
-  uint16_t numInputsReady = 0;
+void waitForBuffer(int buffNum, bool clear) {
+  waitForBuffer(buffNum, clear, /*threadId*/ -1);
+}
 
-  for (int buffNum = 0; (numInputsReady < numInputs) && (buffNum < numBuffs);
-       buffNum++) {
-    const BufferDesc_t *buff = &_progBuffers[buffNum];
-    if (buff->usage == USAGE_INPUT) {
-      waitForBuffer(buffNum, clear);
-      numInputsReady++;
+int waitForAnyBuffer(const int *buffNums, int n, bool clear, int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  if (n < 1 || n > MAX_WAIT_ANY_BUFFERS) {
+    ERR_FATAL(ctx->errFuncPtr,
+              "waitForAnyBuffer called with %d buffers, supported: 1-%d", n,
+              MAX_WAIT_ANY_BUFFERS, 0);
+    __builtin_unreachable();
+  }
+
+  nsp_doorbell_t waitDBs[MAX_WAIT_ANY_BUFFERS];
+  uint32_t waitDBVals[MAX_WAIT_ANY_BUFFERS];
+  uint32_t *dbs = (uint32_t *)ctx->baseL2TCM;
+  for (int i = 0; i < n; i++) {
+    if (buffNums[i] < 0 || buffNums[i] >= _progDesc->numBuffs) {
+      ERR_FATAL(ctx->errFuncPtr,
+                "waitForAnyBuffer called with buffer %d, the program has %d",
+                buffNums[i], _progDesc->numBuffs, 0);
+      __builtin_unreachable();
     }
+    const BufferDesc_t *buff = &_progBuffers[buffNums[i]];
+    waitDBs[i] = (nsp_doorbell_t)&dbs[buff->waitDBNum];
+    waitDBVals[i] = buff->waitDBVal;
   }
-  if (numInputsReady != numInputs) {
-    ERR_FATAL(getNSPContext()->errFuncPtr,
-              "Only found %d ready inputs, but expected to find %d",
-              numInputsReady, numInputs, 0);
-    __builtin_unreachable();
+
+  auto cmpEq = [](uint32_t dbval, uint32_t waitval) {
+    return dbval == waitval;
+  };
+  int ready = os_doorbell_wait_any</*isLocal=*/false,
+                                   /*isDMAPossiblyActive=*/false>(
+      waitDBs, waitDBVals, n, cmpEq, /*doTimeoutCheck*/ false, threadId);
+  if (clear) {
+    os_doorbell_local_write4b(waitDBs[ready], 0);
   }
+  return buffNums[ready];
+}
+
+static void clearIODoorbells(const IODoorbell_t *ioDBs, int numDBs) {
+  uint32_t *dbs = (uint32_t *)getNSPContext()->baseL2TCM;
+  if (numDBs == 0)
+    return;
+  if (_progDesc->ioDoorbellFlags & IO_DOORBELLS_CONTIGUOUS) {
+    os_doorbell_local_clear(&dbs[ioDBs[0].dbNum], numDBs);
+  } else {
+    for (int i = 0; i < numDBs; i++)
+      os_doorbell_local_write4b(&dbs[ioDBs[i].dbNum], 0);
+  }
+}
+
+// Waits for each of the I/O doorbells, and optionally clears them once they
+// have all been rung
+static void waitForIODoorbells(const IODoorbell_t *ioDBs, int numDBs,
+                               bool clear, int threadId) {
+  uint32_t *dbs = (uint32_t *)getNSPContext()->baseL2TCM;
+  for (int i = 0; i < numDBs; i++) {
+    os_doorbell_wait_eq((nsp_doorbell_t)&dbs[ioDBs[i].dbNum], ioDBs[i].dbVal,
+                        /*doTimeoutCheck*/ false, threadId);
+  }
+  if (clear)
+    clearIODoorbells(ioDBs, numDBs);
+}
+
+void waitForAllInputsReady(bool clear, int threadId) {
+  waitForIODoorbells(_progIODoorbells, _progDesc->numInputBuffs, clear,
+                     threadId);
+}
+
+void waitForAllOutputsReady(bool clear, int threadId) {
+  waitForIODoorbells(_progIODoorbells + _progDesc->numInputBuffs,
+                     _progDesc->numOutputBuffs, clear, threadId);
+}
+
+void waitForInputsReady(int group, bool clear, int threadId) {
+  const IOGroupDesc_t *ioGroup = &_progIOGroups[group];
+  waitForIODoorbells(&_progIODoorbells[ioGroup->firstInputDB],
+                     ioGroup->numInputDBs, clear, threadId);
+}
+
+void waitForOutputsReady(int group, bool clear, int threadId) {
+  const IOGroupDesc_t *ioGroup = &_progIOGroups[group];
+  waitForIODoorbells(&_progIODoorbells[ioGroup->firstOutputDB],
+                     ioGroup->numOutputDBs, clear, threadId);
+}
+
+void waitForAllInputsReady(bool clear) {
+  waitForAllInputsReady(clear, /*threadId*/ -1);
 }
 
 void waitForAllOutputsReady(bool clear) {
-  const uint16_t numBuffs = _progDesc->numBuffs;
-  const uint16_t numOutputs = _progDesc->numOutputBuffs;
-  uint16_t numOutputsReady = 0;
+  waitForAllOutputsReady(clear, /*threadId*/ -1);
+}
 
-  for (int buffNum = 0; (numOutputsReady < numOutputs) && (buffNum < numBuffs);
-       buffNum++) {
-    const BufferDesc_t *buff = &_progBuffers[buffNum];
-    if (buff->usage == USAGE_OUTPUT) {
-      waitForBuffer(buffNum, clear);
-      numOutputsReady++;
+void waitForInputsReady(int group, bool clear) {
+  waitForInputsReady(group, clear, /*threadId*/ -1);
+}
+
+void waitForOutputsReady(int group, bool clear) {
+  waitForOutputsReady(group, clear, /*threadId*/ -1);
+}
+
+// Signals the host that this NSP is ready for the group's inputs
+static void signalReadyForInputs(int group) {
+  CoreInfo *ctx = getNSPContext();
+  const IOGroupDesc_t *ioGroup = &_progIOGroups[group];
+  uint16_t inputSem = ioGroup->inputSem;
+
+  hostsem_t semAddr = (hostsem_t *)ctx->semInfo[inputSem].semAddress;
+  auto fwSemIdx = ctx->semInfo[inputSem].semNum;
+
+  // Clear the input doorbells before doing the host increment
+  clearIODoorbells(&_progIODoorbells[ioGroup->firstInputDB],
+                   ioGroup->numInputDBs);
+
+  // Make sure all reads are done before doing semaphore
+  os_release_allthreads(&ctx->inputSemaphoreReleaseLoc);
+  os_load_acquire(&ctx->inputSemaphoreReleaseLoc);
+
+  os_hostsem_inc(semAddr, static_cast<uint32_t>(fwSemIdx));
+}
+
+// Signals the host that this NSP is done writing the group's outputs
+static void signalOutputsDone(int group) {
+  CoreInfo *ctx = getNSPContext();
+  const IOGroupDesc_t *ioGroup = &_progIOGroups[group];
+  uint16_t outputSem = ioGroup->outputSem;
+
+  hostsem_t semAddr = (hostsem_t *)ctx->semInfo[outputSem].semAddress;
+  int fwSemIdx = ctx->semInfo[outputSem].semNum;
+
+  // Clear the output doorbells before doing the host decrement
+  clearIODoorbells(&_progIODoorbells[ioGroup->firstOutputDB],
+                   ioGroup->numOutputDBs);
+
+  os_global_memsync();
+  os_hostsem_dec(semAddr, fwSemIdx);
+}
+
+void readyForInputs(int group, bool waitForArrival, bool clear) {
+  CoreInfo *ctx = getNSPContext();
+  assert(group < _progDesc->numIOGroups);
+  if ((0x1 << ctx->virtualNSPId) & _progIOGroups[group].hasInputsMask) {
+    signalReadyForInputs(group);
+    if (waitForArrival) {
+      waitForInputsReady(group, clear);
     }
+  } else {
+    NN_LOG(ctx->logFuncPtr, NNC_LOG_MASK_WARN,
+           "NSP %d called readyForInputs, but doesn't have inputs in group %d",
+           ctx->virtualNSPId, group);
   }
-  if (numOutputsReady != numOutputs) {
-    ERR_FATAL(getNSPContext()->errFuncPtr,
-              "Only found %d ready outputs, but expected to find %d",
-              numOutputsReady, numOutputs, 0);
-    __builtin_unreachable();
+}
+
+void sendOutputs(int group, bool waitForArrival, bool clear) {
+  CoreInfo *ctx = getNSPContext();
+  assert(group < _progDesc->numIOGroups);
+  if ((0x1 << ctx->virtualNSPId) & _progIOGroups[group].hasOutputsMask) {
+    signalOutputsDone(group);
+    if (waitForArrival) {
+      waitForOutputsReady(group, clear);
+    }
+  } else {
+    NN_LOG(ctx->logFuncPtr, NNC_LOG_MASK_WARN,
+           "NSP %d called sendOutputs, but doesn't have outputs in group %d",
+           ctx->virtualNSPId, group);
   }
 }
 
 void readyForAllInputs(bool waitForArrival, bool clear) {
   // Input from host
   CoreInfo *ctx = getNSPContext();
-  if ((0x1 << ctx->virtualNSPId) & _progDesc->hasInputsMask) {
-    uint16_t inputSem = _progDesc->inputSem;
-
-    hostsem_t semAddr =
-        (hostsem_t *)getNSPContext()->semInfo[inputSem].semAddress;
-    auto fwSemIdx = getNSPContext()->semInfo[inputSem].semNum;
-
-    // Clear the input doorbells before doing the host increment
-    const uint16_t numBuffs = _progDesc->numBuffs;
-    const uint16_t numInputs = _progDesc->numInputBuffs;
-    uint32_t *dbs = (uint32_t *)getNSPContext()->baseL2TCM;
-    uint16_t numInputsCleared = 0;
-    for (int buffNum = 0;
-         (numInputsCleared < numInputs) && (buffNum < numBuffs); buffNum++) {
-      const BufferDesc_t *buff = &_progBuffers[buffNum];
-      if (buff->usage == USAGE_INPUT) {
-        uint16_t waitDBNum = buff->waitDBNum;
-        os_doorbell_local_write4b(&dbs[waitDBNum], 0);
-        numInputsCleared++;
-      }
+  const uint32_t nspBit = 0x1 << ctx->virtualNSPId;
+  if (nspBit & _progDesc->hasInputsMask) {
+    for (int group = 0; group < _progDesc->numIOGroups; group++) {
+      if (nspBit & _progIOGroups[group].hasInputsMask)
+        signalReadyForInputs(group);
     }
-
-    // Make sure all reads are done before doing semaphore
-    os_release_allthreads(&ctx->inputSemaphoreReleaseLoc);
-    os_load_acquire(&ctx->inputSemaphoreReleaseLoc);
-
-    os_hostsem_inc(semAddr, static_cast<uint32_t>(fwSemIdx));
     if (waitForArrival) {
       waitForAllInputsReady(clear);
     }
@@ -126,30 +235,12 @@ void readyForAllInputs(bool waitForArrival, bool clear) {
 void sendAllOutputs(bool waitForArrival, bool clear) {
   // Output to host
   CoreInfo *ctx = getNSPContext();
-  if ((0x1 << ctx->virtualNSPId) & _progDesc->hasInputsMask) {
-    uint16_t outputSem = _progDesc->outputSem;
-
-    hostsem_t semAddr =
-        (hostsem_t *)getNSPContext()->semInfo[outputSem].semAddress;
-    int fwSemIdx = getNSPContext()->semInfo[outputSem].semNum;
-
-    // Clear the output doorbells before doing the host decrement
-    const uint16_t numBuffs = _progDesc->numBuffs;
-    const uint16_t numOutputs = _progDesc->numOutputBuffs;
-    uint32_t *dbs = (uint32_t *)getNSPContext()->baseL2TCM;
-    uint16_t numOutputsCleared = 0;
-    for (int buffNum = 0;
-         (numOutputsCleared < numOutputs) && (buffNum < numBuffs); buffNum++) {
-      const BufferDesc_t *buff = &_progBuffers[buffNum];
-      if (buff->usage == USAGE_OUTPUT) {
-        uint16_t waitDBNum = buff->waitDBNum;
-        os_doorbell_local_write4b(&dbs[waitDBNum], 0);
-        numOutputsCleared++;
-      }
+  const uint32_t nspBit = 0x1 << ctx->virtualNSPId;
+  if (nspBit & _progDesc->hasOutputsMask) {
+    for (int group = 0; group < _progDesc->numIOGroups; group++) {
+      if (nspBit & _progIOGroups[group].hasOutputsMask)
+        signalOutputsDone(group);
     }
-
-    os_global_memsync();
-    os_hostsem_dec(semAddr, fwSemIdx);
     if (waitForArrival) {
       waitForAllOutputsReady(clear);
     }
@@ -160,6 +251,499 @@ void sendAllOutputs(bool waitForArrival, bool clear) {
   }
 }
 
+int inputSlotBufferNum(int buffNum, int slot) {
+  assert(buffNum < _progDesc->numInputBuffs);
+  assert(slot < _progDesc->numInputSlots);
+  return _progDesc->inputSlotsBuffNum + slot * _progDesc->numInputBuffs +
+         buffNum;
+}
+
+int acquireNextInputSlot(int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  const uint16_t numSlots = _progDesc->numInputSlots;
+  if (numSlots < 2) {
+    ERR_FATAL(ctx->errFuncPtr,
+              "acquireNextInputSlot needs numInputSlots > 1, but found %d",
+              numSlots, 0, 0);
+    __builtin_unreachable();
+  }
+
+  int slot = ctx->numInputSlotsAcquired % numSlots;
+  // The first call asks the host for the first inputs
+  if (ctx->numInputSlotsAcquired++ == 0)
+    readyForAllInputs(/*waitForArrival*/ false, /*clear*/ false);
+
+  // Wait for the slot to be released, then for the inputs to arrive
+  const uint16_t numInputs = _progDesc->numInputBuffs;
+  const uint32_t nspBit = 0x1 << ctx->virtualNSPId;
+  for (int buffNum = 0; buffNum < numInputs; buffNum++) {
+    int slotBuffNum = inputSlotBufferNum(buffNum, slot);
+    if (_progBuffers[slotBuffNum].nspMask & nspBit)
+      waitForBuffer(slotBuffNum, /*waitDBVal*/ 0, /*clear*/ false, threadId);
+  }
+  waitForAllInputsReady(/*clear*/ true, threadId);
+
+  DMABatch batch;
+  dmaBatchInit(&batch, threadId);
+  for (int buffNum = 0; buffNum < numInputs; buffNum++) {
+    const BufferDesc_t *buff = &_progBuffers[buffNum];
+    if (buff->nspMask & nspBit)
+      dmaBatchCopy(&batch, getBufferAddr(inputSlotBufferNum(buffNum, slot)),
+                   getBufferAddr(buffNum), buff->size);
+  }
+  waitForTransfer(dmaBatchSubmit(&batch, /*waitForDone*/ false), threadId);
+
+  // The input buffers are free again
+  readyForAllInputs(/*waitForArrival*/ false, /*clear*/ false);
+
+  // Mark the slot as in use
+  uint32_t *dbs = (uint32_t *)ctx->baseL2TCM;
+  for (int buffNum = 0; buffNum < numInputs; buffNum++) {
+    const BufferDesc_t *buff = &_progBuffers[inputSlotBufferNum(buffNum, slot)];
+    if (buff->nspMask & nspBit)
+      os_doorbell_local_write4b(&dbs[buff->waitDBNum], buff->waitDBVal);
+  }
+  return slot;
+}
+
+void releaseInputSlot(int slot) {
+  const uint32_t nspBit = 0x1 << getNSPContext()->virtualNSPId;
+  for (int buffNum = 0; buffNum < _progDesc->numInputBuffs; buffNum++) {
+    int slotBuffNum = inputSlotBufferNum(buffNum, slot);
+    if (_progBuffers[slotBuffNum].nspMask & nspBit)
+      clearBufferValid(slotBuffNum);
+  }
+}
+
+// Central barrier. The last thread to arrive resets the count and the
+// optional work counter, then starts the next generation, which releases the
+// waiting threads.
+static void threadBarrier(uint32_t *workCounter) {
+  CoreInfo *ctx = getNSPContext();
+  uint32_t generation = os_load_acquire(&ctx->barrierGeneration);
+
+  // Make this thread's writes, including HVX stores, visible before arriving
+  os_release_allthreads(&ctx->barrierGeneration);
+  if (__atomic_add_fetch(&ctx->barrierCount, 1, __ATOMIC_ACQ_REL) ==
+      _progDesc->numThreads) {
+    hexagon_atomic_store_nolock4b(&ctx->barrierCount, 0);
+    if (workCounter)
+      hexagon_atomic_store_nolock4b(workCounter, 0);
+    os_release_allthreads(&ctx->barrierGeneration);
+    hexagon_atomic_store_nolock4b(&ctx->barrierGeneration, generation + 1);
+  } else {
+    while (os_load_acquire(&ctx->barrierGeneration) == generation)
+      os_thread_nanosleep(1, os_get_nanosleep_ptr());
+  }
+}
+
+void threadBarrier() { threadBarrier(nullptr); }
+
+uint32_t atomicFetchAdd(uint32_t *counter, uint32_t n) {
+  return __atomic_fetch_add(counter, n, __ATOMIC_ACQ_REL);
+}
+
+uint32_t *_parallelForBegin(int chunk) {
+  assert(chunk > 0 && "parallelFor needs a chunk of at least 1");
+  return &getNSPContext()->parallelForNext;
+}
+
+// Every thread is done taking tiles once all have arrived, so the counter
+// can be reset for the next parallelFor
+void _parallelForEnd() { threadBarrier(&getNSPContext()->parallelForNext); }
+
+typedef struct {
+  TaskFn fn;
+  void *arg;
+} Task;
+
+// Chase-Lev deque, followed by its tasks. The owner pushes and pops at the
+// bottom, other threads steal from the top.
+typedef struct {
+  uint32_t top;
+  uint32_t bottom;
+  uint8_t padding[CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+} TaskDeque;
+static_assert(sizeof(TaskDeque) == CACHE_LINE_SIZE,
+              "TaskDeque is expected to be a cache line");
+
+static TaskDeque *getTaskDeque(int threadId, int affinity) {
+  const BufferDesc_t *buff = &_progBuffers[_progDesc->taskDequesBuffNum];
+  uint32_t dequeNum = threadId * NUM_TASK_AFFINITIES + affinity;
+  return (TaskDeque *)&getNSPContext()
+      ->baseL2TCM[buff->offset + dequeNum * _progDesc->taskDequeSize];
+}
+
+// A power of 2, so the free-running indices wrap with a mask
+static uint32_t taskDequeCapacity() {
+  return (_progDesc->taskDequeSize - sizeof(TaskDeque)) / sizeof(Task);
+}
+
+static Task *getTask(TaskDeque *deque, uint32_t index) {
+  return &((Task *)(deque + 1))[index & (taskDequeCapacity() - 1)];
+}
+
+static bool isHMXThread(int threadId) {
+  return threadId >= _progDesc->numHvxThreads;
+}
+
+void _taskDequesInit() {
+  if (_progDesc->taskDequeSize == 0)
+    return;
+  for (uint32_t t = 0; t < _progDesc->numThreads; t++) {
+    for (int affinity = 0; affinity < NUM_TASK_AFFINITIES; affinity++) {
+      TaskDeque *deque = getTaskDeque(t, affinity);
+      deque->top = 0;
+      deque->bottom = 0;
+    }
+  }
+}
+
+bool spawnTask(int threadId, TaskFn fn, void *arg, TaskAffinity affinity) {
+  CoreInfo *ctx = getNSPContext();
+  if (_progDesc->taskDequeSize == 0) {
+    ERR_FATAL(ctx->errFuncPtr, "spawnTask needs taskDequeSize > 0", 0, 0, 0);
+    __builtin_unreachable();
+  }
+  if ((affinity == TASK_HVX && _progDesc->numHvxThreads == 0) ||
+      (affinity == TASK_HMX &&
+       _progDesc->numHvxThreads == _progDesc->numThreads))
+    return false;
+
+  TaskDeque *deque = getTaskDeque(threadId, affinity);
+  uint32_t bottom = deque->bottom;
+  uint32_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  if (bottom - top >= taskDequeCapacity())
+    return false;
+
+  Task *task = getTask(deque, bottom);
+  task->fn = fn;
+  task->arg = arg;
+  // Count the task before it can be stolen, so runTasks can't see the count
+  // drop to 0 while it is queued
+  __atomic_add_fetch(&ctx->tasksPending, 1, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool popTask(TaskDeque *deque, Task *task) {
+  uint32_t bottom = deque->bottom - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_SEQ_CST);
+  uint32_t top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+  if ((int32_t)(bottom - top) < 0) {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  *task = *getTask(deque, bottom);
+  if (bottom != top)
+    return true;
+
+  // Last task, thieves may be taking it too
+  bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  return won;
+}
+
+static bool stealTask(TaskDeque *deque, Task *task) {
+  uint32_t top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+  uint32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+  if ((int32_t)(bottom - top) <= 0)
+    return false;
+  *task = *getTask(deque, top);
+  return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// Pops from this thread's deques, then steals from the other threads', only
+// taking tasks this thread has the affinity for
+static bool findTask(int threadId, Task *task) {
+  const int affinities[] = {isHMXThread(threadId) ? TASK_HMX : TASK_HVX,
+                            TASK_ANY};
+  for (int affinity : affinities) {
+    if (popTask(getTaskDeque(threadId, affinity), task))
+      return true;
+  }
+  int numThreads = _progDesc->numThreads;
+  for (int i = 1; i < numThreads; i++) {
+    int victim = (threadId + i) % numThreads;
+    for (int affinity : affinities) {
+      if (stealTask(getTaskDeque(victim, affinity), task))
+        return true;
+    }
+  }
+  return false;
+}
+
+void runTasks(int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  // Make the tasks spawned before runTasks visible to every thread
+  threadBarrier();
+  Task task;
+  while (__atomic_load_n(&ctx->tasksPending, __ATOMIC_ACQUIRE) != 0) {
+    if (findTask(threadId, &task)) {
+      task.fn(task.arg);
+      __atomic_sub_fetch(&ctx->tasksPending, 1, __ATOMIC_ACQ_REL);
+    } else {
+      os_thread_nanosleep(1, os_get_nanosleep_ptr());
+    }
+  }
+  // Make the writes of every task visible to every thread
+  threadBarrier();
+}
+
+// Checks this NSP takes part in the collectives
+static void checkNSPCollective() {
+  CoreInfo *ctx = getNSPContext();
+  if (ctx->virtualNSPId >= _progDesc->numCollectiveNSPs) {
+    ERR_FATAL(ctx->errFuncPtr,
+              "NSP collectives need nspCollectives, NSP%d found %d "
+              "collective NSPs",
+              ctx->virtualNSPId, _progDesc->numCollectiveNSPs, 0);
+    __builtin_unreachable();
+  }
+}
+
+// Sets this NSP's doorbell of the collective to *generation on every NSP,
+// once the DMAs in the batch are done
+static DMAHandle signalNSPArrival(DMABatch *batch, uint16_t firstDB,
+                                  const uint32_t *generation) {
+  return libdev_dma_batch_submit(
+      batch, generation, /*dbOnlyCheckedLocally*/ false, /*updateDBs*/ true,
+      /*doRelease*/ true, firstDB + getNSPContext()->virtualNSPId,
+      /*mcId*/ 0);
+}
+
+// Blocks until every NSP's doorbell of the collective has reached the
+// generation. Doorbell values only increase, as an NSP may already be in
+// the next generation.
+static void waitForNSPArrivals(uint16_t firstDB, uint32_t generation,
+                               int threadId) {
+  uint32_t *dbs = (uint32_t *)getNSPContext()->baseL2TCM;
+  auto cmpReached = [](uint32_t dbval, uint32_t waitval) {
+    return (int32_t)(dbval - waitval) >= 0;
+  };
+  traceBegin(TRACE_NSP_WAIT, firstDB, threadId);
+  for (int nsp = 0; nsp < _progDesc->numCollectiveNSPs; nsp++) {
+    os_doorbell_wait</*isLocal=*/false, /*isDMAPossiblyActive=*/true>(
+        (nsp_doorbell_t)&dbs[firstDB + nsp], generation, cmpReached,
+        /*doTimeoutCheck*/ false, threadId);
+  }
+  traceEnd(TRACE_NSP_WAIT, firstDB, threadId);
+}
+
+void nspBarrier(int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  checkNSPCollective();
+  uint32_t generation = ++ctx->nspBarrierGeneration;
+
+  DMABatch batch;
+  dmaBatchInit(&batch, threadId);
+  DMAHandle handle =
+      signalNSPArrival(&batch, _progDesc->nspBarrierDB,
+                       &ctx->nspBarrierGeneration);
+  waitForNSPArrivals(_progDesc->nspBarrierDB, generation, threadId);
+  // The doorbell DMAs read the generation when they run, so they must be
+  // done before the next nspBarrier changes it
+  waitForTransfer(handle, threadId);
+}
+
+template <typename T> static T reduce(T a, T b, ReduceOp op) {
+  switch (op) {
+  case REDUCE_MIN:
+    return (b < a) ? b : a;
+  case REDUCE_MAX:
+    return (b > a) ? b : a;
+  default:
+    return a + b;
+  }
+}
+
+template <typename T>
+static void allReduceImpl(T *data, int count, ReduceOp op, int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  checkNSPCollective();
+  uint32_t size = count * sizeof(T);
+  if (size > _progDesc->allReduceSize) {
+    ERR_FATAL(ctx->errFuncPtr,
+              "allReduce of %d bytes, allReduceSize of the program is %d",
+              size, _progDesc->allReduceSize, 0);
+    __builtin_unreachable();
+  }
+  uint32_t generation = ++ctx->allReduceGeneration;
+  int numNSPs = _progDesc->numCollectiveNSPs;
+  int nspId = ctx->virtualNSPId;
+
+  // Even and odd generations use different halves of the buffer
+  uint32_t slotsOffset =
+      (generation & 1) * numNSPs * _progDesc->allReduceSize;
+  DMABatch batch;
+  dmaBatchInit(&batch, threadId);
+  dmaBatchBroadcastToBuffer(&batch, _progDesc->allReduceBuffNum,
+                            slotsOffset + nspId * _progDesc->allReduceSize,
+                            size, (const int8_t *)data);
+  DMAHandle handle = signalNSPArrival(&batch, _progDesc->allReduceDB,
+                                      &ctx->allReduceGeneration);
+  // This also waits for our own doorbell, which follows the DMA that reads
+  // data, so data can be overwritten after
+  waitForNSPArrivals(_progDesc->allReduceDB, generation, threadId);
+
+  const uint8_t *slots =
+      (const uint8_t *)getBufferAddr(_progDesc->allReduceBuffNum) +
+      slotsOffset;
+  for (int i = 0; i < count; i++) {
+    T acc = (nspId == 0) ? data[i] : ((const T *)slots)[i];
+    for (int nsp = 1; nsp < numNSPs; nsp++) {
+      T val = (nsp == nspId)
+                  ? data[i]
+                  : ((const T *)(slots + nsp * _progDesc->allReduceSize))[i];
+      acc = reduce(acc, val, op);
+    }
+    data[i] = acc;
+  }
+  waitForTransfer(handle, threadId);
+}
+
+void allReduce(float *data, int count, ReduceOp op, int threadId) {
+  allReduceImpl(data, count, op, threadId);
+}
+
+void allReduce(int32_t *data, int count, ReduceOp op, int threadId) {
+  allReduceImpl(data, count, op, threadId);
+}
+
+void pmuConfigure(const uint8_t *events, int numEvents) {
+  CoreInfo *ctx = getNSPContext();
+  assert(numEvents >= 0 && numEvents <= MAX_PMU_COUNTERS &&
+         "Too many PMU events!");
+  // PMUEVTCFG holds the events of counters 0-3, PMUEVTCFG1 of counters 4-7
+  uint32_t evtCfg[2] = {0, 0};
+  for (int i = 0; i < numEvents; i++) {
+    ctx->pmuEvents[i] = events[i];
+    evtCfg[i / 4] |= (uint32_t)events[i] << (8 * (i % 4));
+  }
+  ctx->numPMUEvents = numEvents;
+  if (ctx->setPMUReg) {
+    ctx->setPMUReg(NNC_PMUEVTCFG, evtCfg[0]);
+    ctx->setPMUReg(NNC_PMUEVTCFG1, evtCfg[1]);
+  }
+}
+
+static void readPMUCounters(CoreInfo *ctx, uint32_t *counts) {
+  if (ctx->readPMUCnt) {
+    ctx->readPMUCnt(counts);
+    return;
+  }
+  for (int i = 0; i < MAX_PMU_COUNTERS; i++)
+    counts[i] = 0;
+}
+
+void pmuRegionBegin(int region, int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  assert(region >= 0 && region < MAX_PMU_REGIONS && "Invalid PMU region!");
+  PMURegion *r = &ctx->pmuRegions[threadId][region];
+  readPMUCounters(ctx, r->startCounts);
+  r->startPcycles = os_get_pcycles();
+}
+
+void pmuRegionEnd(int region, int threadId) {
+  uint64_t pcycles = os_get_pcycles();
+  CoreInfo *ctx = getNSPContext();
+  assert(region >= 0 && region < MAX_PMU_REGIONS && "Invalid PMU region!");
+  PMURegion *r = &ctx->pmuRegions[threadId][region];
+  uint32_t counts[MAX_PMU_COUNTERS];
+  readPMUCounters(ctx, counts);
+
+  r->pcycles += pcycles - r->startPcycles;
+  // The counters are 32 bits, and wrap
+  for (int i = 0; i < ctx->numPMUEvents; i++)
+    r->counts[i] += counts[i] - r->startCounts[i];
+  r->numCalls++;
+}
+
+void _pmuLogRegions(int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  for (int region = 0; region < MAX_PMU_REGIONS; region++) {
+    PMURegion *r = &ctx->pmuRegions[threadId][region];
+    if (r->numCalls == 0)
+      continue;
+    // The log takes 32-bit values, so 64-bit counts are logged in hex
+    NN_LOG(ctx->logFuncPtr, NNC_LOG_MASK_INFO,
+           "PMU region %d thread %d: %d calls, pcycles 0x%x%08x", region,
+           threadId, r->numCalls, (uint32_t)(r->pcycles >> 32),
+           (uint32_t)r->pcycles);
+    for (int i = 0; i < ctx->numPMUEvents; i++)
+      NN_LOG(ctx->logFuncPtr, NNC_LOG_MASK_INFO,
+             "PMU region %d thread %d: event 0x%x count 0x%x%08x", region,
+             threadId, ctx->pmuEvents[i], (uint32_t)(r->counts[i] >> 32),
+             (uint32_t)r->counts[i]);
+  }
+}
+
+DDRBWSnapshot ddrBWSnapshot() {
+  CoreInfo *ctx = getNSPContext();
+  DDRBWSnapshot snapshot = {os_get_system_timestamp(), 0, 0};
+  if (ctx->ddrBWMonRegs) {
+    snapshot.readBytes = ctx->ddrBWMonRegs->readBytes;
+    snapshot.writeBytes = ctx->ddrBWMonRegs->writeBytes;
+  }
+  return snapshot;
+}
+
+// Bytes per UTIMER tick to MB/s
+static uint32_t toMBps(uint64_t bytes, uint64_t ticks) {
+  if (ticks == 0)
+    return 0;
+  return bytes * UTimerFreqMS / (ticks * 1000);
+}
+
+uint32_t ddrBWMBps(const DDRBWSnapshot &start, const DDRBWSnapshot &end) {
+  return toMBps(end.readBytes - start.readBytes + end.writeBytes -
+                    start.writeBytes,
+                end.timestamp - start.timestamp);
+}
+
+void ddrBWRegionBegin(int region, int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  assert(region >= 0 && region < MAX_DDR_BW_REGIONS &&
+         "Invalid DDR bandwidth region!");
+  ctx->ddrBWRegions[threadId][region].start = ddrBWSnapshot();
+}
+
+void ddrBWRegionEnd(int region, int threadId) {
+  DDRBWSnapshot end = ddrBWSnapshot();
+  CoreInfo *ctx = getNSPContext();
+  assert(region >= 0 && region < MAX_DDR_BW_REGIONS &&
+         "Invalid DDR bandwidth region!");
+  DDRBWRegion *r = &ctx->ddrBWRegions[threadId][region];
+  r->ticks += end.timestamp - r->start.timestamp;
+  r->readBytes += end.readBytes - r->start.readBytes;
+  r->writeBytes += end.writeBytes - r->start.writeBytes;
+  r->numCalls++;
+  traceInstant(TRACE_DDR_BW, ddrBWMBps(r->start, end), threadId);
+}
+
+void _ddrBWLogRegions(int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  for (int region = 0; region < MAX_DDR_BW_REGIONS; region++) {
+    DDRBWRegion *r = &ctx->ddrBWRegions[threadId][region];
+    if (r->numCalls == 0)
+      continue;
+    uint32_t mbps = toMBps(r->readBytes + r->writeBytes, r->ticks);
+    NN_LOG(ctx->logFuncPtr, NNC_LOG_MASK_INFO,
+           "DDR BW region %d thread %d: %d calls, ticks 0x%x%08x, "
+           "%d.%03d GB/s",
+           region, threadId, r->numCalls, (uint32_t)(r->ticks >> 32),
+           (uint32_t)r->ticks, mbps / 1000, mbps % 1000);
+    NN_LOG(ctx->logFuncPtr, NNC_LOG_MASK_INFO,
+           "DDR BW region %d thread %d: read 0x%x%08x bytes, written "
+           "0x%x%08x bytes",
+           region, threadId, (uint32_t)(r->readBytes >> 32),
+           (uint32_t)r->readBytes, (uint32_t)(r->writeBytes >> 32),
+           (uint32_t)r->writeBytes);
+  }
+}
+
 void logActivate(uint8_t virtualThreadId) {
   CoreInfo *ctx = getNSPContext();
 
@@ -5,10 +5,15 @@
 #define _QAIC_COMPUTEAPI_H_
 
 #include "BufferDesc.h"
+#include "Trace.h"
 #include <stdint.h>
 
 namespace qaic {
 // I/O
+//
+// The waits have overloads that take the calling thread as threadId, for
+// the doorbell trace events and wait stats of that thread. Waits without a
+// threadId aren't traced or counted.
 
 /***
  * Returns true if the value for the buffer indicates it is valid
@@ -29,6 +34,7 @@ void clearBufferValid(int buffNum);
  * by the host, and can be read by the NSP.
  ***/
 void waitForAllInputsReady(bool clear);
+void waitForAllInputsReady(bool clear, int threadId);
 
 /***
  * Blocks until all output buffers have been marked as ready,
@@ -39,6 +45,7 @@ void waitForAllInputsReady(bool clear);
  * it.
  ***/
 void waitForAllOutputsReady(bool clear);
+void waitForAllOutputsReady(bool clear, int threadId);
 
 /***
  * Blocks until the specified buffer has been marked as ready,
@@ -47,6 +54,18 @@ void waitForAllOutputsReady(bool clear);
  * Ready means it is safe for the NSP to read and write the buffer.
  ***/
 void waitForBuffer(int buffNum, bool clear);
+void waitForBuffer(int buffNum, bool clear, int threadId);
+
+/***
+ * Blocks until any of the n buffers in buffNums has been marked as ready,
+ * and optionally clears the ready indication of that buffer. Returns its
+ * buffer number, the earliest in buffNums if several are ready.
+ *
+ * - At most MAX_WAIT_ANY_BUFFERS buffers can be waited on at once
+ * - threadId is the calling thread, or -1 to not trace or count the wait
+ ***/
+const int MAX_WAIT_ANY_BUFFERS = 64;
+int waitForAnyBuffer(const int *buffNums, int n, bool clear, int threadId);
 
 /***
  * Signals that this NSP is not reading from the input buffers,
@@ -76,6 +95,234 @@ void readyForAllInputs(bool waitForArrival, bool clear);
  ***/
 void sendAllOutputs(bool waitForArrival, bool clear);
 
+/***
+ * I/O groups
+ *
+ * Inputs and outputs are split into I/O groups by the ioGroup of their
+ * IODescription. Each group has its own handshake with the host, so the
+ * inputs and outputs of one group are transferred without waiting for the
+ * NSPs that use the other groups. readyForAllInputs and sendAllOutputs
+ * signal every group the NSP has inputs or outputs in.
+ ***/
+
+/***
+ * Blocks until the input buffers of the group have been marked as ready,
+ * and optionally clears the ready indications as they are received.
+ ***/
+void waitForInputsReady(int group, bool clear);
+void waitForInputsReady(int group, bool clear, int threadId);
+
+/***
+ * Blocks until the output buffers of the group have been marked as ready,
+ * and optionally clears the ready indications as they are received.
+ ***/
+void waitForOutputsReady(int group, bool clear);
+void waitForOutputsReady(int group, bool clear, int threadId);
+
+/***
+ * readyForAllInputs for the inputs of one group
+ ***/
+void readyForInputs(int group, bool waitForArrival, bool clear);
+
+/***
+ * sendAllOutputs for the outputs of one group
+ ***/
+void sendOutputs(int group, bool waitForArrival, bool clear);
+
+/***
+ * Input slots
+ *
+ * With numInputSlots > 1 in the program config, each NSP has that many
+ * internal copies (slots) of its input buffers. acquireNextInputSlot
+ * waits for the next inputs, copies them into the next slot and hands the
+ * input buffers back to the host, so the host sends the next inputs while the
+ * NSP computes on the slot. Up to numInputSlots - 1 slots can be in use while
+ * the next inputs are received.
+ *
+ * This replaces readyForAllInputs/waitForAllInputsReady, and is called
+ * by one thread of each NSP with inputs.
+ ***/
+
+/***
+ * Blocks until the next slot has been released and the next inputs have
+ * arrived, copies them into the slot and signals the host that it can send
+ * the following inputs. Returns the slot number.
+ *
+ * - threadId is the thread that issues the copies
+ ***/
+int acquireNextInputSlot(int threadId);
+
+/***
+ * Marks the slot as no longer in use so it can receive new inputs
+ ***/
+void releaseInputSlot(int slot);
+
+/***
+ * Returns the buffer number of the copy of input buffNum in the slot. It
+ * holds the whole input buffer, including the header of allowPartial
+ * buffers.
+ ***/
+int inputSlotBufferNum(int buffNum, int slot);
+
+/***
+ * Thread synchronization
+ *
+ * Every thread of the NSP runs activate(). threadBarrier and parallelFor are
+ * collective: every thread of the NSP calls them, in the same order.
+ ***/
+
+/***
+ * Blocks until every thread of the NSP has called threadBarrier. Writes made
+ * before the barrier, including HVX stores, are visible to every thread
+ * after it.
+ ***/
+void threadBarrier();
+
+/***
+ * Atomically adds n to *counter and returns its previous value, so threads
+ * can take work items from a shared counter without a lock.
+ ***/
+uint32_t atomicFetchAdd(uint32_t *counter, uint32_t n);
+
+uint32_t *_parallelForBegin(int chunk);
+void _parallelForEnd();
+
+/***
+ * Splits [begin, end) into tiles of chunk (> 0) iterations and calls
+ * fn(tileBegin, tileEnd) for each tile on whichever thread takes it next, so
+ * threads that finish early take more tiles. Returns once every tile is
+ * done, with a threadBarrier.
+ ***/
+template <typename Fn> void parallelFor(int begin, int end, int chunk, Fn fn) {
+  uint32_t *next = _parallelForBegin(chunk);
+  // Tiles are taken by their offset from begin, which can't overflow
+  uint32_t count = end > begin ? (uint32_t)((int64_t)end - begin) : 0;
+  for (;;) {
+    uint32_t offset = atomicFetchAdd(next, chunk);
+    if (offset >= count)
+      break;
+    uint32_t size = count - offset > (uint32_t)chunk ? chunk : count - offset;
+    int tileBegin = (int)((int64_t)begin + offset);
+    fn(tileBegin, (int)((int64_t)tileBegin + size));
+  }
+  _parallelForEnd();
+}
+
+/***
+ * Tasks
+ *
+ * With taskDequeSize > 0 in the program config, each thread has a task deque
+ * in L2TCM per TaskAffinity, each holding taskDequeSize tasks rounded up to
+ * a power of 2. Threads run the newest tasks of their own deques first, and
+ * steal the oldest tasks of other threads' deques once theirs are empty.
+ * Threads 0 to numThreads - numHMXThreads - 1 are HVX threads, the rest HMX
+ * threads.
+ ***/
+typedef void (*TaskFn)(void *arg);
+enum TaskAffinity { TASK_ANY = 0, TASK_HVX = 1, TASK_HMX = 2 };
+
+void _taskDequesInit();
+
+/***
+ * Adds a task to the calling thread's deque for the affinity. Tasks can
+ * spawn more tasks.
+ *
+ * Returns false if the deque is full or no thread has the affinity, in
+ * which case the caller can run fn itself.
+ ***/
+bool spawnTask(int threadId, TaskFn fn, void *arg, TaskAffinity affinity);
+
+/***
+ * Runs tasks until every task spawned on the NSP has finished, including
+ * the tasks they spawn. Collective: every thread of the NSP calls it, and
+ * the tasks spawned by any thread before its call are run.
+ ***/
+void runTasks(int threadId);
+
+/***
+ * NSP collectives
+ *
+ * With nspCollectives set in the program config, every NSP of the program
+ * takes part in nspBarrier and allReduce. One thread of each NSP calls them,
+ * in the same order on every NSP. Each collective has a doorbell per NSP,
+ * which an NSP sets on every NSP with a multicast doorbell update when it
+ * arrives.
+ ***/
+
+/***
+ * Blocks until every NSP has called nspBarrier
+ ***/
+void nspBarrier(int threadId);
+
+enum ReduceOp { REDUCE_SUM = 0, REDUCE_MIN = 1, REDUCE_MAX = 2 };
+
+/***
+ * Replaces the count elements of data with the op of the data of every
+ * NSP, reduced in NSP order so every NSP gets the same result.
+ *
+ * Each NSP multicasts its data to the allReduce buffer of the others, so
+ * count elements must fit in allReduceSize bytes of the program config.
+ * data must be in DDR or this NSP's TCMs.
+ ***/
+void allReduce(float *data, int count, ReduceOp op, int threadId);
+void allReduce(int32_t *data, int count, ReduceOp op, int threadId);
+
+/***
+ * PMU profiling
+ *
+ * pmuConfigure sets the events the NSP's PMU counters count, by Hexagon PMU
+ * event number (see the PMU event table of the target). pmuRegionBegin and
+ * pmuRegionEnd accumulate the processor cycles and the count of each event
+ * between them, per thread and region, and each thread logs its regions when
+ * activate returns. The counters count for the whole NSP, so a region also
+ * counts the events of the other threads running at the same time.
+ ***/
+const int MAX_PMU_REGIONS = 16;
+
+/***
+ * Sets the events of the first numEvents (up to MAX_PMU_COUNTERS) counters.
+ * Called by one thread before any region begins.
+ ***/
+void pmuConfigure(const uint8_t *events, int numEvents);
+
+void pmuRegionBegin(int region, int threadId);
+void pmuRegionEnd(int region, int threadId);
+
+void _pmuLogRegions(int threadId);
+
+/***
+ * DDR bandwidth monitoring
+ *
+ * ddrBWSnapshot reads the DDR bandwidth monitor and the UTIMER, and
+ * ddrBWMBps gives the bandwidth between two snapshots. ddrBWRegionBegin and
+ * ddrBWRegionEnd accumulate the bytes read and written and the time between
+ * them, per thread and region. Each region end is traced as TRACE_DDR_BW with
+ * the bandwidth of the call in MB/s, and each thread logs the GB/s of its
+ * regions when activate returns. The monitor counts all of the device's DDR
+ * traffic, so a region also counts that of the other threads, NSPs and DMAs
+ * running at the same time. Without a monitor the counts are 0.
+ ***/
+const int MAX_DDR_BW_REGIONS = 16;
+
+struct DDRBWSnapshot {
+  uint64_t timestamp; // UTIMER ticks
+  uint64_t readBytes;
+  uint64_t writeBytes;
+};
+
+DDRBWSnapshot ddrBWSnapshot();
+
+/***
+ * Bytes read and written per second between two snapshots, in MB/s (10^6
+ * bytes per second)
+ ***/
+uint32_t ddrBWMBps(const DDRBWSnapshot &start, const DDRBWSnapshot &end);
+
+void ddrBWRegionBegin(int region, int threadId);
+void ddrBWRegionEnd(int region, int threadId);
+
+void _ddrBWLogRegions(int threadId);
+
 // SW Events
 /***
  * Write a NN_ACTIVATE_THREAD NnSWEvent to the log
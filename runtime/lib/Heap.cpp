@@ -0,0 +1,190 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include "Heap.h"
+
+#include "NSPContext.h"
+#include "SerializedProgramDesc.h"
+#include "libdev/libdev_assert.h"
+#include "libdev/os-inlines.h"
+
+namespace qaic {
+
+// Every block starts with a header, the caller's memory follows it. A free
+// block links to the next free block through the first word after the
+// header.
+typedef struct {
+  uint32_t sizeClass;
+  uint32_t size; // Of the whole block
+  uint32_t padding[2];
+} HeapBlockHeader;
+static_assert(sizeof(HeapBlockHeader) == HEAP_ALIGNMENT,
+              "HeapBlockHeader is expected to keep blocks aligned");
+
+const uint32_t HEAP_MIN_BLOCK_SIZE = 64;
+const uint32_t HEAP_MIN_BLOCK_SHIFT = 6;
+// Blocks larger than the size classes are multiples of this, and have this
+// size class
+const uint32_t HEAP_LARGE_BLOCK_SIZE = 4096;
+const uint32_t HEAP_LARGE_BLOCK = 0xffffffff;
+// Bytes a thread cache takes or returns at a time, at least one block, so
+// the big classes don't tie up the NSP's heap in one thread's cache
+const uint32_t HEAP_CACHE_BATCH_SIZE = 4096;
+
+static HeapBlockHeader *&nextFree(HeapBlockHeader *block) {
+  return *(HeapBlockHeader **)(block + 1);
+}
+
+static uint32_t sizeClass(uint32_t blockSize) {
+  if (blockSize <= HEAP_MIN_BLOCK_SIZE)
+    return 0;
+  return 32 - __builtin_clz(blockSize - 1) - HEAP_MIN_BLOCK_SHIFT;
+}
+
+// Blocks moved between a thread cache and the NSP's free blocks at a time
+static uint32_t cacheBatch(uint32_t sizeClass) {
+  uint32_t numBlocks =
+      HEAP_CACHE_BATCH_SIZE >> (HEAP_MIN_BLOCK_SHIFT + sizeClass);
+  if (numBlocks == 0)
+    return 1;
+  return numBlocks < HEAP_THREAD_CACHE_SIZE / 2 ? numBlocks
+                                                : HEAP_THREAD_CACHE_SIZE / 2;
+}
+
+static void lockHeap(CoreInfo *ctx) {
+  while (__atomic_exchange_n(&ctx->heapLock, 1, __ATOMIC_ACQUIRE))
+    os_thread_nanosleep(1, os_get_nanosleep_ptr());
+}
+
+static void unlockHeap(CoreInfo *ctx) {
+  __atomic_store_n(&ctx->heapLock, 0, __ATOMIC_RELEASE);
+}
+
+// Takes a new block from the end of the NSP's part of the heap, with the
+// heap locked
+static HeapBlockHeader *carveBlock(CoreInfo *ctx, uint32_t sizeClass,
+                                   uint32_t size) {
+  if ((uintptr_t)(ctx->heapEnd - ctx->heapNext) < size)
+    return nullptr;
+  HeapBlockHeader *block = (HeapBlockHeader *)ctx->heapNext;
+  ctx->heapNext += size;
+  block->sizeClass = sizeClass;
+  block->size = size;
+  return block;
+}
+
+void _heapInit() {
+  CoreInfo *ctx = getNSPContext();
+  uint32_t nspMask = _progBuffers[_progDesc->udmaDescBuffNum].nspMask;
+  uint32_t numNSPs = 32 - __builtin_clz(nspMask | 1);
+  uint64_t nspSize = (ctx->networkHeapSize / numNSPs) &
+                     ~(uint64_t)(HEAP_LARGE_BLOCK_SIZE - 1);
+  if (ctx->virtualNSPId >= numNSPs)
+    nspSize = 0;
+  ctx->heapNext = ctx->networkHeapAddr + ctx->virtualNSPId * nspSize;
+  ctx->heapEnd = ctx->heapNext + nspSize;
+}
+
+// Moves up to a batch of blocks into the thread's cache, from the NSP's free
+// blocks or else new blocks
+static void refillCache(CoreInfo *ctx, HeapThreadCache *cache, uint32_t c) {
+  uint32_t batch = cacheBatch(c);
+  lockHeap(ctx);
+  for (uint32_t i = 0; i < batch; i++) {
+    HeapBlockHeader *block = (HeapBlockHeader *)ctx->heapFreeBlocks[c];
+    if (block)
+      ctx->heapFreeBlocks[c] = nextFree(block);
+    else
+      block = carveBlock(ctx, c, HEAP_MIN_BLOCK_SIZE << c);
+    if (!block)
+      break;
+    nextFree(block) = (HeapBlockHeader *)cache->blocks[c];
+    cache->blocks[c] = block;
+    cache->numBlocks[c]++;
+  }
+  unlockHeap(ctx);
+}
+
+// Moves a batch of the thread's cached blocks back to the NSP's free blocks
+static void flushCache(CoreInfo *ctx, HeapThreadCache *cache, uint32_t c) {
+  uint32_t batch = cacheBatch(c);
+  lockHeap(ctx);
+  for (uint32_t i = 0; i < batch; i++) {
+    HeapBlockHeader *block = (HeapBlockHeader *)cache->blocks[c];
+    cache->blocks[c] = nextFree(block);
+    cache->numBlocks[c]--;
+    nextFree(block) = (HeapBlockHeader *)ctx->heapFreeBlocks[c];
+    ctx->heapFreeBlocks[c] = block;
+  }
+  unlockHeap(ctx);
+}
+
+// Reuses the first free large block that is big enough, or takes a new one
+static HeapBlockHeader *allocLarge(CoreInfo *ctx, uint32_t size) {
+  lockHeap(ctx);
+  HeapBlockHeader *block = nullptr;
+  for (HeapBlockHeader **prev =
+           (HeapBlockHeader **)&ctx->heapFreeLargeBlocks;
+       *prev; prev = &nextFree(*prev)) {
+    if ((*prev)->size >= size) {
+      block = *prev;
+      *prev = nextFree(block);
+      break;
+    }
+  }
+  if (!block)
+    block = carveBlock(ctx, HEAP_LARGE_BLOCK, size);
+  unlockHeap(ctx);
+  return block;
+}
+
+void *malloc(uint32_t size, int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  if (size > UINT32_MAX - HEAP_LARGE_BLOCK_SIZE - sizeof(HeapBlockHeader))
+    return nullptr;
+  uint32_t blockSize = size + sizeof(HeapBlockHeader);
+  uint32_t c = sizeClass(blockSize);
+
+  HeapBlockHeader *block;
+  if (c < HEAP_NUM_SIZE_CLASSES) {
+    HeapThreadCache *cache = &ctx->heapCaches[threadId];
+    if (cache->numBlocks[c] == 0)
+      refillCache(ctx, cache, c);
+    if (cache->numBlocks[c] == 0)
+      return nullptr;
+    block = (HeapBlockHeader *)cache->blocks[c];
+    cache->blocks[c] = nextFree(block);
+    cache->numBlocks[c]--;
+  } else {
+    block = allocLarge(
+        ctx, (uint32_t)alignTo(blockSize, HEAP_LARGE_BLOCK_SIZE));
+    if (!block)
+      return nullptr;
+  }
+  return block + 1;
+}
+
+void free(void *ptr, int threadId) {
+  if (!ptr)
+    return;
+  CoreInfo *ctx = getNSPContext();
+  HeapBlockHeader *block = (HeapBlockHeader *)ptr - 1;
+  uint32_t c = block->sizeClass;
+
+  if (c == HEAP_LARGE_BLOCK) {
+    lockHeap(ctx);
+    nextFree(block) = (HeapBlockHeader *)ctx->heapFreeLargeBlocks;
+    ctx->heapFreeLargeBlocks = block;
+    unlockHeap(ctx);
+    return;
+  }
+
+  assert(c < HEAP_NUM_SIZE_CLASSES && "Not a heap block!");
+  HeapThreadCache *cache = &ctx->heapCaches[threadId];
+  nextFree(block) = (HeapBlockHeader *)cache->blocks[c];
+  cache->blocks[c] = block;
+  cache->numBlocks[c]++;
+  if (cache->numBlocks[c] > 2 * cacheBatch(c))
+    flushCache(ctx, cache, c);
+}
+} // namespace qaic
@@ -0,0 +1,60 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#ifndef _QAIC_HEAP_H_
+#define _QAIC_HEAP_H_
+
+#include <stdint.h>
+
+namespace qaic {
+
+/***
+ * Network heap
+ *
+ * heapSize in the program config sets the size of the network heap in DDR.
+ * The caches of the NSPs aren't coherent with each other, so each NSP of the
+ * program allocates from its own equal part of the heap, and blocks are
+ * freed on the NSP that allocated them. The threads of an NSP share its
+ * part. Small blocks come in power of 2 size classes, and each thread keeps
+ * a cache of free blocks per class, so most malloc and free calls don't take
+ * the NSP's heap lock.
+ ***/
+
+const uint32_t HEAP_ALIGNMENT = 16;
+
+/***
+ * Returns size bytes aligned to HEAP_ALIGNMENT, or nullptr if the heap
+ * doesn't have them
+ ***/
+void *malloc(uint32_t size, int threadId);
+
+/***
+ * Returns a block from malloc to the heap. Any thread of the NSP can free
+ * it, nullptr is ignored.
+ ***/
+void free(void *ptr, int threadId);
+
+/***
+ * malloc for an array of count T
+ ***/
+template <typename T> T *mallocArray(uint32_t count, int threadId) {
+  static_assert(alignof(T) <= HEAP_ALIGNMENT,
+                "Type needs more alignment than the heap has!");
+  if (count > UINT32_MAX / sizeof(T))
+    return nullptr;
+  return (T *)malloc(count * sizeof(T), threadId);
+}
+
+// Blocks of 64 bytes to 64KB, including their header
+const int HEAP_NUM_SIZE_CLASSES = 11;
+// Most free blocks a thread keeps per size class, fewer for the big classes
+const uint32_t HEAP_THREAD_CACHE_SIZE = 16;
+
+typedef struct {
+  void *blocks[HEAP_NUM_SIZE_CLASSES];
+  uint32_t numBlocks[HEAP_NUM_SIZE_CLASSES];
+} HeapThreadCache;
+
+void _heapInit();
+} // namespace qaic
+#endif
@@ -8,34 +8,45 @@
 #include "libdev/libdev_defs.h"
 #include "libdev/os-inlines.h"
 
+#if defined(__hexagon__)
 CoreInfo NSPContext;
+#else
+// The device emulator runs every NSP in one process, so keep a context per
+// emulated NSP and select it based on the calling thread.
+CoreInfo NSPContexts[MAX_NUM_CORES];
+#endif
 
 void _nspContextInit(AICExecContext *ctx) {
+  CoreInfo *nspCtx = getNSPContext();
   // AICExecContext
-  NSPContext.virtualNSPId = ctx->virtualNSPId;
-  NSPContext.baseL2TCM = ctx->baseL2TCM;
-  NSPContext.baseVTCM = ctx->baseVTCM;
-  NSPContext.baseConstantDataMem = ctx->baseConstantDataMem;
-  NSPContext.baseSharedDDR = ctx->baseSharedDDR;
-  NSPContext.baseL2CachedDDR = ctx->baseL2CachedDDR;
-  NSPContext.semInfo = ctx->semaphoreListPtr;
-  NSPContext.mcAddresses = ctx->mcAddresses;
-  NSPContext.startTimeStamp = ctx->startTimeStamp;
-  NSPContext.logFuncPtr = ctx->logFuncPtr;
-  NSPContext.exitThread = ctx->exitThread;
-  NSPContext.setPMUReg = ctx->setPMUReg;
-  NSPContext.errFuncPtr = ctx->errFuncPtr;
-  NSPContext.notifyHangPtr = ctx->notifyHangPtr;
-  NSPContext.udmaReadFuncPtr = ctx->udmaReadFuncPtr;
-  NSPContext.mmapFuncPtr = ctx->mmapFuncPtr;
-  NSPContext.munmapFuncPtr = ctx->munmapFuncPtr;
-  NSPContext.qdss_stm_port_vaddr = ctx->qdssSTMPortVaddr;
+  nspCtx->virtualNSPId = ctx->virtualNSPId;
+  nspCtx->baseL2TCM = ctx->baseL2TCM;
+  nspCtx->baseVTCM = ctx->baseVTCM;
+  nspCtx->baseConstantDataMem = ctx->baseConstantDataMem;
+  nspCtx->baseSharedDDR = ctx->baseSharedDDR;
+  nspCtx->baseL2CachedDDR = ctx->baseL2CachedDDR;
+  nspCtx->semInfo = ctx->semaphoreListPtr;
+  nspCtx->mcAddresses = ctx->mcAddresses;
+  nspCtx->startTimeStamp = ctx->startTimeStamp;
+  nspCtx->logFuncPtr = ctx->logFuncPtr;
+  nspCtx->exitThread = ctx->exitThread;
+  nspCtx->setPMUReg = ctx->setPMUReg;
+  nspCtx->readPMUCnt = ctx->readPMUCnt;
+  nspCtx->errFuncPtr = ctx->errFuncPtr;
+  nspCtx->notifyHangPtr = ctx->notifyHangPtr;
+  nspCtx->udmaReadFuncPtr = ctx->udmaReadFuncPtr;
+  nspCtx->mmapFuncPtr = ctx->mmapFuncPtr;
+  nspCtx->munmapFuncPtr = ctx->munmapFuncPtr;
+  nspCtx->qdss_stm_port_vaddr = ctx->qdssSTMPortVaddr;
+  nspCtx->ddrBWMonRegs = (const DDRBWMonRegs_t *)ctx->ddrBWMonRegVaddr;
+  nspCtx->networkHeapAddr = ctx->networkHeapAddr;
+  nspCtx->networkHeapSize = ctx->networkHeapSize;
   // Other fields
 }
 
 void _udmaContextInit(int threadId) {
   // DMA descriptor setup
-  CoreInfo *ctx = &NSPContext;
+  CoreInfo *ctx = getNSPContext();
   const qaic::BufferDesc_t *udmaDescBuff =
       &qaic::_progBuffers[qaic::_progDesc->udmaDescBuffNum];
   uint32_t dmaDescStartOff = udmaDescBuff->offset;
@@ -80,7 +91,7 @@ void _udmaContextInit(int threadId) {
 }
 
 void _udmaContextCleanup(int threadId) {
-  CoreInfo *ctx = &NSPContext;
+  CoreInfo *ctx = getNSPContext();
   os_udma_wait_done(ctx->dmaTail[threadId], threadId);
 }
 
@@ -89,4 +100,8 @@ nsp_doorbell_t CoreInfo::exitDB() {
   return &dbs[qaic::_progDesc->exitDB];
 }
 
+#if defined(__hexagon__)
 CoreInfo *getNSPContext() { return &NSPContext; }
+#else
+CoreInfo *getNSPContext() { return &NSPContexts[os_host_nsp_index()]; }
+#endif
@@ -5,11 +5,52 @@
 #define _QAIC_NSPCONTEXT_H_
 
 #include "AICMetadataExecCtx.h"
+#include "BufferDesc.h"
+#include "ComputeAPI.h"
 #include "Exit.h"
+#include "Heap.h"
+#include "Trace.h"
 #include "libdev/os.h"
 
 using namespace aic;
 
+// Accumulated by pmuRegionBegin/pmuRegionEnd
+struct PMURegion {
+  uint64_t startPcycles;
+  uint64_t pcycles;
+  uint32_t startCounts[MAX_PMU_COUNTERS];
+  uint64_t counts[MAX_PMU_COUNTERS];
+  uint32_t numCalls;
+};
+
+// Accumulated by ddrBWRegionBegin/ddrBWRegionEnd
+struct DDRBWRegion {
+  qaic::DDRBWSnapshot start;
+  uint64_t ticks;
+  uint64_t readBytes;
+  uint64_t writeBytes;
+  uint32_t numCalls;
+};
+
+// Programs have 281 doorbells (hardcoded in the firmware)
+const int NUM_PROGRAM_DOORBELLS = 281;
+
+#ifdef QAIC_WAIT_STATS
+// Waits of a thread on one doorbell, built with QAIC_RUNTIME_WAIT_STATS.
+// Bucket i counts the waits of 2^(i-1) to 2^i - 1 UTIMER ticks, bucket 0 the
+// waits that didn't wait and the last bucket every longer wait.
+const int NUM_WAIT_BUCKETS = 16;
+struct WaitStats {
+  uint32_t count;
+  uint32_t buckets[NUM_WAIT_BUCKETS];
+  uint64_t totalTicks;
+};
+
+// The waits on anything but a doorbell (e.g. DMA completion) are counted
+// together after the doorbells
+const int WAIT_STATS_OTHER = NUM_PROGRAM_DOORBELLS;
+#endif
+
 struct CoreInfo {
   // NOTE: This constructor must be constexpr to ensure no
   // runtime initializers are needed to initialize the global CoreCtxData since
@@ -39,6 +80,7 @@ struct CoreInfo {
   nnc_log_fp logFuncPtr{nullptr};
   nnc_exit_fp exitThread{nullptr};
   nnc_pmu_set setPMUReg{nullptr};
+  nnc_pmu_get readPMUCnt{nullptr};
   nnc_err_fatal_fp errFuncPtr{nullptr};
   nnc_notify_hang_fp notifyHangPtr{nullptr};
   nnc_udma_read_fp udmaReadFuncPtr{nullptr};
@@ -48,6 +90,9 @@ struct CoreInfo {
     uint8_t *qdss_stm_port_vaddr{nullptr};
     uint8_t *qdssSTMPortVaddr;
   };
+  const volatile DDRBWMonRegs_t *ddrBWMonRegs{nullptr};
+  uint8_t *networkHeapAddr{nullptr};
+  uint64_t networkHeapSize{0};
 
   // DMA
   DMADescriptor *getNextFreeDMADesc(int threadId);
@@ -68,6 +113,57 @@ struct CoreInfo {
   DMADescriptor *dmaDescStart[MAX_NUM_THREADS]{nullptr};
   DMADescriptor *dmaDescEnd[MAX_NUM_THREADS]{nullptr};
   DMADescriptor *dmaDescNext[MAX_NUM_THREADS]{nullptr};
+  // The batch holding descriptors of each thread's ring that it hasn't
+  // linked yet, tracked in debug builds
+  const qaic::DMABatch *openDMABatch[MAX_NUM_THREADS]{nullptr};
+
+  // Input slots
+  uint32_t numInputSlotsAcquired{0};
+
+  // This NSP's part of the network heap: the blocks not handed out yet
+  // start at heapNext, free blocks are in heapFreeBlocks by size class and
+  // in heapFreeLargeBlocks
+  uint8_t *heapNext{nullptr};
+  uint8_t *heapEnd{nullptr};
+  void *heapFreeBlocks[qaic::HEAP_NUM_SIZE_CLASSES]{};
+  void *heapFreeLargeBlocks{nullptr};
+  uint32_t heapLock{0};
+  qaic::HeapThreadCache heapCaches[MAX_NUM_THREADS]{};
+
+  // PMU events counted by the PMU counters, and each thread's regions
+  uint8_t pmuEvents[MAX_PMU_COUNTERS]{};
+  int numPMUEvents{0};
+  PMURegion pmuRegions[MAX_NUM_THREADS][qaic::MAX_PMU_REGIONS]{};
+
+  // Each thread's DDR bandwidth regions
+  DDRBWRegion ddrBWRegions[MAX_NUM_THREADS][qaic::MAX_DDR_BW_REGIONS]{};
+
+#ifdef QAIC_WAIT_STATS
+  WaitStats waitStats[MAX_NUM_THREADS][WAIT_STATS_OTHER + 1]{};
+#endif
+
+  // Each thread's trace ring, nullptr without tracing
+  qaic::TraceRingHeader_t *traceRings[MAX_NUM_THREADS]{};
+  // G_DTS stimulus of the STM port with the STM trace backend, else nullptr
+  volatile uint64_t *traceSTMPort{nullptr};
+
+  // Each thread's part of the arenas
+  qaic::Arena vtcmArenas[MAX_NUM_THREADS]{};
+  qaic::Arena l2tcmArenas[MAX_NUM_THREADS]{};
+
+  // Thread barrier and parallelFor. The generation is an acquire/release
+  // location, so it gets its own cache line.
+  __attribute__((aligned(CACHE_LINE_SIZE))) uint32_t barrierGeneration{0};
+  __attribute__((aligned(CACHE_LINE_SIZE))) uint32_t barrierCount{0};
+  uint32_t parallelForNext{0};
+
+  // Doorbell values of the last nspBarrier and allReduce, read by the DMAs
+  // that update the collective doorbells
+  uint32_t nspBarrierGeneration{0};
+  uint32_t allReduceGeneration{0};
+
+  // Tasks spawned and not yet finished
+  __attribute__((aligned(CACHE_LINE_SIZE))) uint32_t tasksPending{0};
 
   // These need to be on separate cache lines from each other so they aren't
   // treated as the same acquire/release location.
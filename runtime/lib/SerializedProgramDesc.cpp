@@ -10,6 +10,8 @@ namespace qaic {
 
 SerializedProgramDesc_t *_progDesc;
 BufferDesc_t *_progBuffers;
+IOGroupDesc_t *_progIOGroups;
+IODoorbell_t *_progIODoorbells;
 
 void _programDescInit(AICExecContext *ctx) {
   _progDesc = (SerializedProgramDesc_t *)getNSPContext()->baseConstantDataMem;
@@ -21,6 +23,10 @@ void _programDescInit(AICExecContext *ctx) {
   }
   _progBuffers =
       (BufferDesc_t *)((uint8_t *)_progDesc + _progDesc->buffersOffset);
+  _progIOGroups =
+      (IOGroupDesc_t *)((uint8_t *)_progDesc + _progDesc->ioGroupsOffset);
+  _progIODoorbells =
+      (IODoorbell_t *)((uint8_t *)_progDesc + _progDesc->ioDoorbellsOffset);
 }
 
 } // namespace qaic
@@ -9,7 +9,36 @@
 
 namespace qaic {
 
-const uint16_t SERIALIZED_PROGRAMDESC_VERSION = 1;
+const uint16_t SERIALIZED_PROGRAMDESC_VERSION = 10;
+
+// Set in ioDoorbellFlags when the doorbell numbers of all the inputs, and of
+// all the outputs, are consecutive in the I/O doorbells. The doorbells of any
+// range of the I/O doorbells can then be cleared with wide stores.
+const uint16_t IO_DOORBELLS_CONTIGUOUS = 0x1;
+
+// Semaphores and NSPs of the inputs and outputs in one I/O group. Each group
+// has its own handshake with the host.
+typedef struct {
+  uint16_t inputSem;
+  uint16_t outputSem;
+  uint16_t hasInputsMask;
+  uint16_t hasOutputsMask;
+  uint16_t firstInputDB;  // Index of the group's inputs in the I/O doorbells
+  uint16_t numInputDBs;
+  uint16_t firstOutputDB; // Index of the group's outputs in the I/O doorbells
+  uint16_t numOutputDBs;
+} IOGroupDesc_t;
+
+// Ready doorbell of an input or output buffer. The I/O doorbells hold the
+// inputs, then the outputs, each ordered by I/O group, so the doorbells for
+// all inputs, all outputs or the inputs or outputs of one group are
+// contiguous. The host rings I/O doorbells on every NSP, so all NSPs share
+// them.
+typedef struct {
+  uint16_t dbNum;
+  uint16_t buffNum;
+  uint32_t dbVal;
+} IODoorbell_t;
 
 typedef struct {
   uint16_t serialVersion;
@@ -27,11 +56,34 @@ typedef struct {
   uint32_t buffersOffset;
   uint32_t udmaDescBuffNum;
   uint32_t udmaDummyStartDescOffset;
+  uint16_t numInputSlots;
+  uint16_t inputSlotsBuffNum;
+  uint16_t numIOGroups;
+  uint16_t ioDoorbellFlags;
+  uint32_t ioGroupsOffset;
+  uint32_t ioDoorbellsOffset;
+  uint16_t numHvxThreads;
+  uint16_t taskDequesBuffNum;
+  uint32_t taskDequeSize; // Bytes per task deque, 0 without task deques
+  uint16_t numCollectiveNSPs; // 0 without NSP collectives
+  uint16_t nspBarrierDB;      // First of numCollectiveNSPs doorbells
+  uint16_t allReduceDB;       // First of numCollectiveNSPs doorbells
+  uint16_t allReduceBuffNum;
+  uint32_t allReduceSize; // Bytes per NSP in allReduce, 0 without allReduce
+  uint32_t vtcmArenaOffset;
+  uint32_t vtcmArenaSize;
+  uint32_t l2tcmArenaOffset;
+  uint32_t l2tcmArenaSize;
+  uint32_t traceBuffNum;
+  uint32_t traceEntries; // Entries per trace ring, 0 without tracing
+  uint32_t traceBackend; // TraceBackend
 } SerializedProgramDesc_t;
 
 #ifndef _QAIC_SERIALIZEDPROGRAMDESC_CPP_
 extern const SerializedProgramDesc_t *_progDesc;
 extern const BufferDesc_t *_progBuffers;
+extern const IOGroupDesc_t *_progIOGroups;
+extern const IODoorbell_t *_progIODoorbells;
 #endif
 
 void _programDescInit(AICExecContext *ctx);
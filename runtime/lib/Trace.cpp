@@ -0,0 +1,76 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include "Trace.h"
+
+#include "NSPContext.h"
+#include "SerializedProgramDesc.h"
+#include "libdev/os-inlines.h"
+
+namespace qaic {
+
+bool _traceEnabled = false;
+
+void _traceInit() {
+  CoreInfo *ctx = getNSPContext();
+  if (_progDesc->traceBackend == TRACE_BACKEND_STM) {
+    if (!ctx->qdss_stm_port_vaddr) {
+      NN_LOG(ctx->logFuncPtr, NNC_LOG_MASK_WARN,
+             "NSP %d has no STM port, tracing is disabled",
+             ctx->virtualNSPId);
+      return;
+    }
+    ctx->traceSTMPort =
+        (volatile uint64_t *)(ctx->qdss_stm_port_vaddr +
+                              TRACE_STM_G_DTS_OFFSET);
+    _traceEnabled = true;
+    return;
+  }
+
+  uint32_t numEntries = _progDesc->traceEntries;
+  if (numEntries == 0)
+    return;
+
+  // NSPs past the ones the buffer was sized for don't trace
+  uint32_t numThreads = _progDesc->numThreads;
+  uint32_t ringSize = traceRingSize(numEntries);
+  uint32_t firstRing = ctx->virtualNSPId * numThreads;
+  if ((firstRing + numThreads) * ringSize >
+      getBufferSize(_progDesc->traceBuffNum))
+    return;
+
+  uint8_t *rings = (uint8_t *)getBufferAddr(_progDesc->traceBuffNum);
+  for (uint32_t t = 0; t < numThreads; t++) {
+    TraceRingHeader_t *ring =
+        (TraceRingHeader_t *)(rings + (firstRing + t) * ringSize);
+    ring->numEvents = 0;
+    ring->capacity = numEntries;
+    ring->nsp = ctx->virtualNSPId;
+    ring->thread = t;
+    ctx->traceRings[t] = ring;
+  }
+  _traceEnabled = true;
+}
+
+void traceEvent(uint16_t event, TraceKind kind, uint32_t payload,
+                int threadId) {
+  CoreInfo *ctx = getNSPContext();
+  if (ctx->traceSTMPort) {
+    *ctx->traceSTMPort =
+        traceSTMPacket(event, kind, payload, ctx->virtualNSPId, threadId);
+    return;
+  }
+  TraceRingHeader_t *ring = ctx->traceRings[threadId];
+  if (!ring)
+    return;
+  uint32_t n = ring->numEvents;
+  TraceEntry_t *entry =
+      (TraceEntry_t *)((uint8_t *)ring + TRACE_RING_HEADER_SIZE) +
+      (n & (ring->capacity - 1));
+  entry->timestamp = os_get_system_timestamp();
+  entry->event = event;
+  entry->kind = kind;
+  entry->payload = payload;
+  ring->numEvents = n + 1;
+}
+} // namespace qaic
@@ -0,0 +1,127 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#ifndef _QAIC_TRACE_H_
+#define _QAIC_TRACE_H_
+
+#include <stdint.h>
+
+namespace qaic {
+
+/***
+ * Tracing
+ *
+ * With traceEntries > 0 in the program config, each thread of each NSP has a
+ * trace ring in shared DDR. traceEvent stores the UTIMER timestamp, the
+ * event, its kind and a payload in the next entry of the thread's ring,
+ * without formatting or locking, and overwrites the oldest entry once the
+ * ring is full. qaic-trace converts the rings to Chrome trace JSON, for
+ * chrome://tracing or Perfetto. Without traceEntries, traceEvent returns
+ * immediately.
+ *
+ * Programs built with qaic-cc --trace-backend=stm write each event to the
+ * QDSS STM port instead, as a single 64-bit store that the STM timestamps
+ * and forwards to the QDSS sink. This doesn't touch DDR or the caches, so it
+ * doesn't perturb the program or the firmware. qaic-trace decodes the
+ * captured STM stream the same way.
+ ***/
+enum TraceKind : uint8_t {
+  TRACE_INSTANT = 0,
+  TRACE_BEGIN = 1, // Starts a span, ended by the thread's next TRACE_END
+  TRACE_END = 2,
+};
+
+// Events recorded by the runtime. Events of the program start at
+// TRACE_USER_EVENTS.
+enum TraceEvent : uint16_t {
+  TRACE_DMA_SUBMIT = 1,  // Payload is the number of descriptors
+  TRACE_DMA_WAIT = 2,    // Span of waitForTransfer
+  TRACE_NSP_WAIT = 3,    // Span waiting for the NSPs of a collective,
+                         // payload is its first doorbell
+  TRACE_ACTIVATE = 4,    // Span of the program's activate
+  TRACE_DOORBELL = 5,    // A doorbell a thread blocked on was satisfied,
+                         // payload is the doorbell
+  TRACE_DDR_BW = 6,      // End of a DDR bandwidth region, payload is its
+                         // bandwidth in MB/s
+  TRACE_USER_EVENTS = 256,
+};
+
+void traceEvent(uint16_t event, TraceKind kind, uint32_t payload,
+                int threadId);
+
+inline void traceBegin(uint16_t event, uint32_t payload, int threadId) {
+  traceEvent(event, TRACE_BEGIN, payload, threadId);
+}
+
+inline void traceEnd(uint16_t event, uint32_t payload, int threadId) {
+  traceEvent(event, TRACE_END, payload, threadId);
+}
+
+inline void traceInstant(uint16_t event, uint32_t payload, int threadId) {
+  traceEvent(event, TRACE_INSTANT, payload, threadId);
+}
+
+// The trace buffer holds a ring per thread of each NSP, NSP by NSP. A ring is
+// a header, padded to TRACE_RING_HEADER_SIZE, followed by its entries. The
+// number of entries is a power of 2 of at least TRACE_MIN_ENTRIES, so the
+// rings stay cache line aligned.
+typedef struct {
+  uint64_t timestamp; // UTIMER ticks
+  uint16_t event;
+  uint8_t kind;
+  uint8_t reserved;
+  uint32_t payload;
+} TraceEntry_t;
+static_assert(sizeof(TraceEntry_t) == 16,
+              "TraceEntry_t is expected to be 16 bytes!");
+
+typedef struct {
+  uint32_t numEvents; // Events recorded, the ring holds the last capacity
+  uint32_t capacity;  // Entries, 0 if the thread didn't run
+  uint16_t nsp;
+  uint16_t thread;
+  uint32_t reserved;
+} TraceRingHeader_t;
+
+// Where traceEvent records events, SerializedProgramDesc_t::traceBackend
+enum TraceBackend : uint32_t {
+  TRACE_BACKEND_RING = 0,
+  TRACE_BACKEND_STM = 1,
+};
+
+const uint32_t TRACE_RING_HEADER_SIZE = 128;
+const uint32_t TRACE_MIN_ENTRIES =
+    TRACE_RING_HEADER_SIZE / sizeof(TraceEntry_t);
+
+inline uint32_t traceRingSize(uint32_t numEntries) {
+  return TRACE_RING_HEADER_SIZE + numEntries * sizeof(TraceEntry_t);
+}
+
+// With the STM backend an event is one 64-bit STM packet, nibble aligned so
+// it reads in a hex dump:
+//   [63:60] TRACE_STM_TAG, tells the runtime's packets from other STM traffic
+//   [59:56] NSP
+//   [55:52] thread
+//   [51:48] kind
+//   [47:32] event
+//   [31:0]  payload
+// The STM adds the timestamp. Events are written to the guaranteed,
+// timestamped data stimulus (G_DTS) of the program's STM port.
+const uint32_t TRACE_STM_TAG = 0xA;
+const uint32_t TRACE_STM_G_DTS_OFFSET = 0x10;
+
+inline uint64_t traceSTMPacket(uint16_t event, TraceKind kind,
+                               uint32_t payload, uint32_t nsp,
+                               uint32_t thread) {
+  return (uint64_t)TRACE_STM_TAG << 60 | (uint64_t)(nsp & 0xF) << 56 |
+         (uint64_t)(thread & 0xF) << 52 | (uint64_t)(kind & 0xF) << 48 |
+         (uint64_t)event << 32 | payload;
+}
+
+void _traceInit();
+
+// Set by _traceInit once an NSP of the program traces, so the runtime's hot
+// paths can skip tracing without a call
+extern bool _traceEnabled;
+} // namespace qaic
+#endif
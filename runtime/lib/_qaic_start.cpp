@@ -5,13 +5,18 @@
 #include "ComputeAPI.h"
 #include "NSPContext.h"
 #include "SerializedProgramDesc.h"
+#if !defined(__hexagon__)
+#include "libdev/os_host.h"
+#endif
 
 extern "C" {
 void _qaic_start(void *ctx, uint8_t virtualThreadId, uint32_t stid);
 void activate(void *ctx, uint8_t virtualThreadId, uint32_t stid);
 }
 
-static volatile bool _initsDone = false;
+// Indexed by virtualNSPId so the device emulator, which runs all NSPs in one
+// image, gets an init flag per NSP.
+static volatile bool _initsDone[MAX_NUM_CORES] = {false};
 
 void _qaic_start(void *ctx, uint8_t virtualThreadId, uint32_t stid) {
   AICExecContext *qctx = (AICExecContext *)ctx;
@@ -21,17 +26,29 @@ void _qaic_start(void *ctx, uint8_t virtualThreadId, uint32_t stid) {
 
     _nspContextInit(qctx);
     qaic::_programDescInit(qctx);
+    qaic::_taskDequesInit();
+    qaic::_arenasInit();
+    qaic::_heapInit();
+    qaic::_traceInit();
 
-    _initsDone = true;
+    _initsDone[qctx->virtualNSPId] = true;
   } else {
-    while (!_initsDone)
+    while (!_initsDone[qctx->virtualNSPId])
       ;
   }
   qaic::logActivate(virtualThreadId);
   _udmaContextInit(virtualThreadId);
 
   // Jump to the user entry point.
+  qaic::traceBegin(qaic::TRACE_ACTIVATE, stid, virtualThreadId);
   activate(qctx, virtualThreadId, stid);
+  qaic::traceEnd(qaic::TRACE_ACTIVATE, stid, virtualThreadId);
+
+  qaic::_pmuLogRegions(virtualThreadId);
+  qaic::_ddrBWLogRegions(virtualThreadId);
+#ifdef QAIC_WAIT_STATS
+  os_wait_stats_log(virtualThreadId);
+#endif
 
   // Flush the log
   NN_LOG(qctx->logFuncPtr, NNC_LOG_MASK_INFO, "\n");
@@ -44,6 +61,10 @@ void _qaic_start(void *ctx, uint8_t virtualThreadId, uint32_t stid) {
 
   qaic::logDeactivate(virtualThreadId);
 
+#if !defined(__hexagon__)
+  os_host_thread_finished(virtualThreadId);
+#endif
+
   // wait for exit DB non-zero before exiting
   volatile uint32_t *exitDB = (uint32_t *)(getNSPContext()->exitDB());
   while (*exitDB == 0)
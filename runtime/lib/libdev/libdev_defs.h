@@ -4,6 +4,7 @@
 #ifndef LIBDEV_DEFS_H
 #define LIBDEV_DEFS_H
 
+#include "BufferDesc.h"
 #include "libdev_assert.h"
 
 using namespace aic;
@@ -27,6 +28,24 @@ void libdev_multicastVTCM(int8_t *dst, int32_t dstOffset, const int8_t *src,
                           bool dbOnlyCheckedLocally, bool updateDBs,
                           int threadId, uint32_t DBNum, uint32_t mcId);
 
+void libdev_dma_batch_init(qaic::DMABatch *batch, int threadId);
+
+void libdev_dma_batch_add(qaic::DMABatch *batch, int8_t *dst,
+                          int32_t dstOffset, const int8_t *src, unsigned size,
+                          bool isMulticast, bool destBypass, bool srcBypass);
+
+void libdev_dma_batch_add_2d(qaic::DMABatch *batch, int8_t *dst,
+                             const int8_t *src, unsigned rowSize,
+                             unsigned numRows, unsigned dstStride,
+                             unsigned srcStride, bool destBypass,
+                             bool srcBypass);
+
+DMADescriptor *libdev_dma_batch_submit(qaic::DMABatch *batch,
+                                       const uint32_t *dbVal,
+                                       bool dbOnlyCheckedLocally,
+                                       bool updateDBs, bool doRelease,
+                                       uint32_t DBNum, uint32_t mcId);
+
 inline int libdev_l2tcm_size() { return 1 * 1024 * 1024; }
 inline int libdev_vtcm_size() { return 8 * 1024 * 1024; }
 }
@@ -13,6 +13,8 @@ void libdev_copy_dma_doorbells(
   assert(noPayload == false);
 
   CoreInfo *ctx = libdev_getcontext();
+  assert(!ctx->openDMABatch[threadId] &&
+         "DMA issued while a DMABatch of the thread is open");
 
   // Large DMAs should have been split at the IR level.
   assert(size <= UDMAMaxSize);
@@ -93,3 +95,117 @@ void libdev_multicastVTCM(int8_t *dst, int32_t dstOffset, const int8_t *src,
       srcBypass, threadId, dbVal, dbOnlyCheckedLocally, updateDBs,
       /*noPayload=*/false, /*doRelease=*/true, DBNum, mcId);
 }
+
+// Descriptors in each thread's descriptor ring
+static const unsigned numDMADescsPerThread =
+    NUM_UDMA_CACHELINES_PER_THREAD * CACHE_LINE_SIZE / sizeof(DMADescriptor);
+
+static void libdev_dma_batch_append(qaic::DMABatch *batch,
+                                    DMADescriptor *desc) {
+  if (batch->tail)
+    batch->tail->next = (uint32_t)(uintptr_t)desc;
+  else
+    batch->head = desc;
+  batch->tail = desc;
+  batch->numDescs++;
+#ifndef NDEBUG
+  libdev_getcontext()->openDMABatch[batch->threadId] = batch;
+#endif
+}
+
+static void libdev_dma_batch_link(qaic::DMABatch *batch, bool doRelease) {
+  if (batch->head)
+    libdev_getcontext()->submitDMAs(batch->head, batch->tail, doRelease,
+                                    batch->threadId);
+#ifndef NDEBUG
+  libdev_getcontext()->openDMABatch[batch->threadId] = nullptr;
+#endif
+  libdev_dma_batch_init(batch, batch->threadId);
+}
+
+void libdev_dma_batch_init(qaic::DMABatch *batch, int threadId) {
+  batch->head = nullptr;
+  batch->tail = nullptr;
+  batch->numDescs = 0;
+  batch->threadId = threadId;
+}
+
+void libdev_dma_batch_add(qaic::DMABatch *batch, int8_t *dst,
+                          int32_t dstOffset, const int8_t *src, unsigned size,
+                          bool isMulticast, bool destBypass, bool srcBypass) {
+  CoreInfo *ctx = libdev_getcontext();
+  assert((!ctx->openDMABatch[batch->threadId] ||
+          ctx->openDMABatch[batch->threadId] == batch) &&
+         "Another DMABatch of the thread is open");
+
+  while (size) {
+    unsigned transferSize = (size < UDMAMaxSize) ? size : UDMAMaxSize;
+
+    // The ring would hand back a descriptor this batch is still building, so
+    // link what we have first. Two descriptors stay free for the doorbells.
+    if (batch->numDescs + 3 > numDMADescsPerThread)
+      libdev_dma_batch_link(batch, /*doRelease=*/true);
+
+    DMADescriptor *desc = ctx->getNextFreeDMADesc(batch->threadId);
+    bool order = false;
+    ctx->fillOutDMADesc(desc, nullptr, dst, dstOffset, src, transferSize,
+                        destBypass, srcBypass, order, isMulticast,
+                        batch->threadId);
+    libdev_dma_batch_append(batch, desc);
+
+    dstOffset += transferSize;
+    src += transferSize;
+    size -= transferSize;
+  }
+}
+
+// The descriptor format only has a linear transfer type, so a 2D transfer is
+// a chain of per-row descriptors.
+void libdev_dma_batch_add_2d(qaic::DMABatch *batch, int8_t *dst,
+                             const int8_t *src, unsigned rowSize,
+                             unsigned numRows, unsigned dstStride,
+                             unsigned srcStride, bool destBypass,
+                             bool srcBypass) {
+  if (rowSize == dstStride && rowSize == srcStride) {
+    rowSize *= numRows;
+    numRows = 1;
+  }
+  for (unsigned row = 0; row < numRows; ++row) {
+    libdev_dma_batch_add(batch, dst, /*dstOffset=*/0, src, rowSize,
+                         /*isMulticast=*/false, destBypass, srcBypass);
+    dst += dstStride;
+    src += srcStride;
+  }
+}
+
+DMADescriptor *libdev_dma_batch_submit(qaic::DMABatch *batch,
+                                       const uint32_t *dbVal,
+                                       bool dbOnlyCheckedLocally,
+                                       bool updateDBs, bool doRelease,
+                                       uint32_t DBNum, uint32_t mcId) {
+  CoreInfo *ctx = libdev_getcontext();
+  int threadId = batch->threadId;
+  assert((!ctx->openDMABatch[threadId] ||
+          ctx->openDMABatch[threadId] == batch) &&
+         "Another DMABatch of the thread is open");
+
+  if (updateDBs) {
+    DMADescriptor *localDBDesc = ctx->getNextFreeDMADesc(threadId);
+    bool order = true;
+    ctx->fillOutDMADescLocalDBUpdate(localDBDesc, nullptr, dbVal, order,
+                                     threadId, DBNum);
+    libdev_dma_batch_append(batch, localDBDesc);
+
+    if (!dbOnlyCheckedLocally) {
+      DMADescriptor *globalDBDesc = ctx->getNextFreeDMADesc(threadId);
+      bool order = false;
+      ctx->fillOutDMADescGlobalDBUpdate(globalDBDesc, nullptr, dbVal, order,
+                                        threadId, DBNum, mcId);
+      libdev_dma_batch_append(batch, globalDBDesc);
+    }
+  }
+
+  DMADescriptor *tail = batch->tail;
+  libdev_dma_batch_link(batch, doRelease);
+  return tail;
+}
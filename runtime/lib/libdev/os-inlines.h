@@ -8,6 +8,9 @@
 #include "AICMetadata.h"
 #include "libdev_interface.h"
 #include <inttypes.h>
+#if !defined(__hexagon__)
+#include "os_host.h"
+#endif
 
 using namespace aic;
 
@@ -29,6 +32,7 @@ inline constexpr uint64_t alignTo(uint64_t x, uint64_t m) {
 // an atomic store, but that does a mem_locked operation, which we
 // don't need here since any required exclusive access to this
 // address should be guarenteed at a higher level.
+#if defined(__hexagon__)
 inline void hexagon_atomic_store_nolock1b(uint8_t *p, uint8_t val) {
   asm("memb(%0+#0) = %1" : : "r"(p), "r"(val) : "memory");
 }
@@ -38,11 +42,34 @@ inline void hexagon_atomic_store_nolock2b(uint16_t *p, uint16_t val) {
 inline void hexagon_atomic_store_nolock4b(uint32_t *p, uint32_t val) {
   asm("memw(%0+#0) = %1" : : "r"(p), "r"(val) : "memory");
 }
+inline void hexagon_atomic_store_nolock8b(uint64_t *p, uint64_t val) {
+  asm("memd(%0+#0) = %1" : : "r"(p), "r"(val) : "memory");
+}
 inline uint32_t hexagon_atomic_load_nolock4b_acquire(uint32_t *p) {
   uint32_t val;
   asm("%0 = memw_aq(%1)" : "=r"(val) : "r"(p) : "memory");
   return val;
 }
+#else
+// Host emulation: the emulated UDMA engine runs on another OS thread, so
+// use release/acquire ordering to match what the Hexagon memory model gives
+// us for TCM accesses.
+inline void hexagon_atomic_store_nolock1b(uint8_t *p, uint8_t val) {
+  __atomic_store_n(p, val, __ATOMIC_RELEASE);
+}
+inline void hexagon_atomic_store_nolock2b(uint16_t *p, uint16_t val) {
+  __atomic_store_n(p, val, __ATOMIC_RELEASE);
+}
+inline void hexagon_atomic_store_nolock4b(uint32_t *p, uint32_t val) {
+  __atomic_store_n(p, val, __ATOMIC_RELEASE);
+}
+inline void hexagon_atomic_store_nolock8b(uint64_t *p, uint64_t val) {
+  __atomic_store_n(p, val, __ATOMIC_RELEASE);
+}
+inline uint32_t hexagon_atomic_load_nolock4b_acquire(uint32_t *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+#endif
 
 // We can just use atomic load here, since that doesn't get compiled down to
 // mem_locked and will prevent the compiler from re-ordering.
@@ -53,6 +80,7 @@ template <typename T> inline T os_doorbell_read(nsp_doorbell_t db) {
 
 inline void os_thread_nanosleep(const int sleepCount,
                                 const volatile uint32_t *p) {
+#if defined(__hexagon__)
   switch (sleepCount) {
   case 0:
     // Errata workaround
@@ -66,6 +94,10 @@ inline void os_thread_nanosleep(const int sleepCount,
   default:
     asm volatile("pause(#8);\n");
   }
+#else
+  (void)p;
+  os_host_pause(sleepCount);
+#endif
 }
 
 // Get short wait ptr for passing to os_thread_nanosleep
@@ -95,12 +127,22 @@ static void os_doorbell_wait(nsp_doorbell_t db, uint32_t val, Compare &comp,
   // around every 1ms
   int timeoutCheckIter = isLocal ? 10000 : 1000;
   int timeoutIter = 0;
+  bool waited = false;
+
+#ifdef QAIC_WAIT_STATS
+  uint64_t waitStart = 0;
+#endif
 
   uint32_t dbval;
   // Use __builtin_expect to make the case where the doorbell is already met the
   // fast path since the other case is just waiting anyway.
   while (__builtin_expect(
       !comp(dbval = os_doorbell_read4b_acquire((uint32_t *)db), val), false)) {
+    waited = true;
+#ifdef QAIC_WAIT_STATS
+    if (waitStart == 0)
+      waitStart = os_get_system_timestamp();
+#endif
     // A dmwait/dmpoll is required in order to expose page exceptions.
     // If this is a local wait, this poll will already happen in the next call
     // to os_thread_nanosleep().
@@ -118,6 +160,66 @@ static void os_doorbell_wait(nsp_doorbell_t db, uint32_t val, Compare &comp,
       timeoutIter = 0;
     }
   }
+
+  if (waited && qaic::_traceEnabled)
+    os_trace_doorbell(db, threadId);
+#ifdef QAIC_WAIT_STATS
+  os_wait_stats_record(
+      db, threadId, waitStart ? os_get_system_timestamp() - waitStart : 0);
+#endif
+}
+
+// Same as os_doorbell_wait, but waits for any of numDBs doorbells, each
+// compared against its own value, and returns the index of the one that met
+// its value. Doorbells earlier in the list win if several are met.
+template <bool isLocal, bool isDMAPossiblyActive, typename Compare>
+static int os_doorbell_wait_any(const nsp_doorbell_t *dbs,
+                                const uint32_t *vals, int numDBs,
+                                Compare &comp, bool doTimeoutCheck,
+                                int threadId) {
+  int sleepCount = isLocal ? 0 : 255;
+  const volatile uint32_t *nanosleep_ptr = os_get_nanosleep_ptr();
+  // Timeouts are reported against the first doorbell
+  OSTimeoutCheckContext timeoutCtx(threadId, dbs[0], vals[0]);
+  int timeoutCheckIter = isLocal ? 10000 : 1000;
+  int timeoutIter = 0;
+  bool waited = false;
+#ifdef QAIC_WAIT_STATS
+  uint64_t waitStart = 0;
+#endif
+
+  while (true) {
+    for (int i = 0; i < numDBs; i++) {
+      uint32_t dbval = os_doorbell_read4b_acquire((uint32_t *)dbs[i]);
+      if (__builtin_expect(comp(dbval, vals[i]), false)) {
+        if (waited && qaic::_traceEnabled)
+          os_trace_doorbell(dbs[i], threadId);
+#ifdef QAIC_WAIT_STATS
+        os_wait_stats_record(
+            dbs[i], threadId,
+            waitStart ? os_get_system_timestamp() - waitStart : 0);
+#endif
+        return i;
+      }
+    }
+    waited = true;
+#ifdef QAIC_WAIT_STATS
+    if (waitStart == 0)
+      waitStart = os_get_system_timestamp();
+#endif
+
+    if (isDMAPossiblyActive && !isLocal)
+      os_udma_poll();
+
+    os_thread_nanosleep(sleepCount, nanosleep_ptr);
+
+    if (++timeoutIter == timeoutCheckIter) {
+      os_timeout_check(&timeoutCtx,
+                       os_doorbell_read4b_acquire((uint32_t *)dbs[0]),
+                       doTimeoutCheck, false);
+      timeoutIter = 0;
+    }
+  }
 }
 
 extern "C" {
@@ -143,7 +245,12 @@ inline void os_udma_wait_done(const DMADescriptor *desc, int threadId) {
 // terms of HW thread, not SW thread, so is not safe to use if there is any
 // OS thread scheduling/context switching going on.
 inline void os_release_allthreads(void *addr) {
+#if defined(__hexagon__)
   asm("release(%0):at" : : "r"(addr) : "memory");
+#else
+  (void)addr;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
 }
 
 inline uint32_t os_load_acquire(uint32_t *addr) {
@@ -159,16 +266,24 @@ inline void os_udma_link(DMADescriptor *tailDmaDescriptor, DMADescriptor *dmaDes
   // constants.
   if (doRelease)
     os_release_allthreads(dmaDescriptor);
+#if defined(__hexagon__)
   asm("dmlink(%0,%1)"
       :
       : "r"(tailDmaDescriptor), "r"(dmaDescriptor)
       : "memory");
+#else
+  os_host_udma_link(tailDmaDescriptor, dmaDescriptor);
+#endif
 }
 
 inline uint32_t os_udma_poll() {
   uint32_t dm0;
 
+#if defined(__hexagon__)
   asm("%0 = dmpoll" : "=r"(dm0) : : "memory");
+#else
+  dm0 = os_host_udma_poll();
+#endif
   if (isUserDMAError(dm0))
     os_udma_report_error(dm0);
 
@@ -180,13 +295,21 @@ inline uint32_t os_udma_poll() {
 // Others should probably be using os_udma_poll instead.
 inline uint32_t os_udma_poll_nocheck() {
   uint32_t dm0;
+#if defined(__hexagon__)
   asm("%0 = dmpoll" : "=r"(dm0) : : "memory");
+#else
+  dm0 = os_host_udma_poll();
+#endif
   return dm0;
 }
 
 inline uint32_t os_udma_wait() {
   uint32_t dm0;
+#if defined(__hexagon__)
   asm("%0 = dmwait" : "=r"(dm0) : : "memory");
+#else
+  dm0 = os_host_udma_wait();
+#endif
 
   if (isUserDMAError(dm0))
     os_udma_report_error(dm0);
@@ -197,13 +320,29 @@ inline void os_global_memsync() {
   uint32_t sync;
   os_release_allthreads(&sync);
   os_load_acquire(&sync);
+#if defined(__hexagon__)
   asm("syncht" : : : "memory");
+#endif
 }
 
 inline void os_doorbell_local_write4b(nsp_doorbell_t db, uint32_t val) {
   hexagon_atomic_store_nolock4b((uint32_t *)db, val);
 }
 
+// Clears numDBs consecutive 4 byte doorbells, two at a time with doubleword
+// stores once the address is 8 byte aligned.
+inline void os_doorbell_local_clear(nsp_doorbell_t db, int numDBs) {
+  uint32_t *p = (uint32_t *)db;
+  if (numDBs > 0 && ((uintptr_t)p & 0x7)) {
+    hexagon_atomic_store_nolock4b(p++, 0);
+    numDBs--;
+  }
+  for (; numDBs >= 2; numDBs -= 2, p += 2)
+    hexagon_atomic_store_nolock8b((uint64_t *)p, 0);
+  if (numDBs > 0)
+    hexagon_atomic_store_nolock4b(p, 0);
+}
+
 inline uint8_t os_doorbell_read1b(nsp_doorbell_t db) {
   return os_doorbell_read<uint8_t>(db);
 }
@@ -212,9 +351,23 @@ inline uint32_t os_doorbell_read4b_acquire(nsp_doorbell_t db) {
 }
 
 inline uint64_t os_get_system_timestamp() {
+#if defined(__hexagon__)
   uint64_t ts;
   asm volatile("%0=UTIMER" : "=r"(ts));
   return ts;
+#else
+  return os_host_timestamp();
+#endif
+}
+
+inline uint64_t os_get_pcycles() {
+#if defined(__hexagon__)
+  uint64_t pcycles;
+  asm volatile("%0=UPCYCLE" : "=r"(pcycles));
+  return pcycles;
+#else
+  return os_host_timestamp();
+#endif
 }
 
 } // extern "C"
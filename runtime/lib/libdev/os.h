@@ -41,6 +41,7 @@ void os_udma_wait_done(const DMADescriptor *dmaDescriptor, int threadId);
 void debugPrintUdmaDesc(const aic::DMADescriptor *p);
 
 uint64_t os_get_system_timestamp();
+uint64_t os_get_pcycles();
 
 // Debugging
 struct OSTimeoutCheckContext {
@@ -55,6 +56,13 @@ struct OSTimeoutCheckContext {
 
 void os_timeout_check(OSTimeoutCheckContext *timeoutCtx, uint32_t dbval,
                       bool doTimeoutCheck, bool debugLog);
+
+void os_trace_doorbell(nsp_doorbell_t db, int threadId);
+
+#ifdef QAIC_WAIT_STATS
+void os_wait_stats_record(nsp_doorbell_t db, int threadId, uint64_t ticks);
+void os_wait_stats_log(int threadId);
+#endif
 }; // extern "C"
 
 #endif // OS_H
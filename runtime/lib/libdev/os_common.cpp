@@ -109,4 +109,66 @@ void os_timeout_check(OSTimeoutCheckContext *timeoutCtx, uint32_t dbval,
     assert(false && "ctx->errFuncPtr() function call should not have returned");
   }
 }
+
+// Traces that a doorbell the thread blocked on was satisfied. Waits on
+// anything but the program's doorbells, e.g. DMA completion, aren't traced,
+// nor waits of an unknown thread (threadId -1).
+void os_trace_doorbell(nsp_doorbell_t db, int threadId) {
+  if (threadId < 0)
+    return;
+  CoreInfo *ctx = libdev_getcontext();
+  uintptr_t dbNum = ((uintptr_t)db - (uintptr_t)ctx->baseL2TCM) / DB_SIZE;
+  if ((uintptr_t)db < (uintptr_t)ctx->baseL2TCM ||
+      dbNum >= NUM_PROGRAM_DOORBELLS)
+    return;
+  qaic::traceInstant(qaic::TRACE_DOORBELL, dbNum, threadId);
+}
+
+#ifdef QAIC_WAIT_STATS
+// Waits of an unknown thread (threadId -1) aren't counted
+void os_wait_stats_record(nsp_doorbell_t db, int threadId, uint64_t ticks) {
+  if (threadId < 0)
+    return;
+  CoreInfo *ctx = libdev_getcontext();
+  uintptr_t dbNum = ((uintptr_t)db - (uintptr_t)ctx->baseL2TCM) / DB_SIZE;
+  if ((uintptr_t)db < (uintptr_t)ctx->baseL2TCM || dbNum > WAIT_STATS_OTHER)
+    dbNum = WAIT_STATS_OTHER;
+
+  WaitStats *stats = &ctx->waitStats[threadId][dbNum];
+  int bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+  if (bucket >= NUM_WAIT_BUCKETS)
+    bucket = NUM_WAIT_BUCKETS - 1;
+  stats->count++;
+  stats->buckets[bucket]++;
+  stats->totalTicks += ticks;
+}
+
+// Logs the thread's waits by doorbell, with the buffer the doorbell belongs
+// to or -1
+void os_wait_stats_log(int threadId) {
+  CoreInfo *ctx = libdev_getcontext();
+  for (int dbNum = 0; dbNum <= WAIT_STATS_OTHER; dbNum++) {
+    const WaitStats *stats = &ctx->waitStats[threadId][dbNum];
+    if (stats->count == 0)
+      continue;
+    int buffNum = -1;
+    for (int i = 0; i < qaic::_progDesc->numBuffs; i++) {
+      if (qaic::_progBuffers[i].waitDBNum == dbNum)
+        buffNum = i;
+    }
+    DBG_PRINT_INFO("t%d: waits on DB %d (buffer %d): %" PRIu32
+                   " waits, total 0x%" PRIx32 "%08" PRIx32 " ticks",
+                   threadId, dbNum, buffNum, stats->count,
+                   (uint32_t)(stats->totalTicks >> 32),
+                   (uint32_t)stats->totalTicks);
+    for (int i = 0; i < NUM_WAIT_BUCKETS; i++) {
+      if (stats->buckets[i])
+        DBG_PRINT_INFO("t%d: waits on DB %d: %" PRIu32 " under %" PRIu32
+                       " ticks",
+                       threadId, dbNum, stats->buckets[i],
+                       i == NUM_WAIT_BUCKETS - 1 ? UINT32_MAX : 1U << i);
+    }
+  }
+}
+#endif
 } // extern "C"
@@ -0,0 +1,40 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+// Host counterpart of os_hexagon.cpp, used when building the runtime for the
+// device emulator.
+
+#include "os.h"
+
+#include "../AICDefsInternal.h"
+#include "libdev_assert.h"
+#include "os-inlines.h"
+#include "os_host.h"
+
+using namespace aic;
+
+void os_udma_report_error(uint32_t dm0) {
+  assert(isUserDMAError(dm0));
+  DBG_PRINT_INFO("User DMA error!");
+  DBG_PRINT_INFO("DM0: %" PRIu32, dm0);
+
+  const DMADescriptor *desc = (const DMADescriptor *)(uintptr_t)(dm0 & 0xfffffff0);
+  debugPrintUdmaDesc(desc);
+
+  ERR_FATAL(libdev_getcontext()->errFuncPtr, "Halting due to UDMA error", 0, 0,
+            0);
+}
+
+extern "C" {
+
+void os_hostsem_inc(hostsem_t s, uint32_t semNum) {
+  assert(s && "hostsem==nullptr");
+  os_host_hostsem_command(s, OS_HOST_SEMOP_INC, semNum, 0);
+}
+
+void os_hostsem_dec(hostsem_t s, uint32_t semNum) {
+  assert(s && "hostsem==nullptr");
+  os_host_hostsem_command(s, OS_HOST_SEMOP_DEC, semNum, 0);
+}
+
+}; // extern "C"
@@ -0,0 +1,57 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#ifndef OS_HOST_H
+#define OS_HOST_H
+
+// Hooks used by the host (non-Hexagon) build of the runtime in place of the
+// Hexagon instructions in os-inlines.h and the GSM/UDMA hardware accesses in
+// os_hexagon.cpp.  They are implemented by the device emulator
+// (runtime/emulator), which provides the emulated TCMs, shared DDR, host
+// semaphores and the UDMA engine.
+
+#include "../AICDefsInternal.h"
+#include <stdint.h>
+
+extern "C" {
+
+// Index of the emulated NSP the calling thread belongs to.
+int os_host_nsp_index();
+
+// Queue the descriptor chain starting at desc on the calling thread's UDMA
+// queue.  tail is the previous tail of the queue and is only used for
+// validation since the emulated engine walks each chain until next == 0.
+void os_host_udma_link(aic::DMADescriptor *tail, aic::DMADescriptor *desc);
+
+// Returns a DM0 style status word for the calling thread's UDMA queue.
+uint32_t os_host_udma_poll();
+
+// Blocks until the calling thread's UDMA queue is idle and returns DM0.
+uint32_t os_host_udma_wait();
+
+// GSM semaphore commands, same encoding as os_hexagon.cpp.
+enum {
+  OS_HOST_SEMOP_NOP = 0,
+  OS_HOST_SEMOP_INIT = 1,
+  OS_HOST_SEMOP_INC = 2,
+  OS_HOST_SEMOP_DEC = 3,
+};
+
+// Execute a GSM semaphore command.
+void os_host_hostsem_command(void *s, uint8_t op, uint8_t semNum,
+                             uint16_t semVal);
+
+// Yield the calling thread, sleepCount has the same meaning as the Hexagon
+// pause instruction argument.
+void os_host_pause(int sleepCount);
+
+// UTIMER equivalent, in UTimerFreqMS ticks per millisecond.
+uint64_t os_host_timestamp();
+
+// Called by _qaic_start once a thread has returned from activate() and is
+// about to wait for the exit doorbell.
+void os_host_thread_finished(uint8_t virtualThreadId);
+
+} // extern "C"
+
+#endif // OS_HOST_H
@@ -0,0 +1,43 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+// Writes the constants.bin that qaic-cc -save-temps produces for a program
+// config, so the emulator tests don't need the hexagon toolchain. The
+// emulator doesn't use the entry point address in the metadata.
+
+#include <fstream>
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "program/Program.h"
+#include "program/ProgramConfig.h"
+
+using namespace qaic;
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    llvm::errs() << "Usage: " << argv[0] << " <config.json> <constants.bin>\n";
+    return 1;
+  }
+
+  ProgramConfig config;
+  if (!config.loadFromFile(argv[1])) {
+    llvm::errs() << "Unable to load " << argv[1] << "\n";
+    return 1;
+  }
+  ComputeProgram program{std::move(config)};
+  ProgramConstants constants;
+  if (!program.generateMetadata(&constants)) {
+    llvm::errs() << "Unable to generate the constants for " << argv[1] << "\n";
+    return 1;
+  }
+
+  std::ofstream file(argv[2], std::ios::binary);
+  file.write((const char *)constants.constants.data(),
+             constants.constants.size());
+  if (!file) {
+    llvm::errs() << "Unable to write " << argv[2] << "\n";
+    return 1;
+  }
+  return 0;
+}
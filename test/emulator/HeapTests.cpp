@@ -0,0 +1,192 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+// Exercises the network heap allocator from every thread: alignment and
+// size classes, refilling and flushing the thread caches, first-fit reuse of
+// large blocks, freeing on another thread and running out of heap. Run with
+// --heap-size matching heap.json.
+
+#include "AICMetadataExecCtx.h"
+#include "ComputeAPI.h"
+#include "Heap.h"
+
+using namespace qaic;
+
+extern "C" {
+void activate(void *ctx, uint8_t virtualThreadId, uint32_t stid);
+}
+
+namespace {
+const int NUM_THREADS = 4;
+const uint32_t HEAP_SIZE = 4 << 20;
+
+nnc_err_fatal_fp errFatal;
+
+#define CHECK(cond, fmt, a, b)                                                 \
+  do {                                                                         \
+    if (!(cond))                                                               \
+      ERR_FATAL(errFatal, "Heap check failed: " fmt, (uintptr_t)(a),         \
+                (uintptr_t)(b), 0);                                            \
+  } while (0)
+
+void fill(void *ptr, uint32_t size, uint8_t value) {
+  for (uint32_t i = 0; i < size; i++)
+    ((uint8_t *)ptr)[i] = value;
+}
+
+bool isFilled(const void *ptr, uint32_t size, uint8_t value) {
+  for (uint32_t i = 0; i < size; i++) {
+    if (((const uint8_t *)ptr)[i] != value)
+      return false;
+  }
+  return true;
+}
+
+// Every size class and a large block, all live at once so they must not
+// overlap
+void testSizeClasses(int threadId) {
+  const uint32_t sizes[] = {1,    16,   48,    49,    100,   200,  500,
+                            1000, 2000, 4000,  8000,  16000, 32000, 65520,
+                            65521, 100000};
+  const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+  void *ptrs[numSizes];
+  for (int i = 0; i < numSizes; i++) {
+    ptrs[i] = malloc(sizes[i], threadId);
+    CHECK(ptrs[i], "malloc(%d) on thread %d", sizes[i], threadId);
+    CHECK((uintptr_t)ptrs[i] % HEAP_ALIGNMENT == 0,
+          "malloc(%d) returned unaligned 0x%x", sizes[i], ptrs[i]);
+    fill(ptrs[i], sizes[i], threadId * numSizes + i);
+  }
+  for (int i = 0; i < numSizes; i++) {
+    CHECK(isFilled(ptrs[i], sizes[i], threadId * numSizes + i),
+          "Block of malloc(%d) on thread %d was overwritten", sizes[i],
+          threadId);
+    free(ptrs[i], threadId);
+  }
+
+  // The thread cache hands back the block freed last
+  void *p = malloc(100, threadId);
+  free(p, threadId);
+  CHECK(malloc(100, threadId) == p, "Freed block 0x%x not reused on thread %d",
+        p, threadId);
+  free(p, threadId);
+}
+
+// Takes more blocks of a size class than the thread cache holds, so the cache
+// is refilled and flushed several times. The class is only used by this
+// thread while the others run this too, so the blocks taken again must be
+// the same ones.
+void testThreadCache(int threadId) {
+  const int numBlocks = 3 * HEAP_THREAD_CACHE_SIZE;
+  const uint32_t size = (128U << threadId) - 16;
+  void *ptrs[numBlocks];
+  for (int i = 0; i < numBlocks; i++) {
+    ptrs[i] = malloc(size, threadId);
+    CHECK(ptrs[i], "malloc(%d) on thread %d", size, threadId);
+    fill(ptrs[i], size, i);
+  }
+  for (int i = 0; i < numBlocks; i++) {
+    CHECK(isFilled(ptrs[i], size, i), "Block %d on thread %d was overwritten",
+          i, threadId);
+    free(ptrs[i], threadId);
+  }
+  void *again[numBlocks];
+  for (int i = 0; i < numBlocks; i++) {
+    again[i] = malloc(size, threadId);
+    bool reused = false;
+    for (int j = 0; j < numBlocks; j++)
+      reused |= again[i] == ptrs[j];
+    CHECK(reused, "Block 0x%x on thread %d is new, not reused", again[i],
+          threadId);
+  }
+  for (int i = 0; i < numBlocks; i++)
+    free(again[i], threadId);
+}
+
+// Large blocks are reused first fit from a list shared by the threads, so
+// only thread 0 runs this
+void testLargeBlocks(int threadId) {
+  // Above the biggest size class
+  const uint32_t minSize = (64 << 10) - 16 + 1;
+  void *a = malloc(3 * minSize, threadId);
+  void *b = malloc(minSize, threadId);
+  CHECK(a && b, "Large malloc failed 0x%x 0x%x", a, b);
+  free(a, threadId);
+  // Doesn't fit in a
+  void *c = malloc(4 * minSize, threadId);
+  CHECK(c && c != a, "malloc(%d) reused the block of %d", 4 * minSize,
+        3 * minSize);
+  // Fits in a, the large block freed last
+  void *d = malloc(2 * minSize, threadId);
+  CHECK(d == a, "malloc(%d) got 0x%x instead", 2 * minSize, d);
+  free(b, threadId);
+  free(c, threadId);
+  free(d, threadId);
+}
+
+void *crossThreadBlocks[NUM_THREADS];
+
+// Blocks can be freed by another thread of the NSP, into its cache
+void testCrossThreadFree(int threadId) {
+  crossThreadBlocks[threadId] = malloc(200, threadId);
+  CHECK(crossThreadBlocks[threadId], "malloc(200) on thread %d", threadId, 0);
+  fill(crossThreadBlocks[threadId], 200, threadId);
+  threadBarrier();
+
+  int from = (threadId + 1) % NUM_THREADS;
+  void *p = crossThreadBlocks[from];
+  CHECK(isFilled(p, 200, from), "Block of thread %d seen by thread %d", from,
+        threadId);
+  free(p, threadId);
+  CHECK(malloc(200, threadId) == p,
+        "Block freed by thread %d not reused, from thread %d", threadId, from);
+  free(p, threadId);
+  threadBarrier();
+}
+
+// Takes large blocks until the heap runs out, then frees them and takes
+// them again. Only thread 0 runs this.
+void testExhaustion(int threadId) {
+  CHECK(malloc(UINT32_MAX, threadId) == nullptr, "malloc(UINT32_MAX)", 0, 0);
+  CHECK(malloc(HEAP_SIZE, threadId) == nullptr, "malloc(%d)", HEAP_SIZE, 0);
+
+  const uint32_t size = 64 * 1024;
+  const int maxBlocks = HEAP_SIZE / size;
+  void *ptrs[maxBlocks];
+  int numBlocks = 0;
+  while (numBlocks < maxBlocks &&
+         (ptrs[numBlocks] = malloc(size, threadId)) != nullptr)
+    numBlocks++;
+  CHECK(numBlocks > 0 && numBlocks < maxBlocks,
+        "%d blocks of %d fit in the heap", numBlocks, size);
+
+  for (int i = 0; i < numBlocks; i++)
+    free(ptrs[i], threadId);
+  for (int i = 0; i < numBlocks; i++) {
+    ptrs[i] = malloc(size, threadId);
+    CHECK(ptrs[i], "Freed block %d of %d not reused", i, numBlocks);
+  }
+  CHECK(malloc(size, threadId) == nullptr, "Heap grew after %d blocks",
+        numBlocks, 0);
+  for (int i = 0; i < numBlocks; i++)
+    free(ptrs[i], threadId);
+}
+} // namespace
+
+void activate(void *ctx, uint8_t virtualThreadId, uint32_t stid) {
+  AICExecContext *qctx = (AICExecContext *)ctx;
+  errFatal = qctx->errFuncPtr;
+
+  testSizeClasses(virtualThreadId);
+  threadBarrier();
+  testThreadCache(virtualThreadId);
+  threadBarrier();
+  if (virtualThreadId == 0)
+    testLargeBlocks(virtualThreadId);
+  threadBarrier();
+  testCrossThreadFree(virtualThreadId);
+  if (virtualThreadId == 0) {
+    testExhaustion(virtualThreadId);
+    NN_LOG(qctx->logFuncPtr, NNC_LOG_MASK_INFO, "Heap tests passed");
+  }
+}
@@ -0,0 +1,94 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+// Checks threadBarrier orders the writes of every thread, and that
+// parallelFor runs every iteration exactly once in tiles of at most chunk
+// iterations, including empty ranges and ranges ending at INT_MAX.
+
+#include "AICMetadataExecCtx.h"
+#include "ComputeAPI.h"
+
+#include <limits.h>
+
+using namespace qaic;
+
+extern "C" {
+void activate(void *ctx, uint8_t virtualThreadId, uint32_t stid);
+}
+
+namespace {
+const int NUM_THREADS = 6;
+const int NUM_BARRIER_ROUNDS = 100;
+const int MAX_ITERATIONS = 1000;
+
+uint32_t barrierSlots[NUM_THREADS];
+uint32_t hits[MAX_ITERATIONS];
+uint32_t badTiles;
+
+void testBarrier(AICExecContext *qctx, int threadId) {
+  for (int round = 1; round <= NUM_BARRIER_ROUNDS; round++) {
+    __atomic_store_n(&barrierSlots[threadId], round, __ATOMIC_RELAXED);
+    threadBarrier();
+    for (int t = 0; t < NUM_THREADS; t++) {
+      uint32_t slot = __atomic_load_n(&barrierSlots[t], __ATOMIC_RELAXED);
+      if (slot != (uint32_t)round)
+        ERR_FATAL(qctx->errFuncPtr,
+                  "Round %d: the slot of thread %d is %d after the barrier",
+                  round, t, slot);
+    }
+    // Nobody writes the next round before everyone has checked this one
+    threadBarrier();
+  }
+}
+
+void testParallelFor(AICExecContext *qctx, int threadId, int begin, int end,
+                     int chunk) {
+  parallelFor(begin, end, chunk, [begin, end, chunk](int tileBegin,
+                                                     int tileEnd) {
+    if (tileBegin < begin || tileEnd > end || tileBegin >= tileEnd ||
+        (int64_t)tileEnd - tileBegin > chunk) {
+      atomicFetchAdd(&badTiles, 1);
+      return;
+    }
+    for (int i = tileBegin; i < tileEnd; i++)
+      atomicFetchAdd(&hits[(int64_t)i - begin], 1);
+  });
+
+  if (threadId == 0) {
+    int count = end > begin ? (int)((int64_t)end - begin) : 0;
+    for (int i = 0; i < MAX_ITERATIONS; i++) {
+      uint32_t expected = i < count ? 1 : 0;
+      if (hits[i] != expected)
+        ERR_FATAL(qctx->errFuncPtr,
+                  "parallelFor from %d: iteration %d ran %d times", begin,
+                  i, hits[i]);
+      hits[i] = 0;
+    }
+    if (badTiles)
+      ERR_FATAL(qctx->errFuncPtr, "parallelFor from %d to %d: %d bad tiles",
+                begin, end, badTiles);
+  }
+  threadBarrier();
+}
+} // namespace
+
+void activate(void *ctx, uint8_t virtualThreadId, uint32_t stid) {
+  AICExecContext *qctx = (AICExecContext *)ctx;
+
+  testBarrier(qctx, virtualThreadId);
+
+  testParallelFor(qctx, virtualThreadId, 0, MAX_ITERATIONS, 7);
+  testParallelFor(qctx, virtualThreadId, -50, 50, 1);
+  // A single tile
+  testParallelFor(qctx, virtualThreadId, INT_MIN, INT_MIN + 64, 1000);
+  // Empty ranges
+  testParallelFor(qctx, virtualThreadId, 5, 5, 3);
+  testParallelFor(qctx, virtualThreadId, 10, 3, 2);
+  // The tiles taken past the end would overflow an int
+  testParallelFor(qctx, virtualThreadId, INT_MAX - 100, INT_MAX, 16);
+  testParallelFor(qctx, virtualThreadId, INT_MAX - MAX_ITERATIONS, INT_MAX,
+                  INT_MAX);
+
+  if (virtualThreadId == 0)
+    NN_LOG(qctx->logFuncPtr, NNC_LOG_MASK_INFO, "Parallel tests passed");
+}
@@ -0,0 +1,40 @@
+# Runs a program under the device emulator and compares the outputs of its
+# first inference with the expected files. Lists are comma separated.
+#
+#   cmake -DCONSTANTS_GEN=<EmulatorConstants> -DCONFIG=<program config>
+#         -DPROGRAM=<emulator executable> -DWORK_DIR=<scratch directory>
+#         [-DARGS=<emulator args>] [-DINPUTS=<input files>]
+#         [-DEXPECTED_OUTPUTS=<output files>] -P RunEmulatorTest.cmake
+
+foreach(var CONSTANTS_GEN CONFIG PROGRAM WORK_DIR ARGS INPUTS EXPECTED_OUTPUTS)
+  string(REPLACE "," ";" ${var} "${${var}}")
+endforeach()
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR}/output)
+
+execute_process(COMMAND ${CONSTANTS_GEN} ${CONFIG} ${WORK_DIR}/constants.bin
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "Unable to generate the constants for ${CONFIG}")
+endif()
+
+set(emulator_args ${WORK_DIR}/constants.bin -o ${WORK_DIR}/output ${ARGS})
+foreach(input ${INPUTS})
+  list(APPEND emulator_args -i ${input})
+endforeach()
+execute_process(COMMAND ${PROGRAM} ${emulator_args} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${PROGRAM} failed with ${result}")
+endif()
+
+set(output_num 0)
+foreach(expected ${EXPECTED_OUTPUTS})
+  set(output ${WORK_DIR}/output/outputBuff_${output_num}-activation-0-inf-0.bin)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${output} ${expected}
+                  RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${output} doesn't match ${expected}")
+  endif()
+  math(EXPR output_num "${output_num} + 1")
+endforeach()
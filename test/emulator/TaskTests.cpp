@@ -0,0 +1,96 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+// Runs trees of nested tasks across the HVX, HMX and ANY affinities with the
+// work-stealing scheduler and checks every task runs exactly once, on a
+// thread with its affinity. tasks.json has 4 HVX and 2 HMX threads.
+
+#include "AICMetadataExecCtx.h"
+#include "ComputeAPI.h"
+
+using namespace qaic;
+
+extern "C" {
+void activate(void *ctx, uint8_t virtualThreadId, uint32_t stid);
+}
+
+namespace {
+const int NUM_THREADS = 6;
+const int NUM_HVX_THREADS = 4;
+const int NUM_ROUNDS = 2;
+// Each thread spawns TREES_PER_THREAD trees before runTasks. Tasks are the
+// nodes of full binary trees of TREE_NODES nodes, numbered 1 to TREE_NODES
+// like a heap, and spawn their children.
+const int TREES_PER_THREAD = 4;
+const int TREE_NODES = 31;
+const int NUM_TREES = NUM_THREADS * TREES_PER_THREAD;
+
+uint32_t runCounts[NUM_TREES * (TREE_NODES + 1)];
+uint32_t wrongAffinity;
+uint32_t spawnFailures;
+
+// TaskFn has no thread argument
+thread_local int currentThreadId;
+
+TaskAffinity taskAffinity(uint32_t id) {
+  const TaskAffinity affinities[] = {TASK_ANY, TASK_HVX, TASK_HMX};
+  return affinities[id % 3];
+}
+
+void task(void *arg);
+
+void spawn(uint32_t id) {
+  if (!spawnTask(currentThreadId, task, (void *)(uintptr_t)id,
+                 taskAffinity(id)))
+    atomicFetchAdd(&spawnFailures, 1);
+}
+
+void task(void *arg) {
+  uint32_t id = (uintptr_t)arg;
+  atomicFetchAdd(&runCounts[id], 1);
+
+  bool isHMX = currentThreadId >= NUM_HVX_THREADS;
+  TaskAffinity affinity = taskAffinity(id);
+  if ((affinity == TASK_HVX && isHMX) || (affinity == TASK_HMX && !isHMX))
+    atomicFetchAdd(&wrongAffinity, 1);
+
+  uint32_t tree = id / (TREE_NODES + 1);
+  uint32_t node = id % (TREE_NODES + 1);
+  if (2 * node + 1 <= TREE_NODES) {
+    spawn(tree * (TREE_NODES + 1) + 2 * node);
+    spawn(tree * (TREE_NODES + 1) + 2 * node + 1);
+  }
+}
+} // namespace
+
+void activate(void *ctx, uint8_t virtualThreadId, uint32_t stid) {
+  AICExecContext *qctx = (AICExecContext *)ctx;
+  currentThreadId = virtualThreadId;
+
+  for (int round = 0; round < NUM_ROUNDS; round++) {
+    for (int i = 0; i < TREES_PER_THREAD; i++)
+      spawn((virtualThreadId * TREES_PER_THREAD + i) * (TREE_NODES + 1) + 1);
+    runTasks(virtualThreadId);
+
+    if (virtualThreadId == 0) {
+      for (int tree = 0; tree < NUM_TREES; tree++) {
+        for (int node = 1; node <= TREE_NODES; node++) {
+          uint32_t &count = runCounts[tree * (TREE_NODES + 1) + node];
+          if (count != 1)
+            ERR_FATAL(qctx->errFuncPtr, "Tree %d node %d ran %d times", tree,
+                      node, count);
+          count = 0;
+        }
+      }
+      if (wrongAffinity || spawnFailures)
+        ERR_FATAL(qctx->errFuncPtr,
+                  "Round %d: %d tasks ran without their affinity, %d spawns "
+                  "failed",
+                  round, wrongAffinity, spawnFailures);
+      NN_LOG(qctx->logFuncPtr, NNC_LOG_MASK_INFO, "Round %d ran %d tasks",
+             round, NUM_TREES * TREE_NODES);
+    }
+    // The next round's tasks start once the counts are reset
+    threadBarrier();
+  }
+}
@@ -0,0 +1,83 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <thread>
+
+#include "toolchain/CompileCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+using namespace qaic;
+
+static void writeFile(const std::string &path, const std::string &data) {
+  std::ofstream f(path, std::ios::binary);
+  f << data;
+}
+
+static std::string readFile(const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(f),
+                     std::istreambuf_iterator<char>());
+}
+
+TEST(Toolchain, CompileCache_ComputeKey) {
+  auto key = CompileCache::computeKey({"clang", "-O2", "int x;"});
+  EXPECT_EQ(32, key.size());
+  EXPECT_EQ(key, CompileCache::computeKey({"clang", "-O2", "int x;"}));
+  EXPECT_NE(key, CompileCache::computeKey({"clang", "-O3", "int x;"}));
+  // Moving bytes between inputs changes the key
+  EXPECT_NE(CompileCache::computeKey({"ab", "c"}),
+            CompileCache::computeKey({"a", "bc"}));
+}
+
+TEST(Toolchain, CompileCache_StoreLookup) {
+  llvm::SmallString<128> dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("compile-cache", dir));
+  CompileCache cache(dir);
+
+  std::string object = (dir + "/object.o").str();
+  std::string output = (dir + "/output.o").str();
+  writeFile(object, "object data");
+
+  auto key = CompileCache::computeKey({"object"});
+  EXPECT_FALSE(cache.lookup(key, output));
+  ASSERT_TRUE(cache.store(key, object));
+  ASSERT_TRUE(cache.lookup(key, output));
+  EXPECT_EQ("object data", readFile(output));
+
+  llvm::sys::fs::remove_directories(dir);
+}
+
+TEST(Toolchain, CompileCache_Prune) {
+  llvm::SmallString<128> dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("compile-cache", dir));
+  llvm::SmallString<128> cacheDir(dir);
+  llvm::sys::path::append(cacheDir, "cache");
+  CompileCache cache(cacheDir, 1500);
+
+  std::string object = (dir + "/object.o").str();
+  writeFile(object, std::string(1000, 'x'));
+  std::vector<std::string> keys;
+  for (auto name : {"a", "b", "c"}) {
+    keys.push_back(CompileCache::computeKey({name}));
+    ASSERT_TRUE(cache.store(keys.back(), object));
+  }
+
+  // Make "a" the most recently used entry so "b" and "c" are pruned first
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::string output = (dir + "/output.o").str();
+  ASSERT_TRUE(cache.lookup(keys[0], output));
+
+  EXPECT_EQ(2000, cache.prune());
+  EXPECT_TRUE(cache.lookup(keys[0], output));
+  EXPECT_FALSE(cache.lookup(keys[1], output));
+  EXPECT_FALSE(cache.lookup(keys[2], output));
+  EXPECT_EQ(0, cache.prune());
+
+  llvm::sys::fs::remove_directories(dir);
+}
@@ -31,3 +31,14 @@ TEST(Toolchain, Compiler_HexagonProcConfigGetCommandLineArgs) {
     llvm::errs() << a << "\n";
   }
 }
+
+TEST(Toolchain, Compiler_IsSourceFile) {
+  EXPECT_TRUE(Compiler::isSourceFile("foo.c"));
+  EXPECT_TRUE(Compiler::isSourceFile("dir/foo.cpp"));
+  EXPECT_TRUE(Compiler::isSourceFile("foo.CC"));
+  EXPECT_TRUE(Compiler::isSourceFile("foo.cxx"));
+  EXPECT_TRUE(Compiler::isSourceFile("foo.s"));
+  EXPECT_FALSE(Compiler::isSourceFile("foo.o"));
+  EXPECT_FALSE(Compiler::isSourceFile("libfoo.a"));
+  EXPECT_FALSE(Compiler::isSourceFile("foo"));
+}
@@ -3,10 +3,15 @@
 
 #include "metadataflatbufDecode.hpp"
 #include <fstream>
+#include <functional>
 #include <gtest/gtest.h>
+#include <set>
 
 #include "program/Program.h"
 #include "program/ProgramConfig.h"
+#include "../../runtime/lib/AICDefsInternal.h"
+#include "../../runtime/lib/SerializedProgramDesc.h"
+#include "../../runtime/lib/Trace.h"
 
 #include "llvm/Support/Debug.h"
 
@@ -87,6 +92,246 @@ TEST(Program, ComputeProgram_GenerateMetadata) {
   AICMetadata_dump(metaPtr, stdout);
 }
 
+// The constants of test_program.json, as changed by mutate
+struct GeneratedConstants {
+  ProgramConstants constants;
+  const SerializedProgramDesc_t *progDesc{nullptr};
+  const BufferDesc_t *buffers{nullptr};
+
+  template <typename T> const T *at(uint32_t offset) const {
+    return reinterpret_cast<const T *>(&constants.constants[offset]);
+  }
+};
+
+static GeneratedConstants generateConstants(
+    std::function<void(aicnwdesc::ProgramConfig &)> mutate = nullptr) {
+  GeneratedConstants result;
+  ProgramConfig config;
+  if (!config.loadFromFile("test_program.json")) {
+    ADD_FAILURE() << "Unable to load test_program.json";
+    return result;
+  }
+  if (mutate)
+    mutate(config.get());
+  ComputeProgram program{std::move(config)};
+
+  program.setEntrypointAddr(0xd00d7110);
+  if (!program.generateMetadata(&result.constants) ||
+      result.constants.constants.size() < sizeof(SerializedProgramDesc_t)) {
+    ADD_FAILURE() << "Unable to generate the constants";
+    return result;
+  }
+  result.progDesc = result.at<SerializedProgramDesc_t>(0);
+  result.buffers = result.at<BufferDesc_t>(result.progDesc->buffersOffset);
+  return result;
+}
+
+TEST(Program, ComputeProgram_GenerateConstants) {
+  auto generated = generateConstants();
+  ASSERT_NE(nullptr, generated.progDesc);
+  const ProgramConstants &constants = generated.constants;
+
+  ASSERT_EQ(sizeof(AICConstantDescriptor), constants.constantsDesc.size());
+  auto constDesc = reinterpret_cast<const AICConstantDescriptor *>(
+      &constants.constantsDesc[0]);
+  EXPECT_EQ(constants.constants.size(), constDesc->staticConstantsSize);
+  EXPECT_EQ(0, constDesc->dynamicConstantsSize);
+}
+
+TEST(Program, ComputeProgram_InputSlots) {
+  auto generated = generateConstants([](aicnwdesc::ProgramConfig &config) {
+    config.set_numinputslots(2);
+  });
+  ASSERT_NE(nullptr, generated.progDesc);
+  auto progDesc = generated.progDesc;
+  EXPECT_EQ(2, progDesc->numInputSlots);
+  EXPECT_EQ(3, progDesc->inputSlotsBuffNum);
+  // 2 inputs, 1 output, 2 slots of 2 inputs and the UDMA descriptors
+  ASSERT_EQ(8, progDesc->numBuffs);
+
+  auto buffers = generated.buffers;
+  std::set<std::pair<int, uint32_t>> offsets;
+  for (int slot = 0; slot < 2; slot++) {
+    for (int i = 0; i < 2; i++) {
+      const BufferDesc_t &input = buffers[i];
+      const BufferDesc_t &slotBuff = buffers[3 + slot * 2 + i];
+      EXPECT_EQ(input.location, slotBuff.location);
+      EXPECT_EQ(input.size, slotBuff.size);
+      EXPECT_EQ(input.nspMask, slotBuff.nspMask);
+      EXPECT_EQ(USAGE_INTERNAL, slotBuff.usage);
+      EXPECT_EQ(0, slotBuff.offset % 4096);
+      EXPECT_GE(slotBuff.offset, input.offset + input.size);
+      EXPECT_TRUE(offsets.insert({slotBuff.location, slotBuff.offset}).second);
+    }
+  }
+}
+
+TEST(Program, ComputeProgram_IOGroups) {
+  auto generated = generateConstants([](aicnwdesc::ProgramConfig &config) {
+    config.mutable_inputs(1)->set_iogroup(1);
+  });
+  ASSERT_NE(nullptr, generated.progDesc);
+  auto progDesc = generated.progDesc;
+  ASSERT_EQ(2, progDesc->numIOGroups);
+  ASSERT_LE(progDesc->ioGroupsOffset + 2 * sizeof(IOGroupDesc_t),
+            generated.constants.constants.size());
+  auto buffers = generated.buffers;
+  EXPECT_EQ(0, buffers[0].ioGroup);
+  EXPECT_EQ(1, buffers[1].ioGroup);
+  EXPECT_EQ(0, buffers[2].ioGroup);
+
+  auto ioGroups = generated.at<IOGroupDesc_t>(progDesc->ioGroupsOffset);
+  EXPECT_EQ(progDesc->inputSem, ioGroups[0].inputSem);
+  EXPECT_EQ(progDesc->outputSem, ioGroups[0].outputSem);
+  EXPECT_NE(ioGroups[0].inputSem, ioGroups[1].inputSem);
+  EXPECT_NE(ioGroups[0].outputSem, ioGroups[1].outputSem);
+  EXPECT_EQ(0x3fff, ioGroups[0].hasInputsMask);
+  EXPECT_EQ(0x3fff, ioGroups[0].hasOutputsMask);
+  EXPECT_EQ(0x3fff, ioGroups[1].hasInputsMask);
+  EXPECT_EQ(0, ioGroups[1].hasOutputsMask);
+
+  // Inputs by group, then outputs by group
+  EXPECT_EQ(0, ioGroups[0].firstInputDB);
+  EXPECT_EQ(1, ioGroups[0].numInputDBs);
+  EXPECT_EQ(1, ioGroups[1].firstInputDB);
+  EXPECT_EQ(1, ioGroups[1].numInputDBs);
+  EXPECT_EQ(2, ioGroups[0].firstOutputDB);
+  EXPECT_EQ(1, ioGroups[0].numOutputDBs);
+  EXPECT_EQ(0, ioGroups[1].numOutputDBs);
+
+  ASSERT_LE(progDesc->ioDoorbellsOffset + 3 * sizeof(IODoorbell_t),
+            generated.constants.constants.size());
+  auto ioDoorbells = generated.at<IODoorbell_t>(progDesc->ioDoorbellsOffset);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(i, ioDoorbells[i].buffNum);
+    EXPECT_EQ(buffers[i].waitDBNum, ioDoorbells[i].dbNum);
+    EXPECT_EQ(buffers[i].waitDBVal, ioDoorbells[i].dbVal);
+  }
+  EXPECT_TRUE(progDesc->ioDoorbellFlags & IO_DOORBELLS_CONTIGUOUS);
+}
+
+TEST(Program, ComputeProgram_IODoorbellLayout) {
+  auto generated = generateConstants([](aicnwdesc::ProgramConfig &config) {
+    config.mutable_inputs(0)->set_iogroup(1);
+  });
+  ASSERT_NE(nullptr, generated.progDesc);
+
+  // Input DBs are numbered by I/O group, not in buffer order
+  auto buffers = generated.buffers;
+  EXPECT_EQ(1, buffers[0].waitDBNum);
+  EXPECT_EQ(0, buffers[1].waitDBNum);
+  EXPECT_EQ(2, buffers[2].waitDBNum);
+  EXPECT_TRUE(generated.progDesc->ioDoorbellFlags & IO_DOORBELLS_CONTIGUOUS);
+}
+
+TEST(Program, ComputeProgram_TaskDeques) {
+  auto generated = generateConstants([](aicnwdesc::ProgramConfig &config) {
+    config.set_numthreads(2);
+    config.set_numhmxthreads(1);
+    config.set_taskdequesize(20);
+  });
+  ASSERT_NE(nullptr, generated.progDesc);
+  auto progDesc = generated.progDesc;
+  EXPECT_EQ(1, progDesc->numHvxThreads);
+  // Rounded up to a power of 2 of tasks
+  EXPECT_EQ(CACHE_LINE_SIZE + 32 * TASK_DESC_SIZE, progDesc->taskDequeSize);
+  const BufferDesc_t &udmaBuff = generated.buffers[progDesc->udmaDescBuffNum];
+  const BufferDesc_t &taskBuff =
+      generated.buffers[progDesc->taskDequesBuffNum];
+  EXPECT_EQ(L2TCM, taskBuff.location);
+  EXPECT_EQ(USAGE_INTERNAL, taskBuff.usage);
+  EXPECT_EQ(udmaBuff.offset + udmaBuff.size, taskBuff.offset);
+  EXPECT_EQ(2 * NUM_TASK_AFFINITIES * progDesc->taskDequeSize, taskBuff.size);
+}
+
+TEST(Program, ComputeProgram_NSPCollectives) {
+  auto generated = generateConstants([](aicnwdesc::ProgramConfig &config) {
+    config.set_nspcollectives(true);
+    config.set_allreducesize(100);
+  });
+  ASSERT_NE(nullptr, generated.progDesc);
+  auto progDesc = generated.progDesc;
+  EXPECT_EQ(14, progDesc->numCollectiveNSPs);
+  // After the doorbells of the 3 I/O buffers
+  EXPECT_EQ(3, progDesc->nspBarrierDB);
+  EXPECT_EQ(3 + 14, progDesc->allReduceDB);
+  EXPECT_EQ(128, progDesc->allReduceSize);
+
+  const BufferDesc_t &reduceBuff =
+      generated.buffers[progDesc->allReduceBuffNum];
+  EXPECT_EQ(VTCM, reduceBuff.location);
+  EXPECT_EQ(USAGE_INTERNAL, reduceBuff.usage);
+  EXPECT_EQ(0x3fff, reduceBuff.nspMask);
+  EXPECT_EQ(2 * 14 * 128, reduceBuff.size);
+  EXPECT_EQ(3 + 2 * 14, reduceBuff.waitDBNum);
+}
+
+TEST(Program, ComputeProgram_Arenas) {
+  auto generated = generateConstants([](aicnwdesc::ProgramConfig &config) {
+    config.set_vtcmarenasize(64 * 1024);
+    config.set_l2tcmarenasize(8 * 1024);
+  });
+  ASSERT_NE(nullptr, generated.progDesc);
+  auto progDesc = generated.progDesc;
+  EXPECT_EQ(64 * 1024, progDesc->vtcmArenaSize);
+  EXPECT_EQ(8 * 1024, progDesc->l2tcmArenaSize);
+  EXPECT_EQ(0, progDesc->vtcmArenaOffset % 4096);
+  EXPECT_EQ(0, progDesc->l2tcmArenaOffset % 4096);
+
+  // The arenas follow every buffer
+  auto buffers = generated.buffers;
+  for (int i = 0; i < progDesc->numBuffs; i++) {
+    if (buffers[i].location == VTCM)
+      EXPECT_LE(buffers[i].offset + buffers[i].size,
+                progDesc->vtcmArenaOffset);
+    else if (buffers[i].location == L2TCM)
+      EXPECT_LE(buffers[i].offset + buffers[i].size,
+                progDesc->l2tcmArenaOffset);
+  }
+}
+
+TEST(Program, ComputeProgram_TraceRings) {
+  uint32_t numNsps = 0;
+  auto generated =
+      generateConstants([&numNsps](aicnwdesc::ProgramConfig &config) {
+        config.set_traceentries(100);
+        numNsps = config.numnsps();
+      });
+  ASSERT_NE(nullptr, generated.progDesc);
+  auto progDesc = generated.progDesc;
+  EXPECT_EQ(TRACE_BACKEND_RING, progDesc->traceBackend);
+  // Rounded up to a power of 2
+  EXPECT_EQ(128, progDesc->traceEntries);
+
+  // A ring per thread of each NSP, after the other DDR buffers
+  auto buffers = generated.buffers;
+  const BufferDesc_t &traceBuff = buffers[progDesc->traceBuffNum];
+  EXPECT_EQ(DDR, traceBuff.location);
+  EXPECT_EQ(numNsps * progDesc->numThreads * traceRingSize(128),
+            traceBuff.size);
+  EXPECT_EQ(0, traceBuff.offset % CACHE_LINE_SIZE);
+  for (int i = 0; i < progDesc->numBuffs; i++) {
+    if (i != (int)progDesc->traceBuffNum && buffers[i].location == DDR)
+      EXPECT_LE(buffers[i].offset + buffers[i].size, traceBuff.offset);
+  }
+}
+
+TEST(Program, ComputeProgram_TraceSTM) {
+  auto untraced = generateConstants();
+  ASSERT_NE(nullptr, untraced.progDesc);
+  auto generated = generateConstants([](aicnwdesc::ProgramConfig &config) {
+    config.set_traceentries(100);
+    config.set_tracebackend(aicnwdesc::STM);
+  });
+  ASSERT_NE(nullptr, generated.progDesc);
+
+  // Events go to the STM port, there are no trace rings
+  auto progDesc = generated.progDesc;
+  EXPECT_EQ(TRACE_BACKEND_STM, progDesc->traceBackend);
+  EXPECT_EQ(0, progDesc->traceEntries);
+  EXPECT_EQ(untraced.progDesc->numBuffs, progDesc->numBuffs);
+}
+
 TEST(Program, ComputeProgram_GenerateNetworkDcriptor) {
   ProgramConfig config;
   ASSERT_TRUE(config.loadFromFile("test_program.json"));
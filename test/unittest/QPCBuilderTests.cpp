@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <fstream>
+#include <iterator>
 #include <gtest/gtest.h>
 
 #include "program/QPCBuilder.h"
@@ -249,3 +250,245 @@ TEST(Program, QPCBuilder_RoundTripSerialize) {
   destroyQpcHandle(testQPCHandle);
   destroyQpcHandle(expectedQPCHandle);
 }
+
+// Writes a small QPC file with buildFromSegments and returns its path
+static std::string writeTestQpcFile(const char *name) {
+  static char elf[] = "network.elf";
+  static char constants[] = "constants.bin";
+  static char desc[] = "networkdesc.bin";
+  static uint8_t elfData[] = {0x7f, 'E', 'L', 'F', 1, 2, 3};
+  static uint8_t descData[] = {42};
+
+  std::vector<QpcSegmentDesc> segments;
+  segments.emplace_back(sizeof(elfData), 0, elf, elfData);
+  segments.emplace_back(5, constants, "./qpc_segment_data.txt");
+  segments.emplace_back(sizeof(descData), 0, desc, descData);
+
+  std::string path = std::string("./") + name;
+  EXPECT_EQ(0, buildFromSegments(segments, path));
+  return path;
+}
+
+TEST(Program, QPCBuilder_MapQpcFile) {
+  std::string path = writeTestQpcFile("mapped.qpc");
+
+  QAicQpcHandle *handle = nullptr;
+  ASSERT_EQ(0, mapQpcFile(&handle, path));
+  ASSERT_NE(nullptr, handle);
+
+  QAicQpc *qpc = nullptr;
+  ASSERT_EQ(0, getQpc(handle, &qpc));
+  ASSERT_NE(nullptr, qpc);
+  ASSERT_EQ(3, qpc->numImages);
+  EXPECT_STREQ("network.elf", qpc->images[0].name);
+  EXPECT_EQ(7, qpc->images[0].size);
+  EXPECT_EQ('E', qpc->images[0].start[1]);
+  EXPECT_STREQ("networkdesc.bin", qpc->images[2].name);
+  EXPECT_EQ(42, qpc->images[2].start[0]);
+
+  // Segments point into the mapped file
+  uint8_t *serializedQpc = nullptr;
+  size_t serializedQpcSize = 0;
+  ASSERT_EQ(0, getSerializedQpc(handle, &serializedQpc, &serializedQpcSize));
+  EXPECT_GE(qpc->images[1].start, serializedQpc);
+  EXPECT_LE(qpc->images[1].start + qpc->images[1].size,
+            serializedQpc + serializedQpcSize);
+
+  // Static and dynamic constants are resolved in place
+  uint8_t *segBuf = nullptr;
+  size_t segSize = 0;
+  ASSERT_TRUE(getQPCSegment(handle, "constants.bin", &segBuf, &segSize, 0));
+  EXPECT_EQ(qpc->images[1].start, segBuf);
+  EXPECT_EQ(5, segSize);
+  EXPECT_EQ(0, std::memcmp("test ", segBuf, segSize));
+  ASSERT_TRUE(getQPCSegment(handle, "constants.bin", &segBuf, &segSize, 1));
+  EXPECT_EQ(qpc->images[1].start + 5, segBuf);
+  EXPECT_EQ(25, segSize);
+  EXPECT_EQ(0, std::memcmp("data from file", segBuf, 14));
+  EXPECT_FALSE(getQPCSegment(handle, "badseg", &segBuf, &segSize, 0));
+
+  // A copy of the mapped file is a regular serialized QPC
+  std::vector<uint8_t> copy(serializedQpcSize);
+  ASSERT_NE(nullptr,
+            copyQpcBuffer(copy.data(), serializedQpc, serializedQpcSize));
+  EXPECT_TRUE(compareQpc(qpc, reinterpret_cast<QAicQpc *>(copy.data())));
+
+  // Mapped handles are read-only
+  EXPECT_EQ(-EPERM, buildFromQpc(handle, qpc));
+
+  destroyQpcHandle(handle);
+}
+
+TEST(Program, QPCBuilder_MapQpcFileInvalid) {
+  std::string path = writeTestQpcFile("corrupt.qpc");
+  std::vector<char> contents;
+  {
+    std::ifstream ifs(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(ifs),
+                    std::istreambuf_iterator<char>());
+  }
+  ASSERT_GT(contents.size(), sizeof(QAicQpc));
+
+  auto mapContents = [&](const std::vector<char> &data) {
+    {
+      std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+      ofs.write(data.data(), data.size());
+    }
+    QAicQpcHandle *handle = nullptr;
+    int rc = mapQpcFile(&handle, path);
+    EXPECT_EQ(nullptr, handle);
+    destroyQpcHandle(handle);
+    return rc;
+  };
+
+  // Bad magic number
+  std::vector<char> badMagic = contents;
+  badMagic[0] ^= 0xff;
+  EXPECT_EQ(-EINVAL, mapContents(badMagic));
+
+  // Truncated file
+  std::vector<char> truncated(contents.begin(), contents.end() - 1);
+  EXPECT_EQ(-EINVAL, mapContents(truncated));
+
+  // Segment table pointing past the end of the file
+  std::vector<char> badImages = contents;
+  reinterpret_cast<QAicQpc *>(badImages.data())->numImages = 1000;
+  EXPECT_EQ(-EINVAL, mapContents(badImages));
+
+  // Segment data pointing past the end of the file
+  std::vector<char> badSegment = contents;
+  QAicQpc *qpc = reinterpret_cast<QAicQpc *>(badSegment.data());
+  QpcSegment *images = reinterpret_cast<QpcSegment *>(
+      badSegment.data() + reinterpret_cast<uintptr_t>(qpc->images));
+  images[0].size = badSegment.size();
+  EXPECT_EQ(-EINVAL, mapContents(badSegment));
+
+  QAicQpcHandle *handle = nullptr;
+  EXPECT_NE(0, mapQpcFile(&handle, "./does_not_exist.qpc"));
+  EXPECT_EQ(nullptr, handle);
+}
+
+TEST(Program, QPCBuilder_CompressedRoundTrip) {
+  // A zero padded image spanning several chunks and a small segment
+  std::vector<uint8_t> image(3 * AICQPC_DEFAULT_CHUNK_SIZE + 123, 0);
+  for (size_t i = 0; i < image.size(); i += 4096)
+    image[i] = i / 4096;
+  StringRef data = "a quick fox jumped";
+
+  auto buildQPC = [&](bool compress) {
+    QPCBuilder builder;
+    builder.addSegment("image", ArrayRef<uint8_t>(image));
+    builder.addSegment("data", data);
+    if (compress) {
+      builder.setSegmentCompression("image", QPC_CODEC_ZLIB);
+      builder.setSegmentCompression("data", QPC_CODEC_ZLIB);
+    }
+    return builder.finalizeToByteArray();
+  };
+
+  auto serializedQPCBuf = buildQPC(true);
+  auto expectedQPCBuf = buildQPC(false);
+  EXPECT_LT(serializedQPCBuf.size(), image.size() / 10);
+  EXPECT_EQ(COMPRESSED, reinterpret_cast<QAicQpc *>(serializedQPCBuf.data())
+                            ->hdr.compressionType);
+
+  // Compressed segments cannot be returned in place, small segments that do
+  // not shrink are stored as is
+  uint8_t *segBuf = nullptr;
+  size_t segSize = 0;
+  EXPECT_FALSE(getQPCSegment(serializedQPCBuf.data(), "image", &segBuf,
+                             &segSize, 0));
+  ASSERT_TRUE(
+      getQPCSegment(serializedQPCBuf.data(), "data", &segBuf, &segSize, 0));
+  EXPECT_EQ(0, std::memcmp(data.data(), segBuf, data.size() + 1));
+
+  // Reading the QPC back decompresses the segments
+  QAicQpcHandle *testQPCHandle = nullptr;
+  ASSERT_EQ(0, createQpcHandle(&testQPCHandle, CompressionType::SLOWPATH));
+  ASSERT_EQ(0, buildFromByteArray(testQPCHandle, serializedQPCBuf.data()));
+
+  QAicQpc *testQPC = nullptr;
+  getQpc(testQPCHandle, &testQPC);
+  ASSERT_NE(nullptr, testQPC);
+  EXPECT_TRUE(compareQpc(
+      testQPC, reinterpret_cast<QAicQpc *>(expectedQPCBuf.data()), true));
+
+  destroyQpcHandle(testQPCHandle);
+}
+
+TEST(Program, QPCBuilder_MapCompressedQpcFile) {
+  static char elf[] = "network.elf";
+  static char constants[] = "constants.bin";
+  std::vector<uint8_t> elfData(AICQPC_DEFAULT_CHUNK_SIZE + 1, 0x7f);
+
+  std::vector<QpcSegmentDesc> segments;
+  segments.emplace_back(elfData.size(), 0, elf, elfData.data(),
+                        QPC_CODEC_ZLIB);
+  segments.emplace_back(5, constants, "./qpc_segment_data.txt",
+                        QPC_CODEC_ZLIB);
+  ASSERT_EQ(0, buildFromSegments(segments, "./compressed.qpc"));
+
+  QAicQpcHandle *handle = nullptr;
+  ASSERT_EQ(0, mapQpcFile(&handle, "./compressed.qpc"));
+
+  uint8_t *serializedQpc = nullptr;
+  size_t serializedQpcSize = 0;
+  ASSERT_EQ(0, getSerializedQpc(handle, &serializedQpc, &serializedQpcSize));
+  EXPECT_LT(serializedQpcSize, elfData.size() / 10);
+
+  QAicQpc *qpc = nullptr;
+  ASSERT_EQ(0, getQpc(handle, &qpc));
+  ASSERT_EQ(2, qpc->numImages);
+  EXPECT_EQ(SLOWPATH, qpc->hdr.compressionType);
+  ASSERT_EQ(elfData.size(), qpc->images[0].size);
+  EXPECT_EQ(0, std::memcmp(elfData.data(), qpc->images[0].start,
+                           elfData.size()));
+
+  uint8_t *segBuf = nullptr;
+  size_t segSize = 0;
+  ASSERT_TRUE(getQPCSegment(handle, "constants.bin", &segBuf, &segSize, 1));
+  EXPECT_EQ(25, segSize);
+  EXPECT_EQ(0, std::memcmp("data from file", segBuf, 14));
+
+  destroyQpcHandle(handle);
+}
+
+TEST(Program, QPCBuilder_FinalizeToFile) {
+  QPCBuilder builder;
+
+  const char elf[] = {0x7f, 'E', 'L', 'F'};
+  builder.addSegment("network.elf", ArrayRef<char>(elf));
+  ASSERT_TRUE(builder.addStreamedSegmentFromFile("constants.bin",
+                                                 "./qpc_segment_data.txt"));
+  ASSERT_TRUE(
+      builder.addStreamedSegmentFromFile("seg0", "./qpc_segment_data.txt"));
+  builder.setSegmentCompression("seg0", QPC_CODEC_ZLIB);
+  EXPECT_FALSE(builder.addStreamedSegmentFromFile("seg1", "./does_not_exist"));
+
+  EXPECT_TRUE(builder.hasSegment("seg0"));
+  EXPECT_EQ(3, builder.getNumSegments());
+  EXPECT_EQ(30, builder.getSegmentOffset("constants.bin"));
+
+  ASSERT_TRUE(builder.finalizeToFile("./streamed.qpc"));
+  EXPECT_EQ(0, builder.getNumSegments());
+
+  QAicQpcHandle *handle = nullptr;
+  ASSERT_EQ(0, mapQpcFile(&handle, "./streamed.qpc"));
+
+  uint8_t *segBuf = nullptr;
+  size_t segSize = 0;
+  ASSERT_TRUE(getQPCSegment(handle, "network.elf", &segBuf, &segSize, 0));
+  EXPECT_EQ(sizeof(elf), segSize);
+  EXPECT_EQ(0, std::memcmp(elf, segBuf, sizeof(elf)));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(segBuf) % 8);
+
+  ASSERT_TRUE(getQPCSegment(handle, "constants.bin", &segBuf, &segSize, 0));
+  EXPECT_EQ(30, segSize);
+  EXPECT_EQ(0, std::memcmp("test data from file 1234567890", segBuf, 30));
+
+  ASSERT_TRUE(getQPCSegment(handle, "seg0", &segBuf, &segSize, 0));
+  EXPECT_EQ(30, segSize);
+  EXPECT_EQ(0, std::memcmp("test data from file 1234567890", segBuf, 30));
+
+  destroyQpcHandle(handle);
+}
@@ -0,0 +1,157 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "program/STMDecoder.h"
+#include "../../runtime/lib/Trace.h"
+
+using namespace llvm;
+using namespace qaic;
+
+// Builds an STPv2 stream nibble by nibble
+class STMStream {
+public:
+  STMStream &nibbles(uint64_t value, unsigned n) {
+    for (unsigned i = n; i > 0; i--)
+      nibbles_.push_back((value >> (4 * (i - 1))) & 0xF);
+    return *this;
+  }
+
+  STMStream &async() {
+    for (int i = 0; i < 22; i++)
+      nibbles_.push_back(0xF);
+    nibbles_.push_back(0);
+    return *this;
+  }
+
+  // D64TS with a full timestamp
+  STMStream &d64ts(uint64_t data, uint64_t timestamp) {
+    return nibbles(0xF7, 2)
+        .nibbles(data, 16)
+        .nibbles(0xE, 1)
+        .nibbles(timestamp, 16);
+  }
+
+  std::vector<uint8_t> bytes() const {
+    std::vector<uint8_t> stream((nibbles_.size() + 1) / 2, 0);
+    for (size_t i = 0; i < nibbles_.size(); i++)
+      stream[i / 2] |= nibbles_[i] << (i % 2 ? 4 : 0);
+    return stream;
+  }
+
+private:
+  std::vector<uint8_t> nibbles_;
+};
+
+// stm_capture.bin is a capture of two NSPs with traffic of another STM
+// master, a second ASYNC and a packet cut off at the end
+TEST(Program, STMDecoder_DecodeCapture) {
+  auto capture = MemoryBuffer::getFile("./stm_capture.bin");
+  ASSERT_TRUE(!!capture);
+  std::vector<TraceRecord> records;
+  ASSERT_TRUE(
+      decodeSTMTrace(arrayRefFromStringRef((*capture)->getBuffer()), records));
+
+  struct {
+    uint16_t nsp, thread;
+    uint64_t timestamp;
+    uint16_t event;
+    uint8_t kind;
+    uint32_t payload;
+  } expected[] = {
+      {0, 0, 0x1000, TRACE_ACTIVATE, TRACE_BEGIN, 0},
+      {1, 0, 0x1010, TRACE_ACTIVATE, TRACE_BEGIN, 1},
+      {0, 0, 0x1020, TRACE_DMA_SUBMIT, TRACE_INSTANT, 4},
+      {0, 1, 0x1040, TRACE_DMA_WAIT, TRACE_BEGIN, 0},
+      {0, 1, 0x1080, TRACE_DMA_WAIT, TRACE_END, 0},
+      {0, 1, 0x1088, TRACE_DOORBELL, TRACE_INSTANT, 7},
+      {1, 2, 0x1100, TRACE_USER_EVENTS + 1, TRACE_INSTANT, 42},
+      // D64M has no timestamp of its own
+      {0, 0, 0x1100, TRACE_ACTIVATE, TRACE_END, 0},
+      {1, 0, 0x1200, TRACE_ACTIVATE, TRACE_END, 1},
+  };
+  ASSERT_EQ(sizeof(expected) / sizeof(expected[0]), records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(expected[i].nsp, records[i].nsp) << i;
+    EXPECT_EQ(expected[i].thread, records[i].thread) << i;
+    EXPECT_EQ(expected[i].timestamp, records[i].timestamp) << i;
+    EXPECT_EQ(expected[i].event, records[i].event) << i;
+    EXPECT_EQ(expected[i].kind, records[i].kind) << i;
+    EXPECT_EQ(expected[i].payload, records[i].payload) << i;
+  }
+}
+
+TEST(Program, STMDecoder_RuntimePackets) {
+  uint64_t packet =
+      traceSTMPacket(TRACE_USER_EVENTS + 3, TRACE_END, 0xCAFE, 15, 5);
+  std::vector<TraceRecord> records;
+  ASSERT_TRUE(decodeSTMTrace(STMStream().async().d64ts(packet, 77).bytes(),
+                             records));
+  ASSERT_EQ(1U, records.size());
+  EXPECT_EQ(15, records[0].nsp);
+  EXPECT_EQ(5, records[0].thread);
+  EXPECT_EQ(77U, records[0].timestamp);
+  EXPECT_EQ(TRACE_USER_EVENTS + 3, records[0].event);
+  EXPECT_EQ(TRACE_END, records[0].kind);
+  EXPECT_EQ(0xCAFEU, records[0].payload);
+}
+
+TEST(Program, STMDecoder_RequiresAsync) {
+  uint64_t packet = traceSTMPacket(TRACE_DMA_SUBMIT, TRACE_INSTANT, 1, 0, 0);
+  std::vector<TraceRecord> records;
+  EXPECT_FALSE(decodeSTMTrace(STMStream().d64ts(packet, 1).bytes(), records));
+  // 20 0xF nibbles are too few for an ASYNC
+  auto stream = STMStream()
+                    .nibbles(0xFFFFF, 5)
+                    .nibbles(0xFFFFFFFFFFFFFFF0, 16)
+                    .d64ts(packet, 1)
+                    .bytes();
+  EXPECT_FALSE(decodeSTMTrace(stream, records));
+  EXPECT_TRUE(records.empty());
+}
+
+TEST(Program, STMDecoder_ResyncAfterInvalidPacket) {
+  uint64_t first = traceSTMPacket(TRACE_DMA_SUBMIT, TRACE_INSTANT, 1, 0, 0);
+  uint64_t second = traceSTMPacket(TRACE_DMA_SUBMIT, TRACE_INSTANT, 2, 0, 0);
+  // F02 is reserved, the packet after it is lost
+  auto stream = STMStream()
+                    .async()
+                    .nibbles(0xF02, 3)
+                    .d64ts(first, 10)
+                    .async()
+                    .d64ts(second, 20)
+                    .bytes();
+  std::vector<TraceRecord> records;
+  ASSERT_TRUE(decodeSTMTrace(stream, records));
+  ASSERT_EQ(1U, records.size());
+  EXPECT_EQ(2U, records[0].payload);
+  EXPECT_EQ(20U, records[0].timestamp);
+}
+
+TEST(Program, STMDecoder_TimestampFreq) {
+  uint64_t packet = traceSTMPacket(TRACE_DMA_SUBMIT, TRACE_INSTANT, 1, 0, 0);
+  std::vector<TraceRecord> records;
+  uint32_t freq = 1;
+  ASSERT_TRUE(decodeSTMTrace(STMStream().async().d64ts(packet, 1).bytes(),
+                             records, &freq));
+  EXPECT_EQ(0U, freq);
+
+  // The last FREQ applies
+  auto stream = STMStream()
+                    .async()
+                    .nibbles(0xF08, 3)
+                    .nibbles(19200000, 8)
+                    .d64ts(packet, 1)
+                    .nibbles(0xF08, 3)
+                    .nibbles(50000000, 8)
+                    .bytes();
+  records.clear();
+  ASSERT_TRUE(decodeSTMTrace(stream, records, &freq));
+  EXPECT_EQ(1U, records.size());
+  EXPECT_EQ(50000000U, freq);
+}
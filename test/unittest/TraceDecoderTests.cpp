@@ -0,0 +1,101 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "program/TraceDecoder.h"
+#include "../../runtime/lib/Trace.h"
+
+using namespace llvm;
+using namespace qaic;
+
+// Records numEvents events in the ring the way traceEvent does
+static void fillRing(std::vector<uint8_t> &buffer, uint32_t ring,
+                     uint32_t numEntries, uint16_t nsp, uint16_t thread,
+                     uint32_t numEvents) {
+  uint8_t *base = &buffer[ring * traceRingSize(numEntries)];
+  TraceRingHeader_t *header = (TraceRingHeader_t *)base;
+  header->numEvents = numEvents;
+  header->capacity = numEntries;
+  header->nsp = nsp;
+  header->thread = thread;
+  TraceEntry_t *entries = (TraceEntry_t *)(base + TRACE_RING_HEADER_SIZE);
+  for (uint32_t n = 0; n < numEvents; n++) {
+    TraceEntry_t &entry = entries[n & (numEntries - 1)];
+    entry.timestamp = 1000 + n * 192;
+    entry.event = TRACE_USER_EVENTS + n;
+    entry.kind = TRACE_INSTANT;
+    entry.payload = n;
+  }
+}
+
+TEST(Program, TraceDecoder_DecodeRings) {
+  const uint32_t numEntries = 8;
+  std::vector<uint8_t> buffer(3 * traceRingSize(numEntries), 0);
+  fillRing(buffer, 0, numEntries, /*nsp*/ 0, /*thread*/ 0, 3);
+  // Ring 1 didn't run, ring 2 wrapped
+  fillRing(buffer, 2, numEntries, /*nsp*/ 1, /*thread*/ 0, 11);
+
+  std::vector<TraceRecord> records;
+  ASSERT_TRUE(decodeTrace(buffer, numEntries, records));
+  ASSERT_EQ(3 + numEntries, records.size());
+  for (uint32_t i = 0; i < 3; i++) {
+    EXPECT_EQ(0, records[i].nsp);
+    EXPECT_EQ(i, records[i].payload);
+  }
+  // The wrapped ring holds its last numEntries events, oldest first
+  for (uint32_t i = 0; i < numEntries; i++) {
+    const TraceRecord &record = records[3 + i];
+    EXPECT_EQ(1, record.nsp);
+    EXPECT_EQ(3 + i, record.payload);
+    EXPECT_EQ(TRACE_USER_EVENTS + 3 + i, record.event);
+    EXPECT_EQ(1000 + (3 + i) * 192, record.timestamp);
+  }
+}
+
+TEST(Program, TraceDecoder_RejectPartialRings) {
+  std::vector<uint8_t> buffer(traceRingSize(8) + 16, 0);
+  std::vector<TraceRecord> records;
+  EXPECT_FALSE(decodeTrace(buffer, 8, records));
+  // Rings have a power of 2 entries
+  EXPECT_FALSE(decodeTrace(buffer, 12, records));
+}
+
+TEST(Program, TraceDecoder_WriteChromeTrace) {
+  std::vector<TraceRecord> records = {
+      {0, 1, 1000, TRACE_DMA_WAIT, TRACE_BEGIN, 0},
+      {0, 1, 1192, TRACE_DMA_WAIT, TRACE_END, 0},
+      {2, 0, 1384, TRACE_USER_EVENTS + 1, TRACE_INSTANT, 42}};
+  std::string json;
+  raw_string_ostream os(json);
+  writeChromeTrace(records, os);
+  os.flush();
+
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"NSP2\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"Thread 1\""));
+  // 192 UTIMER ticks are 10us
+  EXPECT_NE(std::string::npos,
+            json.find("{\"name\":\"DMA wait\",\"ph\":\"B\",\"ts\":0.000,"
+                      "\"pid\":0,\"tid\":1,"));
+  EXPECT_NE(std::string::npos,
+            json.find("{\"name\":\"DMA wait\",\"ph\":\"E\",\"ts\":10.000,"));
+  EXPECT_NE(std::string::npos,
+            json.find("{\"name\":\"event 257\",\"ph\":\"i\",\"ts\":20.000,"
+                      "\"pid\":2,\"tid\":0,\"s\":\"t\","
+                      "\"args\":{\"payload\":42}}"));
+}
+
+TEST(Program, TraceDecoder_WriteChromeTraceFreq) {
+  std::vector<TraceRecord> records = {
+      {0, 1, 1000, TRACE_DMA_WAIT, TRACE_BEGIN, 0},
+      {0, 1, 1500, TRACE_DMA_WAIT, TRACE_END, 0}};
+  std::string json;
+  raw_string_ostream os(json);
+  // 500 ticks at 50MHz are 10us
+  writeChromeTrace(records, os, 50000000);
+  os.flush();
+
+  EXPECT_NE(std::string::npos,
+            json.find("{\"name\":\"DMA wait\",\"ph\":\"E\",\"ts\":10.000,"));
+}
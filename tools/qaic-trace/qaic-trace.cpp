@@ -0,0 +1,80 @@
+// Copyright (c) Qualcomm Technologies, Inc. and/or its subsidiaries.
+// SPDX-License-Identifier: BSD-3-Clause-Clear
+
+// Converts the trace buffer of a compute program built with traceEntries, or
+// the STM capture of one built with --trace-backend=stm, to Chrome trace JSON,
+// for chrome://tracing or Perfetto.
+
+#include "program/STMDecoder.h"
+#include "program/TraceDecoder.h"
+#include "../../runtime/lib/SerializedProgramDesc.h"
+#include "../../runtime/lib/Trace.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace qaic;
+using namespace llvm;
+
+cl::opt<std::string> ConstantsFile(cl::Positional, cl::Required,
+                                   cl::desc("<constants.bin>"));
+cl::opt<std::string> TraceFile(cl::Positional, cl::Required,
+                               cl::desc("<trace buffer or STM capture>"));
+cl::opt<std::string> OutputFile("o", cl::desc("Output JSON file"),
+                                cl::value_desc("filename"), cl::init("-"));
+
+int main(int argc, const char *argv[]) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  auto constants = MemoryBuffer::getFile(ConstantsFile);
+  if (!constants) {
+    errs() << "Unable to read " << ConstantsFile << "\n";
+    return -1;
+  }
+  const SerializedProgramDesc_t *progDesc =
+      (const SerializedProgramDesc_t *)(*constants)->getBufferStart();
+  if ((*constants)->getBufferSize() < sizeof(SerializedProgramDesc_t) ||
+      progDesc->serialVersion != SERIALIZED_PROGRAMDESC_VERSION) {
+    errs() << ConstantsFile << " isn't a version "
+           << SERIALIZED_PROGRAMDESC_VERSION << " program descriptor\n";
+    return -1;
+  }
+  bool isSTM = progDesc->traceBackend == TRACE_BACKEND_STM;
+  if (!isSTM && progDesc->traceEntries == 0) {
+    errs() << "The program wasn't built with traceEntries\n";
+    return -1;
+  }
+
+  auto trace = MemoryBuffer::getFile(TraceFile);
+  if (!trace) {
+    errs() << "Unable to read " << TraceFile << "\n";
+    return -1;
+  }
+  std::vector<TraceRecord> records;
+  // Ring timestamps are UTIMER ticks, STM ones are at the FREQ packets'
+  // frequency
+  uint32_t ticksPerSecond = 0;
+  if (isSTM) {
+    if (!decodeSTMTrace(arrayRefFromStringRef((*trace)->getBuffer()), records,
+                        &ticksPerSecond)) {
+      errs() << TraceFile << " isn't an STM capture\n";
+      return -1;
+    }
+  } else if (!decodeTrace(arrayRefFromStringRef((*trace)->getBuffer()),
+                          progDesc->traceEntries, records)) {
+    errs() << TraceFile << " doesn't hold whole trace rings of "
+           << progDesc->traceEntries << " entries\n";
+    return -1;
+  }
+
+  std::error_code ec;
+  raw_fd_ostream os(OutputFile, ec, sys::fs::OF_None);
+  if (ec) {
+    errs() << "Unable to write " << OutputFile << ": " << ec.message() << "\n";
+    return -1;
+  }
+  writeChromeTrace(records, os, ticksPerSecond);
+  return 0;
+}